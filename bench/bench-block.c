@@ -0,0 +1,98 @@
+#include <rbtree.h>
+#include <rbtree_block.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// One key per node against RBTREE_BLOCK_KEYS keys per node: the same random
+// keys are inserted, looked up (hits in a scattered order), half erased, then
+// exported with to_array. bytes_per_key counts node memory only. bench-block
+// searches a block with SSE2, bench-block-avx2 (-mavx2) with AVX2 and
+// bench-block-16 is the AVX2 build with one cache line (16 keys) per block.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000, 10000000};
+#ifdef __AVX2__
+  const char *simd = "avx2";
+#else
+  const char *simd = "sse2";
+#endif
+
+  printf("impl,block_keys,n,insert_ns,find_ns,erase_ns,to_array_ms,"
+         "bytes_per_key\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    key_t *out = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+
+    rbtree *t = new_rbtree_pool(0);
+    double start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    double insert = (now_ns() - start) / n;
+    size_t found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      found += rbtree_find(t, keys[(i * 2654435761u) % n]) != NULL;
+    }
+    double find = (now_ns() - start) / n;
+    start = now_ns();
+    for (size_t i = 0; i < n / 2; i++) {
+      rbtree_erase(t, rbtree_find(t, keys[i]));
+    }
+    double erase = (now_ns() - start) / (n / 2);
+    start = now_ns();
+    rbtree_to_array(t, out, n);
+    double to_array = now_ns() - start;
+    printf("rbtree,1,%zu,%.1f,%.1f,%.1f,%.2f,%.1f\n", n, insert, find, erase,
+           to_array / 1e6, (double)sizeof(node_t));
+    delete_rbtree(t);
+
+    rbtree_block *bt = new_rbtree_block();
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_block_insert(bt, keys[i]);
+    }
+    double block_insert = (now_ns() - start) / n;
+    double bytes = (double)bt->tree->count *
+                   (sizeof(rbtree_block_node) + RBTREE_BLOCK_KEYS * 4) / n;
+    size_t block_found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      block_found += rbtree_block_find(bt, keys[(i * 2654435761u) % n]);
+    }
+    double block_find = (now_ns() - start) / n;
+    start = now_ns();
+    for (size_t i = 0; i < n / 2; i++) {
+      rbtree_block_erase(bt, keys[i]);
+    }
+    double block_erase = (now_ns() - start) / (n / 2);
+    start = now_ns();
+    rbtree_block_to_array(bt, out, n);
+    double block_to_array = now_ns() - start;
+    printf("block-%s,%d,%zu,%.1f,%.1f,%.1f,%.2f,%.1f\n", simd,
+           RBTREE_BLOCK_KEYS, n, block_insert, block_find, block_erase,
+           block_to_array / 1e6, bytes);
+
+    if (found != n || block_found != n ||
+        rbtree_block_size(bt) != n - n / 2) {
+      fprintf(stderr, "workload mismatch\n");
+      return 1;
+    }
+    delete_rbtree_block(bt);
+    free(keys);
+    free(out);
+  }
+  return 0;
+}
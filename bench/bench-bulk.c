@@ -0,0 +1,53 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Compare rebuilding a tree with an rbtree_insert loop against
+// rbtree_from_sorted / rbtree_from_array.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000};
+
+  printf("method,n,total_ms,ns_per_key\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+
+    double start = now_ns();
+    rbtree *t = new_rbtree_pool(0);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    double elapsed = now_ns() - start;
+    printf("insert_loop,%zu,%.2f,%.1f\n", n, elapsed / 1e6, elapsed / n);
+    delete_rbtree(t);
+
+    start = now_ns();
+    t = rbtree_from_array(keys, n);
+    elapsed = now_ns() - start;
+    printf("from_array,%zu,%.2f,%.1f\n", n, elapsed / 1e6, elapsed / n);
+
+    rbtree_to_array(t, keys, n);
+    delete_rbtree(t);
+
+    start = now_ns();
+    t = rbtree_from_sorted(keys, n);
+    elapsed = now_ns() - start;
+    printf("from_sorted,%zu,%.2f,%.1f\n", n, elapsed / 1e6, elapsed / n);
+    delete_rbtree(t);
+
+    free(keys);
+  }
+  return 0;
+}
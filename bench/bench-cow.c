@@ -0,0 +1,118 @@
+#include <rbtree.h>
+#include <rbtree_cow.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Persistent tree against the plain tree: building both from the same random
+// keys, then the cost of a version — rbtree_snapshot (one reference) against
+// rbtree_freeze (copy of every key). churn_ns erases and reinserts keys;
+// churn_snap_ns does the same with a new snapshot held across each update,
+// so every update copies its whole path, and drops the old one.
+
+#define CHURN_OPS 1000000
+#define SNAPSHOTS 1000
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000};
+
+  printf("n,insert_ns,cow_insert_ns,find_ns,cow_find_ns,freeze_us,snapshot_ns,"
+         "churn_ns,cow_churn_ns,cow_churn_snap_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+
+    rbtree *t = new_rbtree_pool(0);
+    double start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    double insert = (now_ns() - start) / n;
+
+    rbtree_cow *c = new_rbtree_cow();
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_cow_insert(c, keys[i]);
+    }
+    double cow_insert = (now_ns() - start) / n;
+
+    size_t found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      found += rbtree_find(t, keys[(i * 2654435761u) % n]) != NULL;
+    }
+    double find = (now_ns() - start) / n;
+
+    size_t cow_found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      cow_found += rbtree_cow_find(c, keys[(i * 2654435761u) % n]);
+    }
+    double cow_find = (now_ns() - start) / n;
+
+    start = now_ns();
+    rbtree_frozen *f = rbtree_freeze(t);
+    double freeze = now_ns() - start;
+    delete_rbtree_frozen(f);
+
+    rbtree_cow *snaps[SNAPSHOTS];
+    start = now_ns();
+    for (size_t i = 0; i < SNAPSHOTS; i++) {
+      snaps[i] = rbtree_snapshot(c);
+    }
+    double snapshot = (now_ns() - start) / SNAPSHOTS;
+    for (size_t i = 0; i < SNAPSHOTS; i++) {
+      delete_rbtree_cow(snaps[i]);
+    }
+
+    start = now_ns();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+      key_t key = keys[(i * 2654435761u) % n];
+      rbtree_erase(t, rbtree_find(t, key));
+      rbtree_insert(t, key);
+    }
+    double churn = (now_ns() - start) / CHURN_OPS;
+
+    start = now_ns();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+      key_t key = keys[(i * 2654435761u) % n];
+      rbtree_cow_erase(c, key);
+      rbtree_cow_insert(c, key);
+    }
+    double cow_churn = (now_ns() - start) / CHURN_OPS;
+
+    rbtree_cow *held = rbtree_snapshot(c);
+    start = now_ns();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+      key_t key = keys[(i * 2654435761u) % n];
+      rbtree_cow_erase(c, key);
+      rbtree_cow_insert(c, key);
+      delete_rbtree_cow(held);  // frees the nodes only the old version used
+      held = rbtree_snapshot(c);
+    }
+    double cow_churn_snap = (now_ns() - start) / CHURN_OPS;
+    delete_rbtree_cow(held);
+
+    if (found != n || cow_found != n || rbtree_cow_size(c) != n) {
+      fprintf(stderr, "workload mismatch\n");
+      return 1;
+    }
+    printf("%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", n, insert,
+           cow_insert, find, cow_find, freeze / 1e3, snapshot, churn,
+           cow_churn, cow_churn_snap);
+    delete_rbtree(t);
+    delete_rbtree_cow(c);
+    free(keys);
+  }
+  return 0;
+}
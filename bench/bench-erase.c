@@ -0,0 +1,80 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Deleting a fraction of a tree: rbtree_find + rbtree_erase per key (what
+// expiry jobs did before) against rbtree_erase_range on the same contiguous
+// key range, and rbtree_erase_batch on the same number of scattered nodes
+// next to a per-node rbtree_erase loop over those nodes.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// keys 0, 2, ..., 2(n - 1) inserted in a scattered order
+static rbtree *build(size_t n) {
+  rbtree *t = new_rbtree_pool(0);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, 2 * (key_t)((i * 2654435761u) % n));
+  }
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000, 10000000};
+  const int pcts[] = {1, 10, 50};
+
+  printf("n,erase_pct,find_erase_ms,erase_range_ms,erase_loop_ms,erase_batch_ms\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t p = 0; p < sizeof(pcts) / sizeof(pcts[0]); p++) {
+      const size_t n = sizes[s], k = n * pcts[p] / 100;
+      const key_t lo = 2 * (key_t)(n / 3), hi = lo + 2 * (key_t)k;
+      node_t **nodes = malloc(k * sizeof(node_t *));
+
+      rbtree *t = build(n);
+      double start = now_ns();
+      for (key_t key = lo; key < hi; key += 2) {
+        rbtree_erase(t, rbtree_find(t, key));
+      }
+      double find_erase = now_ns() - start;
+      delete_rbtree(t);
+
+      t = build(n);
+      start = now_ns();
+      size_t erased = rbtree_erase_range(t, lo, hi);
+      double range = now_ns() - start;
+      delete_rbtree(t);
+
+      // every (n / k)-th key, collected up front so only the erase is timed
+      double elapsed[2];
+      for (int batch = 0; batch < 2; batch++) {
+        t = build(n);
+        for (size_t i = 0; i < k; i++) {
+          nodes[i] = rbtree_find(t, 2 * (key_t)(i * (n / k)));
+        }
+        start = now_ns();
+        if (batch) {
+          erased += rbtree_erase_batch(t, nodes, k);
+        } else {
+          for (size_t i = 0; i < k; i++) {
+            rbtree_erase(t, nodes[i]);
+          }
+        }
+        elapsed[batch] = now_ns() - start;
+        delete_rbtree(t);
+      }
+
+      if (erased != 2 * k) {
+        fprintf(stderr, "erase count mismatch\n");
+        return 1;
+      }
+      printf("%zu,%d,%.2f,%.2f,%.2f,%.2f\n", n, pcts[p], find_erase / 1e6,
+             range / 1e6, elapsed[0] / 1e6, elapsed[1] / 1e6);
+      free(nodes);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Lookup throughput of one rbtree_find per key against rbtree_find_batch
+// over batches of BATCH keys, by tree size. The gap should open up once the
+// tree no longer fits in the last-level cache.
+
+#define BATCH 256
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000, 10000000};
+  const size_t lookups = 2000000;
+
+  printf("n,find_ns,find_batch_ns,speedup\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    key_t *queries = malloc(lookups * sizeof(key_t));
+    node_t *out[BATCH];
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+    for (size_t i = 0; i < lookups; i++) {
+      queries[i] = keys[rand() % n];
+    }
+    rbtree *t = new_rbtree_pool(0);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+
+    size_t found = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      found += rbtree_find(t, queries[i]) != NULL;
+    }
+    double single = (now_ns() - start) / lookups;
+
+    size_t batch_found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i += BATCH) {
+      size_t m = lookups - i < BATCH ? lookups - i : BATCH;
+      batch_found += rbtree_find_batch(t, queries + i, m, out);
+    }
+    double batched = (now_ns() - start) / lookups;
+
+    if (found != lookups || batch_found != lookups) {
+      fprintf(stderr, "lookup mismatch\n");
+      return 1;
+    }
+    printf("%zu,%.1f,%.1f,%.2f\n", n, single, batched, single / batched);
+    delete_rbtree(t);
+    free(keys);
+    free(queries);
+  }
+  return 0;
+}
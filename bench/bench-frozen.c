@@ -0,0 +1,81 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Lookups on the live tree (rbtree_find, rbtree_lower_bound) against the
+// same queries on an rbtree_freeze snapshot, by tree size. Half of the
+// queries miss.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000, 10000000};
+  const size_t lookups = 2000000;
+
+  printf("n,freeze_ms,find_ns,frozen_find_ns,lower_bound_ns,frozen_lower_bound_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    key_t *queries = malloc(lookups * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = 2 * (rand() / 2);
+    }
+    for (size_t i = 0; i < lookups; i++) {
+      queries[i] = keys[rand() % n] + (i & 1);
+    }
+    rbtree *t = new_rbtree_pool(0);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+
+    double start = now_ns();
+    rbtree_frozen *f = rbtree_freeze(t);
+    double freeze = now_ns() - start;
+
+    size_t found = 0, frozen_found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      found += rbtree_find(t, queries[i]) != NULL;
+    }
+    double find = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      frozen_found += rbtree_frozen_find(f, queries[i]);
+    }
+    double frozen_find = (now_ns() - start) / lookups;
+
+    size_t sum = 0, frozen_sum = 0;
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      node_t *p = rbtree_lower_bound(t, queries[i]);
+      sum += p != NULL ? p->key : 0;
+    }
+    double lower_bound = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      key_t key;
+      frozen_sum += rbtree_frozen_lower_bound(f, queries[i], &key) ? key : 0;
+    }
+    double frozen_lower_bound = (now_ns() - start) / lookups;
+
+    if (found != frozen_found || sum != frozen_sum) {
+      fprintf(stderr, "snapshot mismatch\n");
+      return 1;
+    }
+    printf("%zu,%.2f,%.1f,%.1f,%.1f,%.1f\n", n, freeze / 1e6, find,
+           frozen_find, lower_bound, frozen_lower_bound);
+    delete_rbtree_frozen(f);
+    delete_rbtree(t);
+    free(keys);
+    free(queries);
+  }
+  return 0;
+}
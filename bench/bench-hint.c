@@ -0,0 +1,92 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Insert and lookup cost by key stream: rbtree_insert against
+// rbtree_insert_hint with the previously inserted node as hint, then
+// rbtree_find against rbtree_find_near with the previous hit as finger,
+// walking the keys in stream order. "asc" takes the append-to-max path of
+// rbtree_insert; "desc" is its mirror image and still descends from the
+// root; "near" is ascending with 10% of the keys moved back a little.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fill(key_t *keys, size_t n, const char *stream) {
+  srand(17);
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(stream, "asc") == 0) {
+      keys[i] = (key_t)i;
+    } else if (strcmp(stream, "desc") == 0) {
+      keys[i] = (key_t)(n - i);
+    } else if (strcmp(stream, "near") == 0) {
+      keys[i] = (key_t)i - (rand() % 10 == 0 ? rand() % 64 : 0);
+    } else {
+      keys[i] = rand();
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000, 10000000};
+  const char *streams[] = {"asc", "desc", "near", "random"};
+
+  printf("stream,n,insert_ns,insert_hint_ns,find_ns,find_near_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    for (size_t d = 0; d < sizeof(streams) / sizeof(streams[0]); d++) {
+      fill(keys, n, streams[d]);
+
+      rbtree *t = new_rbtree_pool(0);
+      double start = now_ns();
+      for (size_t i = 0; i < n; i++) {
+        rbtree_insert(t, keys[i]);
+      }
+      double insert = (now_ns() - start) / n;
+
+      rbtree *u = new_rbtree_pool(0);
+      node_t *hint = NULL;
+      start = now_ns();
+      for (size_t i = 0; i < n; i++) {
+        hint = rbtree_insert_hint(u, hint, keys[i]);
+      }
+      double insert_hint = (now_ns() - start) / n;
+
+      size_t found = 0;
+      start = now_ns();
+      for (size_t i = 0; i < n; i++) {
+        found += rbtree_find(t, keys[i]) != NULL;
+      }
+      double find = (now_ns() - start) / n;
+
+      size_t near_found = 0;
+      node_t *finger = NULL;
+      start = now_ns();
+      for (size_t i = 0; i < n; i++) {
+        node_t *p = rbtree_find_near(t, finger, keys[i]);
+        if (p != NULL) {
+          finger = p;
+          near_found++;
+        }
+      }
+      double find_near = (now_ns() - start) / n;
+
+      if (found != n || near_found != n || rbtree_size(u) != n) {
+        fprintf(stderr, "stream mismatch\n");
+        return 1;
+      }
+      printf("%s,%zu,%.1f,%.1f,%.1f,%.1f\n", streams[d], n, insert,
+             insert_hint, find, find_near);
+      delete_rbtree(t);
+      delete_rbtree(u);
+    }
+    free(keys);
+  }
+  return 0;
+}
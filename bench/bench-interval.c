@@ -0,0 +1,91 @@
+#include <limits.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Stabbing queries (which intervals contain point p) on n random intervals
+// with mostly short and a few long lengths, built with -DRBTREE_INTERVAL.
+// "overlap" is rbtree_interval_overlap(p, p), which prunes subtrees by
+// max_hi; "scan" is what the plain tree can do: walk every interval starting
+// at or before p and test its end. hits is the average number reported.
+
+#define QUERIES 20000
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int count_hit(node_t *p, void *ctx) {
+  (*(size_t *)ctx)++;
+  return 0;
+}
+
+typedef struct {
+  key_t point;
+  size_t hits;
+} scan_ctx;
+
+static int scan_hit(node_t *p, void *ctx) {
+  scan_ctx *s = (scan_ctx *)ctx;
+  s->hits += s->point <= p->hi;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {10000, 100000, 1000000};
+  const key_t span = 100000000;
+
+  printf("impl,n,insert_ns,query_ns,hits\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *points = malloc(QUERIES * sizeof(key_t));
+    rbtree *t = new_rbtree_pool(0);
+    srand(17);
+    double start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      key_t lo = rand() % span;
+      key_t len = (rand() % 100 == 0) ? rand() % (span / 10) : rand() % 1000;
+      rbtree_interval_insert(t, lo, lo + len);
+    }
+    double insert = (now_ns() - start) / n;
+    for (size_t i = 0; i < QUERIES; i++) {
+      points[i] = rand() % span;
+    }
+
+    size_t hits = 0;
+    start = now_ns();
+    for (size_t i = 0; i < QUERIES; i++) {
+      rbtree_interval_overlap(t, points[i], points[i], count_hit, &hits);
+    }
+    double overlap = (now_ns() - start) / QUERIES;
+
+    // the scan is O(n) per query; fewer queries keep the big sizes short
+    const size_t scans = QUERIES * 1000 / n;
+    scan_ctx sc = {0, 0};
+    size_t overlap_hits = 0;
+    start = now_ns();
+    for (size_t i = 0; i < scans; i++) {
+      sc.point = points[i];
+      rbtree_range_foreach(t, INT_MIN, points[i] + 1, scan_hit, &sc);
+    }
+    double scan = (now_ns() - start) / scans;
+    for (size_t i = 0; i < scans; i++) {
+      rbtree_interval_overlap(t, points[i], points[i], count_hit,
+                              &overlap_hits);
+    }
+    if (overlap_hits != sc.hits) {
+      fprintf(stderr, "overlap and scan disagree\n");
+      return 1;
+    }
+    printf("overlap,%zu,%.1f,%.1f,%.1f\n", n, insert, overlap,
+           (double)hits / QUERIES);
+    printf("scan,%zu,%.1f,%.1f,%.1f\n", n, insert, scan,
+           (double)sc.hits / scans);
+    delete_rbtree(t);
+    free(points);
+  }
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Report node size, resident bytes per key and lookup speed for the node
+// layout this binary was built with (bench-layout-compact uses
+// -DRBTREE_COMPACT).
+
+#ifdef RBTREE_COMPACT
+#define LAYOUT "compact"
+#else
+#define LAYOUT "pointer"
+#endif
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// resident set size in bytes, from /proc/self/statm
+static long resident_bytes(void) {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(f);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000, 10000000};
+  const size_t lookups = 2000000;
+
+  printf("layout,n,node_bytes,rss_bytes_per_key,find_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+
+    long before = resident_bytes();
+    rbtree *t = new_rbtree_pool(0);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    long after = resident_bytes();
+
+    size_t found = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      found += rbtree_find(t, keys[(i * 2654435761u) % n]) != NULL;
+    }
+    double elapsed = now_ns() - start;
+    if (found != lookups) {
+      fprintf(stderr, "lookup mismatch\n");
+      return 1;
+    }
+
+    printf("%s,%zu,%zu,%.1f,%.1f\n", LAYOUT, n, sizeof(node_t),
+           (double)(after - before) / n, elapsed / lookups);
+    delete_rbtree(t);
+    free(keys);
+  }
+  return 0;
+}
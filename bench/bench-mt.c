@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <rbtree.h>
+#include <rbtree_sync.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Throughput of a shared tree as reader/writer threads are added: one
+// external mutex around the plain API (what callers did before) against
+// rbtree_sync in rwlock and optimistic (seqlock) mode.
+
+#define BENCH_KEYS 100000
+#define BENCH_OPS 500000  // per thread
+
+typedef enum { MODE_MUTEX, MODE_RWLOCK, MODE_OPTIMISTIC } bench_mode;
+static const char *mode_names[] = {"mutex", "rwlock", "optimistic"};
+
+typedef struct {
+  bench_mode mode;
+  rbtree *tree;  // MODE_MUTEX
+  pthread_mutex_t *lock;  // MODE_MUTEX
+  rbtree_sync *s;  // other modes
+  unsigned int seed;
+  int read_pct;
+} bench_arg;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *worker(void *p) {
+  bench_arg *a = (bench_arg *)p;
+  size_t found = 0;
+  for (int i = 0; i < BENCH_OPS; i++) {
+    key_t key = rand_r(&a->seed) % (2 * BENCH_KEYS);
+    int read = (int)(rand_r(&a->seed) % 100) < a->read_pct;
+    if (a->mode == MODE_MUTEX) {
+      pthread_mutex_lock(a->lock);
+      if (read) {
+        found += rbtree_find(a->tree, key) != NULL;
+      } else if (i & 1) {
+        rbtree_insert(a->tree, key);
+      } else {
+        node_t *n = rbtree_find(a->tree, key);
+        if (n != NULL) {
+          rbtree_erase(a->tree, n);
+        }
+      }
+      pthread_mutex_unlock(a->lock);
+    } else if (read) {
+      found += rbtree_sync_find(a->s, key);
+    } else if (i & 1) {
+      rbtree_sync_insert(a->s, key);
+    } else {
+      rbtree_sync_erase(a->s, key);
+    }
+  }
+  return (void *)found;
+}
+
+static void run(bench_mode mode, int nthreads, int read_pct) {
+  rbtree *t = NULL;
+  rbtree_sync *s = NULL;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+  if (mode == MODE_MUTEX) {
+    t = new_rbtree_pool(0);
+  } else {
+    s = new_rbtree_sync(mode == MODE_RWLOCK ? RBTREE_SYNC_RWLOCK
+                                            : RBTREE_SYNC_OPTIMISTIC);
+  }
+  for (key_t k = 0; k < 2 * BENCH_KEYS; k += 2) {
+    if (t != NULL) {
+      rbtree_insert(t, k);
+    } else {
+      rbtree_sync_insert(s, k);
+    }
+  }
+
+  pthread_t tid[nthreads];
+  bench_arg args[nthreads];
+  double start = now_ns();
+  for (int i = 0; i < nthreads; i++) {
+    args[i] = (bench_arg){mode, t, &lock, s, 17 + i, read_pct};
+    pthread_create(&tid[i], NULL, worker, &args[i]);
+  }
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  double elapsed = now_ns() - start;
+
+  printf("%s,%d,%d,%.2f\n", mode_names[mode], nthreads, read_pct,
+         (double)nthreads * BENCH_OPS / elapsed * 1e3);
+  if (t != NULL) {
+    delete_rbtree(t);
+  } else {
+    delete_rbtree_sync(s);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const int threads[] = {1, 2, 4, 8};
+  const int read_pcts[] = {90, 99};
+
+  printf("mode,threads,read_pct,mops\n");
+  for (size_t r = 0; r < sizeof(read_pcts) / sizeof(read_pcts[0]); r++) {
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+      for (int m = MODE_MUTEX; m <= MODE_OPTIMISTIC; m++) {
+        run((bench_mode)m, threads[i], read_pcts[r]);
+      }
+    }
+  }
+  return 0;
+}
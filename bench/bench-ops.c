@@ -0,0 +1,297 @@
+#include <math.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Per-operation timings for the public API across tree sizes and key
+// distributions, next to a sorted-array baseline (qsort + binary search).
+//
+//   ./bench-ops [--json] [--max N]
+//
+// Each row reports mean ns/op plus p50/p90/p99 over batches of BATCH ops
+// (timing single calls would mostly measure the clock), and the process
+// peak RSS so far. Sizes run in ascending order, so a row's peak is set by
+// its own size. Keys are even so that key + 1 is a guaranteed miss.
+
+#define BATCH 256
+#define LOOKUPS 1000000  // find/min/max calls per case
+#define TO_ARRAY_KEYS 10000000  // keys copied per to_array case
+#define ZIPF_THETA 0.99
+
+typedef struct {
+  double *v;
+  size_t n, cap;
+  double total_ns;
+  size_t ops;
+} samples;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void samples_add(samples *s, double elapsed, size_t ops) {
+  if (s->n == s->cap) {
+    s->cap = s->cap ? 2 * s->cap : 1024;
+    s->v = realloc(s->v, s->cap * sizeof(double));
+  }
+  s->v[s->n++] = elapsed / ops;
+  s->total_ns += elapsed;
+  s->ops += ops;
+}
+
+// time body for i in [0, total), one sample per BATCH iterations
+#define TIMED_LOOP(s, total, body)                                 \
+  do {                                                             \
+    size_t batch_start_ = 0;                                       \
+    double t0_ = now_ns();                                         \
+    for (size_t i = 0; i < (total); i++) {                         \
+      body;                                                        \
+      if (i + 1 - batch_start_ == BATCH || i + 1 == (total)) {     \
+        double t1_ = now_ns();                                     \
+        samples_add((s), t1_ - t0_, i + 1 - batch_start_);         \
+        batch_start_ = i + 1;                                      \
+        t0_ = t1_;                                                 \
+      }                                                            \
+    }                                                              \
+  } while (0)
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int compare_key(const void *a, const void *b) {
+  key_t x = *(const key_t *)a, y = *(const key_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int json;
+static int rows;
+
+static void report(const char *impl, const char *dist, size_t n,
+                   const char *op, samples *s) {
+  qsort(s->v, s->n, sizeof(double), compare_double);
+  double p50 = s->v[s->n / 2];
+  double p90 = s->v[s->n * 9 / 10];
+  double p99 = s->v[s->n * 99 / 100];
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  if (json) {
+    printf("%s  {\"impl\": \"%s\", \"dist\": \"%s\", \"n\": %zu, "
+           "\"op\": \"%s\", \"ns_per_op\": %.2f, \"p50\": %.2f, "
+           "\"p90\": %.2f, \"p99\": %.2f, \"peak_rss_kb\": %ld}",
+           rows ? ",\n" : "", impl, dist, n, op, s->total_ns / s->ops, p50,
+           p90, p99, ru.ru_maxrss);
+  } else {
+    printf("%s,%s,%zu,%s,%.2f,%.2f,%.2f,%.2f,%ld\n", impl, dist, n, op,
+           s->total_ns / s->ops, p50, p90, p99, ru.ru_maxrss);
+  }
+  rows++;
+  s->n = 0;
+  s->total_ns = 0;
+  s->ops = 0;
+}
+
+static unsigned long long rng_state = 17;
+
+static unsigned long long rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// Zipfian ranks in [0, n) (Gray et al., as used by YCSB), scattered over
+// the key range so the hot keys are not all neighbours
+static void fill_zipf(key_t *keys, size_t n) {
+  double zetan = 0;
+  for (size_t i = 1; i <= n; i++) {
+    zetan += 1.0 / pow((double)i, ZIPF_THETA);
+  }
+  double zeta2 = 1.0 + 1.0 / pow(2.0, ZIPF_THETA);
+  double alpha = 1.0 / (1.0 - ZIPF_THETA);
+  double eta = (1.0 - pow(2.0 / n, 1.0 - ZIPF_THETA)) / (1.0 - zeta2 / zetan);
+
+  for (size_t i = 0; i < n; i++) {
+    double u = (double)(rng() >> 11) / (double)(1ULL << 53);
+    double uz = u * zetan;
+    size_t rank;
+    if (uz < 1.0) {
+      rank = 0;
+    } else if (uz < zeta2) {
+      rank = 1;
+    } else {
+      rank = (size_t)(n * pow(eta * u - eta + 1.0, alpha));
+      if (rank >= n) {
+        rank = n - 1;
+      }
+    }
+    keys[i] = 2 * (key_t)((rank * 2654435761u) % n);
+  }
+}
+
+static void fill_keys(key_t *keys, size_t n, const char *dist) {
+  rng_state = 17;
+  if (strcmp(dist, "zipf") == 0) {
+    fill_zipf(keys, n);
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(dist, "seq") == 0) {
+      keys[i] = 2 * (key_t)i;
+    } else if (strcmp(dist, "random") == 0) {
+      keys[i] = 2 * (key_t)(rng() % (1u << 30));
+    } else {  // dup: about 64 copies of each key
+      keys[i] = 2 * (key_t)(rng() % (n / 64 + 1));
+    }
+  }
+}
+
+// lookup i walks the stream in a scattered but repeatable order
+static size_t probe(size_t i, size_t n) {
+  return (i * 2654435761u) % n;
+}
+
+// branch-free lower bound (n > 0), so the baseline is not held back by
+// mispredicted comparisons
+static size_t lower_bound(const key_t *arr, size_t n, key_t key) {
+  const key_t *base = arr;
+  while (n > 1) {
+    size_t half = n / 2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+  return (base - arr) + (*base < key);
+}
+
+static volatile size_t sink;
+
+static void bench_rbtree(const char *dist, const key_t *keys, size_t n,
+                         key_t *out, samples *s) {
+  rbtree *t = new_rbtree_pool(0);
+  size_t hits = 0;
+
+  TIMED_LOOP(s, n, rbtree_insert(t, keys[i]));
+  report("rbtree", dist, n, "insert", s);
+
+  TIMED_LOOP(s, LOOKUPS, hits += rbtree_find(t, keys[probe(i, n)]) != NULL);
+  report("rbtree", dist, n, "find_hit", s);
+
+  TIMED_LOOP(s, LOOKUPS,
+             hits += rbtree_find(t, keys[probe(i, n)] + 1) != NULL);
+  report("rbtree", dist, n, "find_miss", s);
+
+  TIMED_LOOP(s, LOOKUPS, hits += rbtree_min(t)->key);
+  report("rbtree", dist, n, "min", s);
+
+  TIMED_LOOP(s, LOOKUPS, hits += rbtree_max(t)->key);
+  report("rbtree", dist, n, "max", s);
+
+  // one sample per call, in ns per key copied
+  for (size_t r = 0; r == 0 || r * n < TO_ARRAY_KEYS; r++) {
+    double start = now_ns();
+    rbtree_to_array(t, out, n);
+    samples_add(s, now_ns() - start, n);
+  }
+  report("rbtree", dist, n, "to_array", s);
+
+  TIMED_LOOP(s, n, rbtree_erase(t, rbtree_find(t, keys[i])));
+  report("rbtree", dist, n, "erase", s);
+
+  sink = hits;
+  delete_rbtree(t);
+}
+
+// the same operations on a sorted array, where insert is bulk copy + qsort
+// (ns per key) and erase is not measured
+static void bench_sorted_array(const char *dist, const key_t *keys, size_t n,
+                               key_t *out, samples *s) {
+  key_t *arr = malloc(n * sizeof(key_t));
+  size_t hits = 0;
+
+  double start = now_ns();
+  memcpy(arr, keys, n * sizeof(key_t));
+  qsort(arr, n, sizeof(key_t), compare_key);
+  samples_add(s, now_ns() - start, n);
+  report("sorted_array", dist, n, "insert", s);
+
+  TIMED_LOOP(s, LOOKUPS, {
+    key_t key = keys[probe(i, n)];
+    size_t j = lower_bound(arr, n, key);
+    hits += j < n && arr[j] == key;
+  });
+  report("sorted_array", dist, n, "find_hit", s);
+
+  TIMED_LOOP(s, LOOKUPS, {
+    key_t key = keys[probe(i, n)] + 1;
+    size_t j = lower_bound(arr, n, key);
+    hits += j < n && arr[j] == key;
+  });
+  report("sorted_array", dist, n, "find_miss", s);
+
+  TIMED_LOOP(s, LOOKUPS, hits += ((volatile key_t *)arr)[0]);
+  report("sorted_array", dist, n, "min", s);
+
+  TIMED_LOOP(s, LOOKUPS, hits += ((volatile key_t *)arr)[n - 1]);
+  report("sorted_array", dist, n, "max", s);
+
+  for (size_t r = 0; r == 0 || r * n < TO_ARRAY_KEYS; r++) {
+    start = now_ns();
+    memcpy(out, arr, n * sizeof(key_t));
+    samples_add(s, now_ns() - start, n);
+  }
+  report("sorted_array", dist, n, "to_array", s);
+
+  sink = hits + out[n / 2];
+  free(arr);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 10000, 100000, 1000000, 10000000};
+  const char *dists[] = {"seq", "random", "zipf", "dup"};
+  size_t max_n = 10000000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      json = 1;
+    } else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+      max_n = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--json] [--max N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  samples s = {0};
+  if (json) {
+    printf("[\n");
+  } else {
+    printf("impl,dist,n,op,ns_per_op,p50,p90,p99,peak_rss_kb\n");
+  }
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    const size_t n = sizes[i];
+    if (n > max_n) {
+      break;
+    }
+    key_t *keys = malloc(n * sizeof(key_t));
+    key_t *out = malloc(n * sizeof(key_t));
+    for (size_t d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+      fill_keys(keys, n, dists[d]);
+      bench_sorted_array(dists[d], keys, n, out, &s);
+      bench_rbtree(dists[d], keys, n, out, &s);
+    }
+    free(keys);
+    free(out);
+  }
+  if (json) {
+    printf("\n]\n");
+  }
+  free(s.v);
+  return 0;
+}
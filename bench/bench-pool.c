@@ -0,0 +1,59 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Compare the calloc/free path (new_rbtree) with the slab pool
+// (new_rbtree_pool) under an insert/erase churn workload.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, rbtree *t, const key_t *keys,
+                const size_t n, const size_t rounds) {
+  double start = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  double fill = now_ns() - start;
+
+  // erase a random live key and insert a fresh one, rounds times
+  start = now_ns();
+  for (size_t r = 0; r < rounds; r++) {
+    node_t *p = rbtree_find(t, keys[r % n]);
+    if (p != NULL) {
+      rbtree_erase(t, p);
+    }
+    rbtree_insert(t, keys[(r * 7 + 3) % n]);
+  }
+  double churn = now_ns() - start;
+
+  start = now_ns();
+  delete_rbtree(t);
+  double teardown = now_ns() - start;
+
+  printf("%s,%zu,%.1f,%.1f,%.1f\n", name, n, fill / n, churn / rounds,
+         teardown / n);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000};
+  const size_t rounds = 1000000;
+
+  printf("allocator,n,insert_ns,churn_ns,teardown_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+    run("calloc", new_rbtree(), keys, n, rounds);
+    run("pool", new_rbtree_pool(0), keys, n, rounds);
+    free(keys);
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// The tree as a scheduler queue against an array binary heap: n timers are
+// pending, and each step takes the earliest one (now = its deadline) and
+// schedules a new timer at now + a random delay (the "hold" model). The tree
+// pops through rbtree_pop_min, which starts at the cached leftmost node
+// instead of walking down from the root. peek_ns is one rbtree_min (or
+// heap[0]) on the same queue. The heap stays ahead on this plain workload
+// (the tree pays for its insert descent); the tree is for queues that also
+// need cancel, ordered scans or pops from both ends.
+
+#define STEPS 4000000
+#define MAX_DELAY 100000  // now grows ~MAX_DELAY / n per step; stays far below INT_MAX
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void heap_push(key_t *h, size_t *n, const key_t key) {
+  size_t i = (*n)++;
+  while (i > 0 && h[(i - 1) / 2] > key) {
+    h[i] = h[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h[i] = key;
+}
+
+static key_t heap_pop(key_t *h, size_t *n) {
+  const key_t top = h[0], last = h[--(*n)];
+  size_t i = 0;
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= *n) {
+      break;
+    }
+    if (c + 1 < *n && h[c + 1] < h[c]) {
+      c++;
+    }
+    if (last <= h[c]) {
+      break;
+    }
+    h[i] = h[c];
+    i = c;
+  }
+  h[i] = last;
+  return top;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000};
+
+  printf("impl,n,step_ns,peek_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *delays = malloc(STEPS * sizeof(key_t));
+    key_t *heap = malloc((n + 1) * sizeof(key_t));
+    size_t hn = 0;
+    rbtree *t = new_rbtree_pool(0);
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      key_t key = rand() % MAX_DELAY;
+      heap_push(heap, &hn, key);
+      rbtree_insert(t, key);
+    }
+    for (size_t i = 0; i < STEPS; i++) {
+      delays[i] = 1 + rand() % MAX_DELAY;
+    }
+
+    long long sum = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < STEPS; i++) {
+      key_t now = heap_pop(heap, &hn);
+      heap_push(heap, &hn, now + delays[i]);
+      sum += now;
+    }
+    double heap_step = (now_ns() - start) / STEPS;
+    start = now_ns();
+    volatile key_t *top = heap;  // read every time, like a scheduler polling
+    for (size_t i = 0; i < STEPS; i++) {
+      sum += *top;
+    }
+    double heap_peek = (now_ns() - start) / STEPS;
+
+    start = now_ns();
+    for (size_t i = 0; i < STEPS; i++) {
+      key_t now;
+      rbtree_pop_min(t, &now);
+      rbtree_insert(t, now + delays[i]);
+      sum -= now;
+    }
+    double tree_step = (now_ns() - start) / STEPS;
+    start = now_ns();
+    for (size_t i = 0; i < STEPS; i++) {
+      sum -= rbtree_min(t)->key;
+    }
+    double tree_peek = (now_ns() - start) / STEPS;
+
+    // both queues went through the same deadlines and must drain the same
+    int same = sum == 0 && rbtree_size(t) == n;
+    key_t k;
+    while (same && hn > 0) {
+      same = rbtree_pop_min(t, &k) && k == heap_pop(heap, &hn);
+    }
+    if (!same || rbtree_size(t) != 0) {
+      fprintf(stderr, "heap and tree disagree\n");
+      return 1;
+    }
+    printf("heap,%zu,%.1f,%.2f\n", n, heap_step, heap_peek);
+    printf("rbtree,%zu,%.1f,%.2f\n", n, tree_step, tree_peek);
+    delete_rbtree(t);
+    free(heap);
+    free(delays);
+  }
+  return 0;
+}
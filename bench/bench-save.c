@@ -0,0 +1,74 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Restart cost: rebuilding a tree from source keys with rbtree_insert,
+// against rbtree_load (checksum + O(n) bulk build) and rbtree_frozen_open
+// (mmap only) followed by a first round of lookups, which pays the page
+// faults.
+
+#define FILE_PATH "bench-save.dat"
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000, 10000000};
+  const size_t lookups = 100000;
+
+  printf("n,rebuild_ms,save_ms,load_ms,open_ms,open_first_lookups_ms\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+
+    double start = now_ns();
+    rbtree *t = new_rbtree_pool(0);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    double rebuild = now_ns() - start;
+
+    start = now_ns();
+    if (rbtree_save(t, FILE_PATH) != 0) {
+      fprintf(stderr, "save failed\n");
+      return 1;
+    }
+    double save = now_ns() - start;
+
+    start = now_ns();
+    rbtree *u = rbtree_load(FILE_PATH);
+    double load = now_ns() - start;
+
+    start = now_ns();
+    rbtree_frozen *f = rbtree_frozen_open(FILE_PATH);
+    double open = now_ns() - start;
+
+    size_t found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      found += rbtree_frozen_find(f, keys[(i * 2654435761u) % n]);
+    }
+    double first = now_ns() - start;
+
+    if (u == NULL || f == NULL || found != lookups) {
+      fprintf(stderr, "reload mismatch\n");
+      return 1;
+    }
+    printf("%zu,%.2f,%.2f,%.2f,%.3f,%.2f\n", n, rebuild / 1e6, save / 1e6,
+           load / 1e6, open / 1e6, first / 1e6);
+    delete_rbtree_frozen(f);
+    delete_rbtree(u);
+    delete_rbtree(t);
+    free(keys);
+  }
+  remove(FILE_PATH);
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Merging two trees: the old way (rbtree_to_array on both, merge, then
+// rbtree_from_sorted) against rbtree_union, rbtree_union_parallel and the
+// join-based intersection/difference, by size of the larger tree and the
+// ratio of the smaller one. The trees own separate allocators, so every set
+// operation also pays for moving the smaller tree's slabs over.
+
+#define THREADS 4
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static rbtree *build(const key_t *keys, size_t n) {
+  rbtree *t = rbtree_from_array(keys, n);
+  if (t == NULL) {
+    fprintf(stderr, "build failed\n");
+    exit(1);
+  }
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000, 4000000};
+  const size_t ratios[] = {1, 10, 1000};
+
+  printf("n,m,array_merge_ms,union_ms,union_parallel_ms,intersection_ms,difference_ms\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++) {
+      const size_t n = sizes[s], m = n / ratios[r];
+      key_t *a = malloc(n * sizeof(key_t));
+      key_t *b = malloc(m * sizeof(key_t));
+      key_t *out = malloc((n + m) * sizeof(key_t));
+      srand(17);
+      for (size_t i = 0; i < n; i++) {
+        a[i] = rand();
+      }
+      for (size_t i = 0; i < m; i++) {
+        b[i] = rand();
+      }
+
+      rbtree *t1 = build(a, n), *t2 = build(b, m);
+      double start = now_ns();
+      rbtree_to_array(t1, a, n);
+      rbtree_to_array(t2, b, m);
+      size_t i = 0, j = 0, k = 0;
+      while (i < n || j < m) {
+        out[k++] = (j == m || (i < n && a[i] <= b[j])) ? a[i++] : b[j++];
+      }
+      rbtree *u = rbtree_from_sorted(out, k);
+      double merge = now_ns() - start;
+      delete_rbtree(t1);
+      delete_rbtree(t2);
+
+      double elapsed[4];
+      for (int op = 0; op < 4; op++) {
+        t1 = build(a, n);
+        t2 = build(b, m);
+        start = now_ns();
+        if (op == 0) {
+          t1 = rbtree_union(t1, t2);
+        } else if (op == 1) {
+          t1 = rbtree_union_parallel(t1, t2, THREADS);
+        } else if (op == 2) {
+          t1 = rbtree_intersection(t1, t2);
+        } else {
+          t1 = rbtree_difference(t1, t2);
+        }
+        elapsed[op] = now_ns() - start;
+        if (t1 == NULL || (op < 2 && rbtree_size(t1) != rbtree_size(u))) {
+          fprintf(stderr, "set operation mismatch\n");
+          return 1;
+        }
+        delete_rbtree(t1);
+      }
+
+      printf("%zu,%zu,%.2f,%.2f,%.2f,%.2f,%.2f\n", n, m, merge / 1e6,
+             elapsed[0] / 1e6, elapsed[1] / 1e6, elapsed[2] / 1e6,
+             elapsed[3] / 1e6);
+      delete_rbtree(u);
+      free(a);
+      free(b);
+      free(out);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Cost of the RBTREE_STATS counters: the same insert/find/erase workload
+// built as bench-stats (counters compiled out) and bench-stats-on
+// (-DRBTREE_STATS). The two CSVs should only differ by the price of the
+// counters; with them compiled out the hot paths build to the same code as
+// before they existed. bench-stats-on also writes rbtree_stats_dump for
+// each size to stderr.
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {1000, 100000, 1000000};
+  const size_t lookups = 2000000;
+#ifdef RBTREE_STATS
+  const char *build = "stats";
+#else
+  const char *build = "plain";
+#endif
+
+  printf("build,n,insert_ns,find_ns,erase_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+    rbtree *t = new_rbtree_pool(0);
+
+    double start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, keys[i]);
+    }
+    double insert = (now_ns() - start) / n;
+
+    size_t found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      found += rbtree_find(t, keys[(i * 2654435761u) % n]) != NULL;
+    }
+    double find = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_erase(t, rbtree_find(t, keys[i]));
+    }
+    double erase = (now_ns() - start) / n;
+
+    if (found != lookups || t->root != t->nil) {
+      fprintf(stderr, "workload mismatch\n");
+      return 1;
+    }
+    printf("%s,%zu,%.1f,%.1f,%.1f\n", build, n, insert, find, erase);
+    rbtree_stats_dump(t, stderr);
+    delete_rbtree(t);
+    free(keys);
+  }
+  return 0;
+}
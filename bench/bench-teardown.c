@@ -0,0 +1,73 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Teardown cost by tree size: delete_rbtree on a calloc tree (one free per
+// node) and on a pool tree (whole slabs), and a refill cycle that either
+// deletes the tree and builds a new one or calls rbtree_clear and inserts
+// into the slabs it kept.
+
+#define ROUNDS 3  // refill cycles per size
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static rbtree *fill(rbtree *t, const key_t *keys, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {10000, 100000, 1000000, 10000000};
+
+  printf("n,calloc_delete_ms,pool_delete_ms,delete_refill_ms,clear_refill_ms\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+
+    rbtree *t = fill(new_rbtree(), keys, n);
+    double start = now_ns();
+    delete_rbtree(t);
+    double calloc_delete = now_ns() - start;
+
+    t = fill(new_rbtree_pool(0), keys, n);
+    start = now_ns();
+    delete_rbtree(t);
+    double pool_delete = now_ns() - start;
+
+    t = fill(new_rbtree_pool(0), keys, n);
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+      delete_rbtree(t);
+      t = fill(new_rbtree_pool(0), keys, n);
+    }
+    double delete_refill = (now_ns() - start) / ROUNDS;
+
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+      rbtree_clear(t);
+      fill(t, keys, n);
+    }
+    double clear_refill = (now_ns() - start) / ROUNDS;
+
+    if (rbtree_size(t) != n) {
+      fprintf(stderr, "refill mismatch\n");
+      return 1;
+    }
+    printf("%zu,%.2f,%.3f,%.2f,%.2f\n", n, calloc_delete / 1e6,
+           pool_delete / 1e6, delete_refill / 1e6, clear_refill / 1e6);
+    delete_rbtree(t);
+    free(keys);
+  }
+  return 0;
+}
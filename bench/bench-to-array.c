@@ -0,0 +1,69 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// rbtree_to_array against rbtree_to_array_parallel with 1..8 threads on
+// trees of random keys. Without RBTREE_ORDER_STAT the parallel version
+// first counts each subtree (one extra pass, also split across threads);
+// bench-to-array-ostat reads the subtree sizes instead. Each run is the best
+// of a few, and every result is checked against the serial array.
+
+#define RUNS 3
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000, 10000000};
+  const int threads[] = {1, 2, 4, 8};
+#ifdef RBTREE_ORDER_STAT
+  const char *build = "ostat";
+#else
+  const char *build = "plain";
+#endif
+
+  printf("build,n,threads,serial_ms,parallel_ms,speedup\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *expect = malloc(n * sizeof(key_t));
+    key_t *out = malloc(n * sizeof(key_t));
+    rbtree *t = new_rbtree_pool(0);
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t, rand());
+    }
+
+    double serial = 1e18;
+    for (int r = 0; r < RUNS; r++) {
+      double start = now_ns();
+      rbtree_to_array(t, expect, n);
+      double d = now_ns() - start;
+      serial = d < serial ? d : serial;
+    }
+    for (size_t k = 0; k < sizeof(threads) / sizeof(threads[0]); k++) {
+      double parallel = 1e18;
+      for (int r = 0; r < RUNS; r++) {
+        memset(out, 0, n * sizeof(key_t));
+        double start = now_ns();
+        rbtree_to_array_parallel(t, out, n, threads[k]);
+        double d = now_ns() - start;
+        parallel = d < parallel ? d : parallel;
+      }
+      if (memcmp(out, expect, n * sizeof(key_t)) != 0) {
+        fprintf(stderr, "parallel result differs\n");
+        return 1;
+      }
+      printf("%s,%zu,%d,%.2f,%.2f,%.2f\n", build, n, threads[k], serial / 1e6,
+             parallel / 1e6, serial / parallel);
+    }
+    delete_rbtree(t);
+    free(expect);
+    free(out);
+  }
+  return 0;
+}
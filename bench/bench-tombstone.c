@@ -0,0 +1,99 @@
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Eager erase against tombstones: the same workload built as bench-tombstone
+// (rbtree_erase unlinks and rebalances) and bench-tombstone-on
+// (-DRBTREE_TOMBSTONE, rbtree_erase only marks the node). Half of the nodes
+// are erased in random order with each erase timed on its own, then lookups
+// run over the tree that still holds the marks, then rbtree_compact drops
+// them. churn_ns erases and reinserts the same key, which the tombstone
+// build turns into a flag flip on one node.
+
+#define CHURN_OPS 2000000
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t sizes[] = {100000, 1000000};
+  const size_t lookups = 2000000;
+#ifdef RBTREE_TOMBSTONE
+  const char *build = "tombstone";
+#else
+  const char *build = "eager";
+#endif
+
+  printf("build,n,erase_ns,erase_p50_ns,erase_p99_ns,find_ns,compact_ms,churn_ns\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t n = sizes[s];
+    key_t *keys = malloc(n * sizeof(key_t));
+    node_t **nodes = malloc(n * sizeof(node_t *));
+    double *lat = malloc(n / 2 * sizeof(double));
+    srand(17);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = rand();
+    }
+    rbtree *t = new_rbtree_pool(0);
+    for (size_t i = 0; i < n; i++) {
+      nodes[i] = rbtree_insert(t, keys[i]);
+    }
+    for (size_t i = n - 1; i > 0; i--) {  // random erase order
+      size_t j = rand() % (i + 1);
+      node_t *p = nodes[i];
+      nodes[i] = nodes[j];
+      nodes[j] = p;
+    }
+
+    double total = 0;
+    for (size_t i = 0; i < n / 2; i++) {
+      double start = now_ns();
+      rbtree_erase(t, nodes[i]);
+      lat[i] = now_ns() - start;
+      total += lat[i];
+    }
+    qsort(lat, n / 2, sizeof(double), compare_double);
+
+    size_t found = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < lookups; i++) {
+      found += rbtree_find(t, keys[(i * 2654435761u) % n]) != NULL;
+    }
+    double find = (now_ns() - start) / lookups;
+
+    start = now_ns();
+    rbtree_compact(t, 0);
+    double compact = now_ns() - start;
+
+    start = now_ns();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+      node_t *p = nodes[n / 2 + i % (n / 2)];  // live nodes only
+      key_t key = p->key;
+      rbtree_erase(t, p);
+      nodes[n / 2 + i % (n / 2)] = rbtree_insert(t, key);
+    }
+    double churn = (now_ns() - start) / CHURN_OPS;
+
+    if (found == 0 || rbtree_size(t) != n - n / 2) {
+      fprintf(stderr, "workload mismatch\n");
+      return 1;
+    }
+    printf("%s,%zu,%.1f,%.1f,%.1f,%.1f,%.2f,%.1f\n", build, n, total / (n / 2),
+           lat[n / 4], lat[n / 2 * 99 / 100], find, compact / 1e6, churn);
+    delete_rbtree(t);
+    free(keys);
+    free(nodes);
+    free(lat);
+  }
+  return 0;
+}
@@ -1,328 +1,2597 @@
+#ifdef RBTREE_COMPACT
+#define _GNU_SOURCE // mremap
+#endif
 #include "rbtree.h"
 
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h> // for debugging
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// 트리를 생성하는 함수
-rbtree *new_rbtree(void) {
+#define RBTREE_DEFAULT_SLAB 1024 // new_rbtree_pool에 0을 넘겼을 때의 slab 크기
+#define FIND_BATCH_WIDTH 16 // rbtree_find_batch가 번갈아 진행하는 탐색 수
+#define RELEASE_LANES 16 // release_flat이 번갈아 반납하는 서브트리 수
+#define RELEASE_QUEUE_LOCAL 64 // release_subtree가 stack에 두는 queue 크기
+#define ERASE_BATCH_AHEAD 8 // rbtree_erase_batch가 몇 개 앞의 노드를 prefetch 하는지
+#define TO_ARRAY_PIECES 8 // rbtree_to_array_parallel이 thread마다 만드는 서브트리 조각 수
+#define TO_ARRAY_PARALLEL_MIN 65536 // 노드가 이보다 적으면 rbtree_to_array_parallel도 thread 없이 복사
+#define PARALLEL_MAX_THREADS 64 // 병렬 함수가 nthreads로 받아들이는 최대 thread 수 (더 크면 이 값으로 줄임)
+
+enum { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE }; // set_operation의 연산 종류
+
+#ifdef RBTREE_COUNTED
+#define COPIES(x) ((x)->count) // 노드에 담긴 같은 key의 수
+#elif defined(RBTREE_TOMBSTONE)
+#define COPIES(x) (!(x)->dead) // tombstone은 key로 세지 않음
+#else
+#define COPIES(x) 1 // 노드마다 key 하나
+#endif
+
+#ifdef RBTREE_TOMBSTONE
+#ifdef RBTREE_COUNTED
+#define DEAD(x) ((x)->count == 0) // 같은 key를 모두 지운 노드가 tombstone
+#else
+#define DEAD(x) ((x)->dead)
+#endif
+#define PURGE(t) rbtree_compact(t, 0) // 모양을 통째로 바꾸는 연산 전에 tombstone을 모두 떼어냄
+#else
+#define DEAD(x) 0 // tombstone 없음 (건너뛰는 반복문은 빌드에서 빠짐)
+#define PURGE(t) ((void)0)
+#endif
+
+#ifdef RBTREE_STATS
+// 읽기만 하는 (const) 함수에서도 세므로 const를 떼고 더함
+// read lock만 잡은 여러 thread가 같이 세므로 relaxed atomic으로 더함 (순서는 맞출 필요 없고 횟수만 빠지지 않으면 됨)
+#define STAT_ADD(t, field, n) ((void)__atomic_fetch_add(&((rbtree *)(t))->stats.field, (n), __ATOMIC_RELAXED))
+#define STAT_PATH(t, depth, cmps) stat_path((rbtree *)(t), (depth), (cmps))
+#else
+// 빌드에서 빠짐 (세던 지역 변수도 쓰이지 않으므로 컴파일러가 지움)
+#define STAT_ADD(t, field, n) ((void)0)
+#define STAT_PATH(t, depth, cmps) ((void)(depth), (void)(cmps))
+#endif
+
+#ifdef RBTREE_COMPACT
+// 압축 노드는 포인터 대신 노드 저장소의 32비트 인덱스로 연결됨
+// 저장소는 트리마다 주소 공간을 미리 예약해 둔 연속 배열이라
+// 인덱스 <-> 포인터 변환이 덧셈/뺄셈 한 번이고, 노드는 옮겨지지 않음
+// 실제 메모리는 STORE_CHUNK개 단위로 필요할 때만 붙임
+// 예약은 RBTREE_COMPACT_RESERVE_NODES개(rbtree_from_sorted는 n개가 더 크면 n개)로 시작하고,
+// 다 쓰면 같은 자리에서 두 배로 늘려 보며 (노드를 옮길 수 없으므로 뒤에 빈 주소가 없으면 할당 실패)
+// RBTREE_COMPACT_MAX_NODES개를 넘지 않음
+#ifndef RBTREE_COMPACT_RESERVE_NODES
+#define RBTREE_COMPACT_RESERVE_NODES ((size_t)1 << 24)
+#endif
+#ifndef RBTREE_COMPACT_MAX_NODES
+#define RBTREE_COMPACT_MAX_NODES ((size_t)1 << 28)
+#endif
+#define STORE_CHUNK ((size_t)1 << 16) // 한 번에 쓰기 가능으로 바꾸는 노드 수
+#define NIL_INDEX 0 // NIL은 저장소의 0번 칸
+
+#define NODE(t, i) ((t)->pool->base + (i))
+#define INDEX(t, p) ((uint32_t)((p) - (t)->pool->base))
+
+#define LEFT(t, x) NODE(t, (x)->left)
+#define RIGHT(t, x) NODE(t, (x)->right)
+#define PARENT(t, x) NODE(t, (x)->parent_color >> 1)
+#define COLOR(x) ((color_t)((x)->parent_color & 1))
+#define SET_LEFT(t, x, y) ((x)->left = INDEX(t, y))
+#define SET_RIGHT(t, x, y) ((x)->right = INDEX(t, y))
+#define SET_PARENT(t, x, y) ((x)->parent_color = (INDEX(t, y) << 1) | ((x)->parent_color & 1))
+#define SET_COLOR(x, c) ((x)->parent_color = ((x)->parent_color & ~(uint32_t)1) | (uint32_t)(c))
+#else
+#define LEFT(t, x) ((x)->left)
+#define RIGHT(t, x) ((x)->right)
+#define PARENT(t, x) ((x)->parent)
+#define COLOR(x) ((x)->color)
+#define SET_LEFT(t, x, y) ((x)->left = (y))
+#define SET_RIGHT(t, x, y) ((x)->right = (y))
+#define SET_PARENT(t, x, y) ((x)->parent = (y))
+#define SET_COLOR(x, c) ((x)->color = (c))
+
+// 노드를 한 번에 여러 개 담는 메모리 블록
+typedef struct node_slab_t {
+  struct node_slab_t *next; // 다음 slab
+  size_t cap; // 이 slab에 들어가는 노드 수
+  node_t nodes[]; // 노드 배열
+} node_slab_t;
+#endif
+
+struct node_pool_t {
+#ifdef RBTREE_COMPACT
+  node_t *base; // 예약한 저장소의 시작 주소 (NODE 매크로가 인덱스로 찾아감)
+  size_t committed; // 쓰기 가능으로 바꾼 노드 수
+  size_t reserved; // 예약한 주소 공간의 노드 수
+#else
+  node_t nil; // sentinel 노드
+  node_slab_t *slabs; // 할당한 slab 목록 (가장 최근 slab이 맨 앞)
+  node_slab_t *spare; // rbtree_clear로 비운 slab 목록 (새 slab을 할당하기 전에 다시 씀)
+#endif
+  node_t *free_list; // 반납된 노드 목록 (right로 연결, NIL에서 끝남)
+  size_t slab_nodes; // 새 slab 하나에 들어가는 노드 수, 0이면 calloc/free 사용
+  size_t used; // 가장 최근 slab에서 사용한 노드 수 (압축 노드는 저장소 전체에서 사용한 칸 수)
+  size_t refs; // 이 할당기를 같이 쓰는 트리 수 (rbtree_split 등으로 늘어남)
+};
+
+#ifdef RBTREE_COMPACT
+// 저장소에서 STORE_CHUNK개를 더 쓸 수 있게 만드는 함수
+static int store_grow(node_pool_t *pool) {
+  if(pool->committed + STORE_CHUNK > pool->reserved) // 예약한 공간을 다 씀
+  {
+    size_t more = pool->reserved * 2 < RBTREE_COMPACT_MAX_NODES ? pool->reserved * 2 : RBTREE_COMPACT_MAX_NODES;
+    if(more <= pool->reserved) return 0;
+    if(mremap(pool->base, pool->reserved * sizeof(node_t), more * sizeof(node_t), 0) == MAP_FAILED) return 0; // 제자리에서만 늘림
+    pool->reserved = more;
+  }
+  if(mprotect(pool->base + pool->committed, STORE_CHUNK * sizeof(node_t), PROT_READ | PROT_WRITE) != 0) return 0;
+  pool->committed += STORE_CHUNK;
+  return 1;
+}
+#endif
+
+// 트리 모양을 통째로 바꾼 뒤 최소/최대 노드를 다시 찾는 함수 (O(log n), 빈 트리면 둘 다 NIL)
+// min/max를 읽는 함수들은 const라 cache를 채우지 않으므로, 트리를 바꾸는 쪽이 항상 맞춰 둠
+static void find_ends(rbtree *t) {
+  node_t *x = t->root;
+  if(x != t->nil) while(LEFT(t, x) != t->nil) x = LEFT(t, x);
+  t->min = x;
+  x = t->root;
+  if(x != t->nil) while(RIGHT(t, x) != t->nil) x = RIGHT(t, x);
+  t->max = x;
+}
+
+// slab_nodes 크기의 할당기를 가진 트리를 생성하는 함수
+// 압축 노드 빌드에서는 slab 대신 저장소에서 할당하고, 저장소는 reserve_nodes개 이상을 예약함 (0이면 기본 크기)
+static rbtree *create_rbtree(size_t slab_nodes, size_t reserve_nodes) {
   rbtree *p = (rbtree *)calloc(1, sizeof(rbtree)); // 트리 구조체를 할당
-  node_t *NIL = (node_t *)calloc(1, sizeof(node_t)); // NIL 노드를 할당
+  node_pool_t *pool = (node_pool_t *)calloc(1, sizeof(node_pool_t)); // 할당기와 NIL 노드를 할당
 
-  if(p == NULL || NIL == NULL) return NULL; // 할당에 실패하면 NULL 반환
+  if(p == NULL || pool == NULL) // 할당에 실패하면 NULL 반환
+  {
+    free(p);
+    free(pool);
+    return NULL;
+  }
+  p->pool = pool; // 할당기를 가리키도록 함
 
-  NIL->color = RBTREE_BLACK; // NIL 노드는 항상 검은색
-  NIL->parent = NIL->left = NIL->right = NIL; // NIL 노드는 자기 자신을 가리키도록 함
-  
+#ifdef RBTREE_COMPACT
+  // 주소 공간만 예약하고 (PROT_NONE) 실제 메모리는 store_grow에서 붙임
+  if(reserve_nodes < RBTREE_COMPACT_RESERVE_NODES) reserve_nodes = RBTREE_COMPACT_RESERVE_NODES;
+  reserve_nodes = (reserve_nodes + STORE_CHUNK - 1) / STORE_CHUNK * STORE_CHUNK;
+  void *base = reserve_nodes <= RBTREE_COMPACT_MAX_NODES ? mmap(NULL, reserve_nodes * sizeof(node_t), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) : MAP_FAILED;
+  pool->base = (base == MAP_FAILED) ? NULL : (node_t *)base;
+  pool->reserved = reserve_nodes;
+  if(pool->base == NULL || !store_grow(pool)) // 예약에 실패하면 NULL 반환
+  {
+    if(pool->base != NULL) munmap(pool->base, pool->reserved * sizeof(node_t));
+    free(pool);
+    free(p);
+    return NULL;
+  }
+  node_t *NIL = NODE(p, NIL_INDEX); // NIL 노드는 저장소의 0번 칸
+  pool->used = NIL_INDEX + 1;
+  if(slab_nodes == 0) slab_nodes = STORE_CHUNK; // 압축 노드는 항상 저장소에서 할당
+#else
+  (void)reserve_nodes;
+  node_t *NIL = &pool->nil; // NIL 노드는 할당기 안에 있음
+#endif
   p->nil = NIL; // NIL 노드를 가리키도록 함
+  SET_COLOR(NIL, RBTREE_BLACK); // NIL 노드는 항상 검은색
+  SET_PARENT(p, NIL, NIL); // NIL 노드는 자기 자신을 가리키도록 함
+  SET_LEFT(p, NIL, NIL);
+  SET_RIGHT(p, NIL, NIL);
+  pool->slab_nodes = slab_nodes; // slab 크기 저장
+  pool->free_list = NIL; // 반납된 노드 없음
+  pool->refs = 1;
+
   p->root = NIL; // root 노드를 NIL 노드로 초기화
+  p->min = p->max = NIL; // 빈 트리의 최소/최대 노드
   return p; // 트리 구조체 반환
 }
 
+// 트리를 생성하는 함수 (노드마다 calloc/free)
+rbtree *new_rbtree(void) {
+  return create_rbtree(0, 0);
+}
+
+// 노드를 slab 단위로 할당하는 트리를 생성하는 함수
+rbtree *new_rbtree_pool(size_t slab_nodes) {
+  if(slab_nodes == 0) slab_nodes = RBTREE_DEFAULT_SLAB; // 0이면 기본 크기 사용
+  return create_rbtree(slab_nodes, 0);
+}
+
+#ifdef RBTREE_STATS
+// 한 번 내려간 경로의 길이(방문한 노드 수)와 비교 횟수를 더하는 함수
+static void stat_path(rbtree *t, size_t depth, size_t cmps) {
+  STAT_ADD(t, depth[depth < RBTREE_STATS_DEPTHS ? depth : RBTREE_STATS_DEPTHS - 1], 1);
+  STAT_ADD(t, compares, cmps);
+}
+#endif
+
+// 할당기에서 노드 하나를 꺼내는 함수
+static node_t *take_node(rbtree *t) {
+  node_pool_t *pool = t->pool;
+#ifndef RBTREE_COMPACT
+  if(pool->slab_nodes == 0) return (node_t *)calloc(1, sizeof(node_t)); // pool을 쓰지 않으면 calloc
+#endif
+
+  node_t *p = pool->free_list;
+  if(p != t->nil) // 반납된 노드가 있으면 재사용
+  {
+    pool->free_list = RIGHT(t, p); // 다음 반납 노드로 이동
+    return p;
+  }
+
+#ifdef RBTREE_COMPACT
+  if(pool->used == pool->committed && !store_grow(pool)) return NULL; // 쓸 수 있는 칸을 다 썼으면 더 붙임
+  return NODE(t, pool->used++); // 저장소에서 다음 칸을 잘라서 반환
+#else
+  if((pool->slabs == NULL || pool->used == pool->slabs->cap) && pool->spare != NULL) // 비워 둔 slab이 있으면 그것부터 씀
+  {
+    node_slab_t *slab = pool->spare;
+    pool->spare = slab->next;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->used = 0;
+  }
+  if(pool->slabs == NULL || pool->used == pool->slabs->cap) // 현재 slab을 다 썼으면 새 slab 할당
+  {
+    // 0으로 채워 두면 lock 없이 읽는 쪽(rbtree_sync.c)이 초기화 전 노드를 보더라도 링크가 NULL로 보임
+    node_slab_t *slab = (node_slab_t *)calloc(1, sizeof(node_slab_t) + pool->slab_nodes * sizeof(node_t));
+    if(slab == NULL) return NULL; // 할당에 실패하면 NULL 반환
+    slab->cap = pool->slab_nodes;
+    slab->next = pool->slabs; // 새 slab을 목록 맨 앞에 추가
+    pool->slabs = slab;
+    pool->used = 0;
+  }
+  return &pool->slabs->nodes[pool->used++]; // slab에서 다음 노드를 잘라서 반환
+#endif
+}
+
+// 노드 하나를 할당하는 함수 (할당 횟수를 셈)
+static node_t *alloc_node(rbtree *t) {
+  node_t *p = take_node(t);
+  if(p != NULL) STAT_ADD(t, allocs, 1);
+  return p;
+}
+
+// 노드 n개를 한 slab에서 연속으로 꺼낼 수 있도록 미리 할당하는 함수
+static int reserve_nodes(rbtree *t, size_t n) {
+#ifdef RBTREE_COMPACT
+  (void)t;
+  (void)n;
+  return 1; // 압축 노드는 저장소에서 이미 연속으로 잘라 씀
+#else
+  node_pool_t *pool = t->pool;
+  if(pool->free_list != t->nil || pool->slab_nodes == 0) return 1; // 반납 목록이나 calloc에서 꺼내는 경우
+  if(pool->slabs != NULL && pool->slabs->cap - pool->used >= n) return 1; // 현재 slab에 충분히 남음
+
+  node_slab_t *slab = (node_slab_t *)calloc(1, sizeof(node_slab_t) + n * sizeof(node_t)); // n개짜리 slab 하나로 한 번에 할당
+  if(slab == NULL) return 0; // 할당에 실패하면 0 반환
+  slab->cap = n;
+  slab->next = pool->slabs; // 새 slab을 목록 맨 앞에 추가
+  pool->slabs = slab;
+  pool->used = 0;
+  return 1;
+#endif
+}
+
+// 노드를 할당기에 반납하는 함수
+static void release_node(rbtree *t, node_t *p) {
+  node_pool_t *pool = t->pool;
+  STAT_ADD(t, frees, 1);
+  if(pool->slab_nodes == 0) // pool을 쓰지 않으면 free
+  {
+    free(p);
+    return;
+  }
+  SET_RIGHT(t, p, pool->free_list); // 반납 목록 맨 앞에 추가
+  pool->free_list = p;
+}
+
+// 노드의 왼쪽 자식을 구하는 함수
+node_t *rbtree_left(const rbtree *t, const node_t *x) {
+  (void)t; // 포인터 링크 빌드에서는 쓰지 않음
+  return LEFT(t, x);
+}
+
+// 노드의 오른쪽 자식을 구하는 함수
+node_t *rbtree_right(const rbtree *t, const node_t *x) {
+  (void)t;
+  return RIGHT(t, x);
+}
+
+// 노드의 부모를 구하는 함수
+node_t *rbtree_parent(const rbtree *t, const node_t *x) {
+  (void)t;
+  return PARENT(t, x);
+}
+
+// 노드의 색을 구하는 함수
+color_t rbtree_color(const node_t *x) {
+  return COLOR(x);
+}
+
+#ifdef RBTREE_INTERVAL
+// x의 max_hi를 x의 구간과 양쪽 서브트리의 max_hi로 다시 계산하는 함수 (NIL은 보지 않음)
+static void pull_hi(const rbtree *t, node_t *x) {
+  key_t m = x->hi;
+  node_t *l = LEFT(t, x), *r = RIGHT(t, x);
+  if(l != t->nil && l->max_hi > m) m = l->max_hi;
+  if(r != t->nil && r->max_hi > m) m = r->max_hi;
+  x->max_hi = m;
+}
+
+// x의 구간 끝을 hi로 바꾸고 x부터 root까지 max_hi를 다시 계산하는 함수
+static void set_hi(rbtree *t, node_t *x, const key_t hi) {
+  x->hi = hi;
+  for(node_t *p = x; p != t->nil; p = PARENT(t, p)) pull_hi(t, p);
+}
+#endif
+
 // 왼쪽으로 회전하는 함수
 void left_rotate(rbtree *t, node_t *x) {
- node_t *y = x->right; // y는 x의 오른쪽 자식 노드
- x->right = y->left; // y의 왼쪽 자식 노드를 x의 오른쪽 자식 노드로 만듦
+ node_t *y = RIGHT(t, x); // y는 x의 오른쪽 자식 노드
+ STAT_ADD(t, rotations, 1);
+ SET_RIGHT(t, x, LEFT(t, y)); // y의 왼쪽 자식 노드를 x의 오른쪽 자식 노드로 만듦
  
  // y의 왼쪽 자식 노드가 NIL 노드가 아니면 y의 왼쪽 자식 노드의 부모 노드를 x로 만듦
- if(y->left != t->nil) y->left->parent = x; 
+ if(LEFT(t, y) != t->nil) SET_PARENT(t, LEFT(t, y), x); 
  
- y->parent = x->parent; // y의 부모 노드를 x의 부모 노드로 만듦
+ SET_PARENT(t, y, PARENT(t, x)); // y의 부모 노드를 x의 부모 노드로 만듦
  
- if(x->parent == t->nil) t->root = y; // x의 부모 노드가 NIL 노드이면 y를 root 노드로 만듦
- else if(x == x->parent->left) x->parent->left = y; // x가 x의 부모 노드의 왼쪽 자식 노드이면 y를 x의 부모 노드의 왼쪽 자식 노드로 만듦
- else x->parent->right = y; // x가 x의 부모 노드의 오른쪽 자식 노드이면 y를 x의 부모 노드의 오른쪽 자식 노드로 만듦
+ if(PARENT(t, x) == t->nil) t->root = y; // x의 부모 노드가 NIL 노드이면 y를 root 노드로 만듦
+ else if(x == LEFT(t, PARENT(t, x))) SET_LEFT(t, PARENT(t, x), y); // x가 x의 부모 노드의 왼쪽 자식 노드이면 y를 x의 부모 노드의 왼쪽 자식 노드로 만듦
+ else SET_RIGHT(t, PARENT(t, x), y); // x가 x의 부모 노드의 오른쪽 자식 노드이면 y를 x의 부모 노드의 오른쪽 자식 노드로 만듦
 
- y->left = x; // y의 왼쪽 자식 노드를 x로 만듦
- x->parent = y; // x의 부모 노드를 y로 만듦
+ SET_LEFT(t, y, x); // y의 왼쪽 자식 노드를 x로 만듦
+ SET_PARENT(t, x, y); // x의 부모 노드를 y로 만듦
+#ifdef RBTREE_ORDER_STAT
+ y->size = x->size; // y가 x 자리를 차지하므로 서브트리 크기도 물려받음
+ x->size = LEFT(t, x)->size + RIGHT(t, x)->size + COPIES(x); // x의 서브트리 크기를 다시 계산
+#endif
+#ifdef RBTREE_INTERVAL
+ y->max_hi = x->max_hi; // 서브트리에 담긴 구간은 그대로이므로 물려받음
+ pull_hi(t, x); // x는 y의 왼쪽 서브트리를 넘겨받았으므로 다시 계산
+#endif
 }
 
 // 오른쪽으로 회전하는 함수
 void right_rotate(rbtree *t, node_t *x) {
-  node_t* y = x->left; // y는 x의 왼쪽 자식 노드
-  x->left = y->right; // y의 오른쪽 자식 노드를 x의 왼쪽 자식 노드로 만듦
+  node_t* y = LEFT(t, x); // y는 x의 왼쪽 자식 노드
+  STAT_ADD(t, rotations, 1);
+  SET_LEFT(t, x, RIGHT(t, y)); // y의 오른쪽 자식 노드를 x의 왼쪽 자식 노드로 만듦
 
-  if(y->right != t->nil) y->right->parent = x; // y의 오른쪽 자식 노드가 NIL 노드가 아니면 y의 오른쪽 자식 노드의 부모 노드를 x로 만듦
-  y->parent = x->parent; // y의 부모 노드를 x의 부모 노드로 만듦
+  if(RIGHT(t, y) != t->nil) SET_PARENT(t, RIGHT(t, y), x); // y의 오른쪽 자식 노드가 NIL 노드가 아니면 y의 오른쪽 자식 노드의 부모 노드를 x로 만듦
+  SET_PARENT(t, y, PARENT(t, x)); // y의 부모 노드를 x의 부모 노드로 만듦
   
-  if(x->parent==t->nil) t->root = y; // x의 부모 노드가 NIL 노드이면 y를 root 노드로 만듦
-  else if(x == x->parent->right) x->parent->right = y; // x가 x의 부모 노드의 오른쪽 자식 노드이면 y를 x의 부모 노드의 오른쪽 자식 노드로 만듦
-  else x->parent->left = y; // x가 x의 부모 노드의 왼쪽 자식 노드이면 y를 x의 부모 노드의 왼쪽 자식 노드로 만듦
+  if(PARENT(t, x)==t->nil) t->root = y; // x의 부모 노드가 NIL 노드이면 y를 root 노드로 만듦
+  else if(x == RIGHT(t, PARENT(t, x))) SET_RIGHT(t, PARENT(t, x), y); // x가 x의 부모 노드의 오른쪽 자식 노드이면 y를 x의 부모 노드의 오른쪽 자식 노드로 만듦
+  else SET_LEFT(t, PARENT(t, x), y); // x가 x의 부모 노드의 왼쪽 자식 노드이면 y를 x의 부모 노드의 왼쪽 자식 노드로 만듦
   
-  y->right = x; // y의 오른쪽 자식 노드를 x로 만듦
-  x->parent = y; // x의 부모 노드를 y로 만듦
+  SET_RIGHT(t, y, x); // y의 오른쪽 자식 노드를 x로 만듦
+  SET_PARENT(t, x, y); // x의 부모 노드를 y로 만듦
+#ifdef RBTREE_ORDER_STAT
+  y->size = x->size; // y가 x 자리를 차지하므로 서브트리 크기도 물려받음
+  x->size = LEFT(t, x)->size + RIGHT(t, x)->size + COPIES(x); // x의 서브트리 크기를 다시 계산
+#endif
+#ifdef RBTREE_INTERVAL
+  y->max_hi = x->max_hi; // 서브트리에 담긴 구간은 그대로이므로 물려받음
+  pull_hi(t, x); // x는 y의 오른쪽 서브트리를 넘겨받았으므로 다시 계산
+#endif
 }
 
 // 노드를 이동하는 함수
 void rbtree_transplant(rbtree *t, node_t *u, node_t *v) {
 
-  if (u->parent == t->nil) t->root = v; // u의 부모 노드가 NIL 노드이면 v를 root 노드로 만듦
-  else if (u == u->parent->left) u->parent->left = v; // u가 u의 부모 노드의 왼쪽 자식 노드이면 v를 u의 부모 노드의 왼쪽 자식 노드로 만듦
-  else u->parent->right = v; // u가 u의 부모 노드의 오른쪽 자식 노드이면 v를 u의 부모 노드의 오른쪽 자식 노드로 만듦
+  if (PARENT(t, u) == t->nil) t->root = v; // u의 부모 노드가 NIL 노드이면 v를 root 노드로 만듦
+  else if (u == LEFT(t, PARENT(t, u))) SET_LEFT(t, PARENT(t, u), v); // u가 u의 부모 노드의 왼쪽 자식 노드이면 v를 u의 부모 노드의 왼쪽 자식 노드로 만듦
+  else SET_RIGHT(t, PARENT(t, u), v); // u가 u의 부모 노드의 오른쪽 자식 노드이면 v를 u의 부모 노드의 오른쪽 자식 노드로 만듦
   
-  v->parent = u->parent; // v의 부모 노드를 u의 부모 노드로 만듦
+  SET_PARENT(t, v, PARENT(t, u)); // v의 부모 노드를 u의 부모 노드로 만듦
 }
 
-// 노드를 해제하는 함수
-void free_node(node_t *p, node_t *NIL) {
-  if(p == NIL) return; // p가 NULL이거나 NIL이면 함수 종료
+// 서브트리의 노드를 모두 할당기에 반납하고 반납한 key 수를 반환하는 함수 (재귀와 힙 할당 없음)
+// 한 갈래는 왼쪽 자식이 있으면 오른쪽으로 회전해서 끌어올리고, 없으면 노드를 반납하고 오른쪽 자식으로 넘어감
+// 회전마다 왼쪽 가장자리가 하나씩 줄어 노드마다 상수 번만 만지므로 O(n)이고, 트리가 한쪽으로 쏠려 있어도 그대로 동작
+// 위쪽 노드를 반납하면서 겹치지 않는 서브트리 RELEASE_LANES개로 나누고 한 단계씩 번갈아 진행하며
+// 다음에 만질 노드를 prefetch 하므로 cache miss를 기다리는 시간이 겹쳐짐 (rbtree_find_batch와 같은 방식)
+static size_t release_flat(rbtree *t, node_t *root) {
+  node_t *lane[RELEASE_LANES];
+  size_t lanes = 0, n = 0, i = 0;
+  if(root != t->nil) lane[lanes++] = root;
+  while(lanes > 0 && lanes < RELEASE_LANES) // 맨 위 노드를 반납하고 두 자식을 각각 갈래로 만듦
+  {
+    if(i >= lanes) i = 0;
+    node_t *p = lane[i], *l = LEFT(t, p), *r = RIGHT(t, p);
+    n += COPIES(p);
+    release_node(t, p);
+    if(l != t->nil && r != t->nil) lane[lanes++] = r;
+    if(l != t->nil || r != t->nil) lane[i++] = (l != t->nil) ? l : r;
+    else lane[i] = lane[--lanes]; // 빈 갈래는 빼고 같은 자리를 다시 봄
+  }
+  for(i = 0; i < lanes; i++) __builtin_prefetch(LEFT(t, lane[i]), 1);
+
+  // 각 갈래의 p는 cache에 있고 p의 왼쪽 자식은 한 바퀴 전에 prefetch 되어 있음
+  while(lanes > 0)
+  {
+    for(i = 0; i < lanes; )
+    {
+      node_t *p = lane[i], *l = LEFT(t, p);
+      if(l != t->nil) // l을 p 위로 올림 (부모 링크는 곧 버리므로 고치지 않음)
+      {
+        SET_LEFT(t, p, RIGHT(t, l));
+        SET_RIGHT(t, l, p);
+        __builtin_prefetch(LEFT(t, l), 1);
+        lane[i++] = l;
+        continue;
+      }
+      node_t *r = RIGHT(t, p);
+      n += COPIES(p);
+      release_node(t, p);
+      if(r == t->nil)
+      {
+        lane[i] = lane[--lanes]; // 다 반납한 갈래는 빼고 같은 자리를 다시 봄
+        continue;
+      }
+      __builtin_prefetch(LEFT(t, r), 1);
+      lane[i++] = r;
+    }
+  }
+  return n;
+}
 
-  free_node(p->left, NIL); // p의 왼쪽 자식 노드를 인자로 재귀 호출
-  free_node(p->right, NIL); // p의 오른쪽 자식 노드를 인자로 재귀 호출
-  free(p); // p를 해제
+// 할당기와 그 안의 노드 메모리를 모두 해제하는 함수
+static void destroy_pool(node_pool_t *pool) {
+#ifdef RBTREE_COMPACT
+  munmap(pool->base, pool->reserved * sizeof(node_t)); // 저장소는 노드를 순회하지 않고 통째로 해제
+#else
+  node_slab_t *lists[2] = {pool->slabs, pool->spare};
+  for(int i = 0; i < 2; i++)
+  {
+    while(lists[i] != NULL) // slab은 노드를 순회하지 않고 통째로 해제
+    {
+      node_slab_t *next = lists[i]->next;
+      free(lists[i]);
+      lists[i] = next;
+    }
+  }
+#endif
+  free(pool); // 할당기와 NIL 노드를 해제
 }
 
 // 트리를 삭제하는 함수
 void delete_rbtree(rbtree *t) {
-  free_node(t->root, t->nil); // root 노드와 NIL 노드를 인자로 전달
-  free(t->nil); // NIL 노드를 해제
+  node_pool_t *pool = t->pool;
+  if(pool->slab_nodes == 0) release_flat(t, t->root); // calloc으로 할당한 노드는 하나씩 해제
+  // 할당기를 같이 쓰는 트리가 남아 있으면 slab은 마지막 트리를 삭제할 때 해제
+  if(--pool->refs == 0) destroy_pool(pool);
   free(t);
 }
 
+// 트리를 비우는 함수 (트리와 할당기는 남겨 두고 다시 채워 씀)
+// 할당기를 혼자 쓰면 노드를 순회하지 않고 slab(압축 노드는 저장소)을 처음부터 다시 쓰게 하므로
+// 할당해 둔 메모리가 그대로 남아 다음 삽입에서 malloc과 page fault가 없음
+void rbtree_clear(rbtree *t) {
+  node_pool_t *pool = t->pool;
+  if(pool->refs > 1 || pool->slab_nodes == 0) release_flat(t, t->root); // 다른 트리와 같이 쓰거나 calloc이면 노드마다 반납
+  else
+  {
+#ifdef RBTREE_COMPACT
+    pool->used = NIL_INDEX + 1; // 0번 칸(NIL) 다음부터 다시 씀
+#else
+    if(pool->slabs != NULL) // 쓰던 slab을 모두 비워 둔 slab 목록으로 옮김
+    {
+      node_slab_t *tail = pool->slabs;
+      while(tail->next != NULL) tail = tail->next;
+      tail->next = pool->spare;
+      pool->spare = pool->slabs;
+      pool->slabs = NULL;
+    }
+#endif
+    pool->free_list = t->nil;
+  }
+  t->root = t->nil;
+  t->min = t->max = t->nil;
+  t->count = 0;
+#ifdef RBTREE_TOMBSTONE
+  t->tombstones = 0;
+#endif
+}
+
 // 삽입 후 불균형을 해결하는 함수
-void rbtree_insert_fixup(rbtree *t, node_t *z) {
- while(z->parent->color == RBTREE_RED) // z의 부모 노드의 색이 빨간색인 동안 반복
+// 마지막에 빨간 root를 검은색으로 바꿨으면 (black height가 1 늘었으면) 1 반환
+int rbtree_insert_fixup(rbtree *t, node_t *z) {
+ while(COLOR(PARENT(t, z)) == RBTREE_RED) // z의 부모 노드의 색이 빨간색인 동안 반복
  {
-   if(z->parent == z->parent->parent->left) // z의 부모 노드가 z의 부모 노드의 부모 노드의 왼쪽 자식 노드이면
+   STAT_ADD(t, insert_fixup_loops, 1);
+   if(PARENT(t, z) == LEFT(t, PARENT(t, PARENT(t, z)))) // z의 부모 노드가 z의 부모 노드의 부모 노드의 왼쪽 자식 노드이면
    {
-     node_t* y = z->parent->parent->right; // y는 z의 부모 노드의 부모 노드의 오른쪽 자식 노드
-     if(y->color == RBTREE_RED) // y의 색이 빨간색이면
+     node_t* y = RIGHT(t, PARENT(t, PARENT(t, z))); // y는 z의 부모 노드의 부모 노드의 오른쪽 자식 노드
+     if(COLOR(y) == RBTREE_RED) // y의 색이 빨간색이면
      {
-       z->parent->color = RBTREE_BLACK; // z의 부모 노드의 색을 검은색으로 만듦
-       y->color = RBTREE_BLACK; // y의 색을 검은색으로 만듦
-       z->parent->parent->color = RBTREE_RED; // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦
-       z = z->parent->parent; // z를 z의 부모 노드의 부모 노드로 만듦
+       SET_COLOR(PARENT(t, z), RBTREE_BLACK); // z의 부모 노드의 색을 검은색으로 만듦
+       SET_COLOR(y, RBTREE_BLACK); // y의 색을 검은색으로 만듦
+       SET_COLOR(PARENT(t, PARENT(t, z)), RBTREE_RED); // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦
+       z = PARENT(t, PARENT(t, z)); // z를 z의 부모 노드의 부모 노드로 만듦
      }
      else
      {
-        if(z == z->parent->right) // z가 z의 부모 노드의 오른쪽 자식 노드이면
+        if(z == RIGHT(t, PARENT(t, z))) // z가 z의 부모 노드의 오른쪽 자식 노드이면
         {
-          z = z->parent; // z를 z의 부모 노드로 만듦
+          z = PARENT(t, z); // z를 z의 부모 노드로 만듦
           left_rotate(t, z); // z를 기준으로 왼쪽으로 회전
         }
-        z->parent->color = RBTREE_BLACK; // z의 부모 노드의 색을 검은색으로 만듦
-        z->parent->parent->color = RBTREE_RED; // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦
-        right_rotate(t, z->parent->parent); // z의 부모 노드의 부모 노드를 기준으로 오른쪽으로 회전
+        SET_COLOR(PARENT(t, z), RBTREE_BLACK); // z의 부모 노드의 색을 검은색으로 만듦
+        SET_COLOR(PARENT(t, PARENT(t, z)), RBTREE_RED); // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦
+        right_rotate(t, PARENT(t, PARENT(t, z))); // z의 부모 노드의 부모 노드를 기준으로 오른쪽으로 회전
      }
    }
    else
    {
-      node_t* y = z->parent->parent->left; // y는 z의 부모 노드의 부모 노드의 왼쪽 자식 노드
-      if(y->color == RBTREE_RED)
+      node_t* y = LEFT(t, PARENT(t, PARENT(t, z))); // y는 z의 부모 노드의 부모 노드의 왼쪽 자식 노드
+      if(COLOR(y) == RBTREE_RED)
       {
-        z->parent->color = RBTREE_BLACK; // z의 부모 노드의 색을 검은색으로 만듦
-        y->color = RBTREE_BLACK; // y의 색을 검은색으로 만듦
-        z->parent->parent->color = RBTREE_RED; // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦
-        z = z->parent->parent; // z를 z의 부모 노드의 부모 노드로 만듦
+        SET_COLOR(PARENT(t, z), RBTREE_BLACK); // z의 부모 노드의 색을 검은색으로 만듦
+        SET_COLOR(y, RBTREE_BLACK); // y의 색을 검은색으로 만듦
+        SET_COLOR(PARENT(t, PARENT(t, z)), RBTREE_RED); // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦
+        z = PARENT(t, PARENT(t, z)); // z를 z의 부모 노드의 부모 노드로 만듦
       }
       else
       {
-          if(z == z->parent->left)
+          if(z == LEFT(t, PARENT(t, z)))
           {
-            z = z->parent; // z를 z의 부모 노드로 만듦
+            z = PARENT(t, z); // z를 z의 부모 노드로 만듦
             right_rotate(t, z); // z를 기준으로 오른쪽으로 회전
           }
-          z->parent->color = RBTREE_BLACK; // z의 부모 노드의 색을 검은색으로 만듦
-          z->parent->parent->color = RBTREE_RED; // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦  
-          left_rotate(t, z->parent->parent); // z의 부모 노드의 부모 노드를 기준으로 왼쪽으로 회전
+          SET_COLOR(PARENT(t, z), RBTREE_BLACK); // z의 부모 노드의 색을 검은색으로 만듦
+          SET_COLOR(PARENT(t, PARENT(t, z)), RBTREE_RED); // z의 부모 노드의 부모 노드의 색을 빨간색으로 만듦  
+          left_rotate(t, PARENT(t, PARENT(t, z))); // z의 부모 노드의 부모 노드를 기준으로 왼쪽으로 회전
       }
     }
   }
-  t->root->color = RBTREE_BLACK; // root 노드의 색을 검은색으로 만듦
+  int grew = COLOR(t->root) == RBTREE_RED;
+  SET_COLOR(t->root, RBTREE_BLACK); // root 노드의 색을 검은색으로 만듦
+  return grew;
 }
 
-// 트리에 노드를 삽입하는 함수
-node_t *rbtree_insert(rbtree *t, const key_t key) {
+// 이미 할당된 노드 z를 y의 자식 자리(left가 참이면 왼쪽)에 붙이고 균형을 맞추는 함수
+void rbtree_insert_node(rbtree *t, node_t *y, node_t *z, int left) {
+  SET_PARENT(t, z, y); // z의 부모 노드를 y로 만듦
+
+  if (y == t->nil || (y == t->max && !left)) t->max = z; // 빈 트리이거나 최대 노드의 오른쪽에 붙으면 z가 새 최대 노드
+  if (y == t->nil || (y == t->min && left)) t->min = z; // 최소 노드의 왼쪽에 붙으면 z가 새 최소 노드
+  if (y == t->nil) t->root = z; // y가 NIL 노드이면 z를 root 노드로 만듦
+  else if (left) SET_LEFT(t, y, z); // z를 y의 왼쪽 자식 노드로 만듦
+  else SET_RIGHT(t, y, z); // z를 y의 오른쪽 자식 노드로 만듦
+
+  SET_LEFT(t, z, t->nil); // z의 왼쪽 자식 노드를 NIL 노드로 만듦
+  SET_RIGHT(t, z, t->nil); // z의 오른쪽 자식 노드를 NIL 노드로 만듦
+  SET_COLOR(z, RBTREE_RED); // z의 색을 빨간색으로 만듦
+#ifdef RBTREE_COUNTED
+  z->count = 1; // key 하나로 시작
+#elif defined(RBTREE_TOMBSTONE)
+  z->dead = 0; // 반납 목록에서 꺼낸 노드는 tombstone 표시가 남아 있을 수 있음
+#endif
+#ifdef RBTREE_ORDER_STAT
+  z->size = 1; // z 혼자인 서브트리
+  for(node_t *p = y; p != t->nil; p = PARENT(t, p)) p->size++; // z의 조상들의 서브트리 크기 증가
+#endif
+#ifdef RBTREE_INTERVAL
+  z->hi = z->max_hi = z->key; // 점 구간 [key, key]로 시작 (rbtree_interval_insert가 끝을 바꿈)
+  for(node_t *p = y; p != t->nil && p->max_hi < z->hi; p = PARENT(t, p)) p->max_hi = z->hi; // 더 커지는 조상까지만 올라감
+#endif
+  t->count++; // 노드 수 증가
+
+  rbtree_insert_fixup(t, z); // 삽입 후 불균형을 해결
+}
+
+#ifdef RBTREE_COUNTED
+// 노드 x에 같은 key를 delta개 더하거나 빼는 함수 (트리 모양은 그대로)
+static void add_copies(rbtree *t, node_t *x, ptrdiff_t delta) {
+  x->count += delta;
+#ifdef RBTREE_ORDER_STAT
+  for(node_t *p = x; p != t->nil; p = PARENT(t, p)) p->size += delta; // x와 조상들의 서브트리 크기도 같이 바뀜
+#endif
+  t->count += delta;
+}
+#endif
+
+#ifdef RBTREE_TOMBSTONE
+// 노드 x를 tombstone으로 표시하거나(dead가 1) 되살리는 함수 (트리 모양은 그대로이므로 회전과 fixup 없음)
+static void set_dead(rbtree *t, node_t *x, int dead) {
+#ifdef RBTREE_COUNTED
+  add_copies(t, x, dead ? -1 : 1); // count가 0인 노드가 tombstone
+#else
+  x->dead = dead;
+#ifdef RBTREE_ORDER_STAT
+  for(node_t *p = x; p != t->nil; p = PARENT(t, p)) p->size += dead ? -1 : 1; // 서브트리 크기는 살아 있는 key만 셈
+#endif
+  t->count += dead ? -1 : 1;
+#endif
+  t->tombstones += dead ? 1 : -1;
+#ifdef RBTREE_INTERVAL
+  if(!dead && x->hi != x->key) set_hi(t, x, x->key); // 되살린 노드는 새로 넣은 점 구간 (지워진 구간의 끝이 남아 있음)
+#endif
+}
+#endif
+
+// x에서부터 내려가 key를 삽입하는 함수 (depth는 x까지 이미 지나온 노드 수, RBTREE_STATS용)
+// x는 root이거나 key가 들어갈 범위를 가진 서브트리의 root여야 함
+// RBTREE_COUNTED이면 같은 key가 이미 있을 때 그 노드의 수만 늘리고 반환 (할당과 fixup 없음)
+static node_t *insert_below(rbtree *t, node_t *x, const key_t key, size_t depth) {
   node_t* y = t->nil; // y는 NIL 노드
-  node_t* x = t->root; // x는 root 노드
   
   while(x != t->nil) // x가 NIL 노드가 아닌 동안 반복
   {
+    depth++;
+#ifdef RBTREE_TOMBSTONE
+    if(key == x->key && DEAD(x)) // 같은 key의 tombstone을 지나가면 할당하지 않고 되살림
+    {
+      STAT_PATH(t, depth, 2 * depth - 1);
+      set_dead(t, x, 0);
+      return x;
+    }
+#endif
+#ifdef RBTREE_COUNTED
+    if(key == x->key)
+    {
+      STAT_PATH(t, depth, 2 * depth - 1);
+      add_copies(t, x, 1);
+      return x;
+    }
+#endif
     y = x; // y를 x로 만듦
-    if(key < x->key) x = x->left; // key가 x의 키보다 작으면 x를 x의 왼쪽 자식 노드로 만듦
-    else x = x->right; // 그렇지 않으면 x를 x의 오른쪽 자식 노드로 만듦
+    if(key < x->key) x = LEFT(t, x); // key가 x의 키보다 작으면 x를 x의 왼쪽 자식 노드로 만듦
+    else x = RIGHT(t, x); // 그렇지 않으면 x를 x의 오른쪽 자식 노드로 만듦
   }
 
-  node_t* z = (node_t *)calloc(1, sizeof(node_t)); // z는 새로운 노드
+#ifdef RBTREE_COUNTED
+  STAT_PATH(t, depth, 2 * depth); // 노드마다 ==, < 한 번씩
+#else
+  STAT_PATH(t, depth, depth); // 노드마다 < 한 번
+#endif
+
+  node_t* z = alloc_node(t); // z는 새로운 노드
   
   if(z == NULL) return NULL; // 할당에 실패하면 NULL 반환
   
   z->key = key; // z의 키를 key로 만듦
-  z->parent = y; // z의 부모 노드를 y로 만듦
+  rbtree_insert_node(t, y, z, y != t->nil && key < y->key); // key가 y의 키보다 작으면 왼쪽, 아니면 오른쪽에 붙임
+  return z; // 삽입한 노드 반환
+}
 
-  if (y == t->nil) t->root = z; // y가 NIL 노드이면 z를 root 노드로 만듦
-  else if (key < y->key) y->left = z; // key가 y의 키보다 작으면 z를 y의 왼쪽 자식 노드로 만듦
-  else y->right = z; // 그렇지 않으면 z를 y의 오른쪽 자식 노드로 만듦
+// 트리에 노드를 삽입하는 함수
+// key가 최대 노드의 key 이상이면 root에서 내려가지 않고 최대 노드 오른쪽에 바로 붙이므로
+// 증가하는 순서로 들어오는 key는 탐색 없이 O(1) + fixup
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  STAT_ADD(t, inserts, 1);
+  node_t *m = t->max;
+  if(m == t->nil) return insert_below(t, t->root, key, 0);
+  STAT_ADD(t, compares, 1);
+  if(m->key <= key) return insert_below(t, m, key, 0); // 최대 노드의 서브트리에 key가 들어갈 자리가 있음
+  return insert_below(t, t->root, key, 0);
+}
 
-  z->left = t->nil; // z의 왼쪽 자식 노드를 NIL 노드로 만듦
-  z->right = t->nil; // z의 오른쪽 자식 노드를 NIL 노드로 만듦
-  z->color = RBTREE_RED; // z의 색을 빨간색으로 만듦
+// finger에서 parent를 따라 올라가 key가 들어갈 범위를 가진 가장 낮은 서브트리의 root를 찾는 함수
+// key가 finger보다 크면 finger가 왼쪽 서브트리에 있는 가장 가까운 조상(위쪽 경계)만 확인하면 되고 작으면 반대
+// 경계 조상의 key가 key와 같으면 그 노드를 *equal에 담음 (RBTREE_COUNTED에서 같은 key 노드는 그곳에만 있을 수 있음)
+static node_t *climb_near(const rbtree *t, node_t *finger, const key_t key, node_t **equal, size_t *depth) {
+  node_t *x = finger;
+  *equal = (key == finger->key) ? finger : NULL;
+  if(*equal != NULL) return x;
 
-  rbtree_insert_fixup(t, z); // 삽입 후 불균형을 해결
-  return z; // 삽입한 노드 반환
+  int right = finger->key < key;
+  for(;;)
+  {
+    node_t *c = x, *p = PARENT(t, c);
+    while(p != t->nil && c == (right ? RIGHT(t, p) : LEFT(t, p))) // 같은 쪽으로 올라가는 동안은 경계가 그대로
+    {
+      c = p;
+      p = PARENT(t, p);
+      (*depth)++;
+    }
+    if(p == t->nil) return x; // 그쪽 경계가 없음
+    if(p->key == key)
+    {
+      *equal = p;
+      return x;
+    }
+    if(right ? key < p->key : p->key < key) return x; // 경계 안쪽이므로 x 아래에 들어감
+    x = p; // 경계를 넘었으므로 p의 서브트리에서 다시 확인
+    (*depth)++;
+  }
 }
 
- // 트리에서 노드를 찾는 함수(중복 값이 있을 때)
-node_t *rbtree_find(const rbtree *t, const key_t key)
-{
-    node_t *p = t->root;
+// hint 노드 근처에서부터 key를 삽입하는 함수 (hint가 NULL이면 rbtree_insert와 같음)
+// hint에서 key가 들어갈 서브트리까지만 올라갔다가 내려가므로 key가 hint와 가까울수록 빠름
+// 최대 노드 이상인 key는 hint에서 올라가면 오른쪽 가장자리를 root까지 타야 하므로 rbtree_insert의 append로 보냄
+node_t *rbtree_insert_hint(rbtree *t, node_t *hint, const key_t key) {
+  if(hint == NULL || hint == t->nil || t->max->key <= key) return rbtree_insert(t, key);
+  STAT_ADD(t, inserts, 1);
+  node_t *equal;
+  size_t depth = 0;
+  node_t *x = climb_near(t, hint, key, &equal, &depth);
+#ifdef RBTREE_TOMBSTONE
+  if(equal != NULL && DEAD(equal)) // 경계의 같은 key tombstone은 되살림
+  {
+    STAT_PATH(t, depth + 1, depth + 1);
+    set_dead(t, equal, 0);
+    return equal;
+  }
+#endif
+#ifdef RBTREE_COUNTED
+  if(equal != NULL)
+  {
+    STAT_PATH(t, depth + 1, depth + 1);
+    add_copies(t, equal, 1);
+    return equal;
+  }
+#endif
+  return insert_below(t, x, key, depth);
+}
+
+static node_t *live_equal(const rbtree *t, const node_t *x);
 
+// p에서부터 내려가 key를 가진 노드를 찾는 함수 (depth는 p까지 이미 지나온 노드 수, RBTREE_STATS용)
+// 찾은 노드가 tombstone이면 같은 key가 옆에 살아 있을 수 있으므로 live_equal로 확인함
+static node_t *find_below(const rbtree *t, node_t *p, const key_t key, size_t depth)
+{
     while (p != t->nil && key != p->key) 
     {
-        if (key < p->key) p = p->left;
-        else p = p->right;
+        depth++;
+#ifdef RBTREE_COMPACT
+        uint32_t i = p->right;
+        if (key < p->key) i = p->left; // 인덱스를 먼저 고르면 분기 대신 cmov가 됨
+        p = NODE(t, i);
+#else
+        if (key < p->key) p = LEFT(t, p);
+        else p = RIGHT(t, p);
+#endif
     }
+    STAT_PATH(t, depth + (p != t->nil), 2 * depth + (p != t->nil)); // 내려간 노드마다 !=, < 그리고 찾은 노드에서 ==
 
+    if (p != t->nil && DEAD(p)) return live_equal(t, p);
     if (p != t->nil && p->key == key) return p; // 노드를 찾으면 해당 노드 반환
     else return NULL; // 찾지 못하면 NULL 반환  
 }
 
-// 트리에서 최소값을 찾는 함수
+ // 트리에서 노드를 찾는 함수(중복 값이 있을 때)
+node_t *rbtree_find(const rbtree *t, const key_t key)
+{
+    STAT_ADD(t, lookups, 1);
+    return find_below(t, t->root, key, 0);
+}
+
+// finger 노드 근처에서부터 key를 찾는 함수 (finger가 NULL이면 rbtree_find와 같음)
+// finger에서 key가 있을 수 있는 서브트리까지만 올라갔다가 내려감
+node_t *rbtree_find_near(const rbtree *t, const node_t *finger, const key_t key)
+{
+    if (finger == NULL || finger == t->nil) return rbtree_find(t, key);
+    STAT_ADD(t, lookups, 1);
+    node_t *equal;
+    size_t depth = 0;
+    node_t *x = climb_near(t, (node_t *)finger, key, &equal, &depth);
+    if (equal != NULL)
+    {
+        STAT_PATH(t, depth + 1, depth + 1);
+        return DEAD(equal) ? live_equal(t, equal) : equal;
+    }
+    return find_below(t, x, key, depth);
+}
+
+// 여러 key를 한 번에 찾는 함수 (찾은 key 수 반환, out[i]는 rbtree_find(t, keys[i])와 같음)
+// 탐색 FIND_BATCH_WIDTH개를 번갈아 한 단계씩 내려가면서 다음 자식을 prefetch 해 두면
+// 한 탐색이 cache miss를 기다리는 동안 다른 탐색들이 진행되어 miss가 겹쳐짐
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+  node_t *cur[FIND_BATCH_WIDTH]; // 각 탐색의 현재 노드
+  size_t idx[FIND_BATCH_WIDTH]; // 각 탐색이 맡은 keys의 위치
+  size_t depth[FIND_BATCH_WIDTH]; // RBTREE_STATS용 각 탐색의 경로 길이
+  size_t active = 0, next = 0, found = 0;
+  STAT_ADD(t, lookups, n);
+
+  while(active < FIND_BATCH_WIDTH && next < n) // 처음 탐색들을 root에서 시작
+  {
+    idx[active] = next++;
+    depth[active] = 0;
+    cur[active++] = t->root;
+  }
+
+  while(active > 0)
+  {
+    for(size_t w = 0; w < active;)
+    {
+      node_t *p = cur[w];
+      key_t key = keys[idx[w]];
+      if(p == t->nil || p->key == key) // 이 탐색이 끝남
+      {
+        if(p != t->nil && DEAD(p)) p = live_equal(t, p); // tombstone에서 멈췄으면 살아 있는 같은 key를 찾음
+        if(p == NULL) p = t->nil;
+        out[idx[w]] = (p == t->nil) ? NULL : p;
+        found += p != t->nil;
+        STAT_PATH(t, depth[w] + (p != t->nil), 2 * depth[w] + (p != t->nil));
+        if(next < n) // 남은 key가 있으면 그 자리에서 새 탐색 시작
+        {
+          idx[w] = next++;
+          depth[w] = 0;
+          cur[w] = t->root;
+          w++;
+        }
+        else // 없으면 마지막 탐색을 이 자리로 옮김
+        {
+          active--;
+          cur[w] = cur[active];
+          idx[w] = idx[active];
+          depth[w] = depth[active];
+        }
+        continue;
+      }
+#ifdef RBTREE_COMPACT
+      uint32_t i = p->right;
+      if(key < p->key) i = p->left;
+      p = NODE(t, i);
+#else
+      p = (key < p->key) ? LEFT(t, p) : RIGHT(t, p);
+#endif
+      __builtin_prefetch(p); // 이 탐색으로 다시 돌아올 때까지 캐시에 올라와 있도록 함
+      depth[w]++;
+      cur[w++] = p;
+    }
+  }
+  return found;
+}
+
+// 트리에서 최소값을 찾는 함수 (tombstone은 건너뜀)
+// 가장 왼쪽 노드는 삽입/삭제가 t->min에 맞춰 두므로 읽기만 함 (read lock만 잡은 여러 thread가 함께 불러도 됨)
 node_t *rbtree_min(const rbtree *t) {
-  if(t->root == t->nil) return t->nil; // root 노드가 NIL 노드이면 NIL 노드 반환
-  node_t* x = t->root;
-  while(x->left != t->nil) x = x->left; // x를 x의 왼쪽 자식 노드로 업데이트
-  return x; // 가장 왼쪽 끝에 있는 노드 (최소값을 가진 노드) 반환
+  node_t *x = t->min;
+  if(x != t->nil && DEAD(x)) x = rbtree_successor(t, x);
+  return (x != NULL) ? x : t->nil; // 가장 왼쪽 끝에 있는 노드 (최소값을 가진 노드) 반환
 }
 
-// 트리에서 최대값을 찾는 함수
+// 트리에서 최대값을 찾는 함수 (tombstone은 건너뜀)
 node_t *rbtree_max(const rbtree *t) {
-  if(t->root == t->nil) return t->nil; // root 노드가 NIL 노드이면 NIL 노드 반환
-  node_t* x = t->root;
-  while(x->right != t->nil) x = x->right; // x를 x의 오른쪽 자식 노드로 업데이트
-  return x; // 가장 오른쪽 끝에 있는 노드 (최대값을 가진 노드) 반환
-
+  node_t *x = t->max; // rbtree_min과 같이 읽기만 함
+  if(x != t->nil && DEAD(x)) x = rbtree_predecessor(t, x);
+  return (x != NULL) ? x : t->nil;
 }
 
 // 삭제 후 불균형을 해결하는 함수
 void rbtree_delete_fixup(rbtree *t, node_t *x) {
   node_t* w = NULL;// w는 x의 형제 노드
-  while(x != t->root && x->color == RBTREE_BLACK) // x가 root 노드가 아니고 x의 색이 검은색인 동안 반복
+  while(x != t->root && COLOR(x) == RBTREE_BLACK) // x가 root 노드가 아니고 x의 색이 검은색인 동안 반복
   {
-    if(x == x->parent->left) // x가 x의 부모 노드의 왼쪽 자식 노드이면
+    STAT_ADD(t, delete_fixup_loops, 1);
+    if(x == LEFT(t, PARENT(t, x))) // x가 x의 부모 노드의 왼쪽 자식 노드이면
     {
-      w = x->parent->right; // w는 x의 형제 노드
-      if(w->color == RBTREE_RED) // w의 색이 빨간색이면
+      w = RIGHT(t, PARENT(t, x)); // w는 x의 형제 노드
+      if(COLOR(w) == RBTREE_RED) // w의 색이 빨간색이면
       {
-        w->color = RBTREE_BLACK; // w의 색을 검은색으로 만듦
-        x->parent->color = RBTREE_RED; // x의 부모 노드의 색을 빨간색으로 만듦
-        left_rotate(t, x->parent); // x의 부모 노드를 기준으로 왼쪽으로 회전
-        w = x->parent->right; // w를 x의 부모 노드의 오른쪽 자식 노드로 만듦
+        SET_COLOR(w, RBTREE_BLACK); // w의 색을 검은색으로 만듦
+        SET_COLOR(PARENT(t, x), RBTREE_RED); // x의 부모 노드의 색을 빨간색으로 만듦
+        left_rotate(t, PARENT(t, x)); // x의 부모 노드를 기준으로 왼쪽으로 회전
+        w = RIGHT(t, PARENT(t, x)); // w를 x의 부모 노드의 오른쪽 자식 노드로 만듦
       }
-      if(w->left->color == RBTREE_BLACK && w->right->color == RBTREE_BLACK) // w의 왼쪽 자식 노드와 오른쪽 자식 노드의 색이 모두 검은색이면
+      if(COLOR(LEFT(t, w)) == RBTREE_BLACK && COLOR(RIGHT(t, w)) == RBTREE_BLACK) // w의 왼쪽 자식 노드와 오른쪽 자식 노드의 색이 모두 검은색이면
       {
-        w->color = RBTREE_RED; // w의 색을 빨간색으로 만듦
-        x = x->parent; // x를 x의 부모 노드로 만듦
+        SET_COLOR(w, RBTREE_RED); // w의 색을 빨간색으로 만듦
+        x = PARENT(t, x); // x를 x의 부모 노드로 만듦
       }
       else
       {
-        if(w->right->color == RBTREE_BLACK)
+        if(COLOR(RIGHT(t, w)) == RBTREE_BLACK)
         {
-          w->left->color = RBTREE_BLACK; // w의 왼쪽 자식 노드의 색을 검은색으로 만듦
-          w->color = RBTREE_RED; // w의 색을 빨간색으로 만듦
+          SET_COLOR(LEFT(t, w), RBTREE_BLACK); // w의 왼쪽 자식 노드의 색을 검은색으로 만듦
+          SET_COLOR(w, RBTREE_RED); // w의 색을 빨간색으로 만듦
           right_rotate(t, w); // w를 기준으로 오른쪽으로 회전
-          w = x->parent->right; // w를 x의 부모 노드의 오른쪽 자식 노드로 만듦
+          w = RIGHT(t, PARENT(t, x)); // w를 x의 부모 노드의 오른쪽 자식 노드로 만듦
         }
-        w->color = x->parent->color; // w의 색을 x의 부모 노드의 색으로 만듦
-        x->parent->color = RBTREE_BLACK; // x의 부모 노드의 색을 검은색으로 만듦
-        w->right->color = RBTREE_BLACK; // w의 오른쪽 자식 노드의 색을 검은색으로 만듦
-        left_rotate(t, x->parent); // x의 부모 노드를 기준으로 왼쪽으로 회전
+        SET_COLOR(w, COLOR(PARENT(t, x))); // w의 색을 x의 부모 노드의 색으로 만듦
+        SET_COLOR(PARENT(t, x), RBTREE_BLACK); // x의 부모 노드의 색을 검은색으로 만듦
+        SET_COLOR(RIGHT(t, w), RBTREE_BLACK); // w의 오른쪽 자식 노드의 색을 검은색으로 만듦
+        left_rotate(t, PARENT(t, x)); // x의 부모 노드를 기준으로 왼쪽으로 회전
         x = t->root; // x를 root 노드로 만듦
       }
     }
     else // x == x->parent->right
     {
-      w = x->parent->left; // w는 x의 형제 노드
-      if(w->color == RBTREE_RED) // w의 색이 빨간색이면
+      w = LEFT(t, PARENT(t, x)); // w는 x의 형제 노드
+      if(COLOR(w) == RBTREE_RED) // w의 색이 빨간색이면
       {
-        w->color = RBTREE_BLACK; // w의 색을 검은색으로 만듦
-        x->parent->color = RBTREE_RED; // x의 부모 노드의 색을 빨간색으로 만듦
-        right_rotate(t, x->parent); // x의 부모 노드를 기준으로 오른쪽으로 회전
-        w = x->parent->left; // w를 x의 부모 노드의 왼쪽 자식 노드로 만듦
+        SET_COLOR(w, RBTREE_BLACK); // w의 색을 검은색으로 만듦
+        SET_COLOR(PARENT(t, x), RBTREE_RED); // x의 부모 노드의 색을 빨간색으로 만듦
+        right_rotate(t, PARENT(t, x)); // x의 부모 노드를 기준으로 오른쪽으로 회전
+        w = LEFT(t, PARENT(t, x)); // w를 x의 부모 노드의 왼쪽 자식 노드로 만듦
       }
-      if(w->right->color == RBTREE_BLACK && w->left->color == RBTREE_BLACK) // w의 오른쪽 자식 노드와 왼쪽 자식 노드의 색이 모두 검은색이면
+      if(COLOR(RIGHT(t, w)) == RBTREE_BLACK && COLOR(LEFT(t, w)) == RBTREE_BLACK) // w의 오른쪽 자식 노드와 왼쪽 자식 노드의 색이 모두 검은색이면
       {
-        w->color = RBTREE_RED; // w의 색을 빨간색으로 만듦
-        x = x->parent; // x를 x의 부모 노드로 만듦
+        SET_COLOR(w, RBTREE_RED); // w의 색을 빨간색으로 만듦
+        x = PARENT(t, x); // x를 x의 부모 노드로 만듦
       }
       else
       {
-        if(w->left->color == RBTREE_BLACK) // w의 왼쪽 자식 노드의 색이 검은색이면
+        if(COLOR(LEFT(t, w)) == RBTREE_BLACK) // w의 왼쪽 자식 노드의 색이 검은색이면
         {
-          w->right->color = RBTREE_BLACK; // w의 오른쪽 자식 노드의 색을 검은색으로 만듦
-          w->color = RBTREE_RED; // w의 색을 빨간색으로 만듦
+          SET_COLOR(RIGHT(t, w), RBTREE_BLACK); // w의 오른쪽 자식 노드의 색을 검은색으로 만듦
+          SET_COLOR(w, RBTREE_RED); // w의 색을 빨간색으로 만듦
           left_rotate(t, w); // w를 기준으로 왼쪽으로 회전
-          w = x->parent->left; // w를 x의 부모 노드의 왼쪽 자식 노드로 만듦
+          w = LEFT(t, PARENT(t, x)); // w를 x의 부모 노드의 왼쪽 자식 노드로 만듦
         }
-        w->color = x->parent->color; // w의 색을 x의 부모 노드의 색으로 만듦
-        x->parent->color = RBTREE_BLACK; // x의 부모 노드의 색을 검은색으로 만듦
-        w->left->color = RBTREE_BLACK; // w의 왼쪽 자식 노드의 색을 검은색으로 만듦
-        right_rotate(t, x->parent); // x의 부모 노드를 기준으로 오른쪽으로 회전
+        SET_COLOR(w, COLOR(PARENT(t, x))); // w의 색을 x의 부모 노드의 색으로 만듦
+        SET_COLOR(PARENT(t, x), RBTREE_BLACK); // x의 부모 노드의 색을 검은색으로 만듦
+        SET_COLOR(LEFT(t, w), RBTREE_BLACK); // w의 왼쪽 자식 노드의 색을 검은색으로 만듦
+        right_rotate(t, PARENT(t, x)); // x의 부모 노드를 기준으로 오른쪽으로 회전
         x = t->root; // x를 root 노드로 만듦
       } 
     }
   }
-  x->color = RBTREE_BLACK; // x의 색을 검은색으로 만듦
+  SET_COLOR(x, RBTREE_BLACK); // x의 색을 검은색으로 만듦
 }
 
-// 트리에서 노드를 삭제하는 함수
-int rbtree_erase(rbtree *t, node_t *z) {
+// 노드 z를 트리에서 떼어내고 균형을 맞추는 함수 (z의 메모리는 그대로 둠)
+void rbtree_remove_node(rbtree *t, node_t *z) {
   node_t *y = z; // y는 삭제할 노드
   node_t *x; // x는 y의 자식 노드
 
-  color_t y_original_color = y->color; // y의 색을 저장
-  if (z->left == t->nil)
+  color_t y_original_color = COLOR(y); // y의 색을 저장
+  if(z == t->max) // 최대 노드는 오른쪽 자식이 없으므로 바로 앞 노드는 왼쪽 서브트리의 최대 노드나 부모
+  {
+    node_t *m = LEFT(t, z);
+    if(m != t->nil) while(RIGHT(t, m) != t->nil) m = RIGHT(t, m);
+    else m = PARENT(t, z);
+    t->max = m; // z가 마지막 노드였으면 NIL
+  }
+  if(z == t->min) // 최소 노드는 왼쪽 자식이 없으므로 바로 뒤 노드는 오른쪽 서브트리의 최소 노드나 부모
+  {
+    node_t *m = RIGHT(t, z);
+    if(m != t->nil) while(LEFT(t, m) != t->nil) m = LEFT(t, m);
+    else m = PARENT(t, z);
+    t->min = m;
+  }
+#ifdef RBTREE_ORDER_STAT
+  if(LEFT(t, z) != t->nil && RIGHT(t, z) != t->nil) // 실제로 빠지는 노드는 z 또는 z의 successor
+  {
+    y = RIGHT(t, z);
+    while(LEFT(t, y) != t->nil) y = LEFT(t, y);
+  }
+  size_t gone = COPIES(y); // z 아래에서는 y가 z 자리로 올라가면서 빠지고
+  for(node_t *p = PARENT(t, y); p != t->nil; p = PARENT(t, p)) // 빠지는 노드의 조상들의 서브트리 크기 감소
+  {
+    if(p == z) gone = COPIES(z); // z부터 위로는 z가 빠짐
+    p->size -= gone;
+  }
+  y = z;
+#endif
+  t->count -= COPIES(z); // key 수 감소
+
+  if (LEFT(t, z) == t->nil)
   {
-    x = z->right; // x는 z의 오른쪽 자식 노드
-    rbtree_transplant(t, z, z->right); // z를 z의 오른쪽 자식 노드로 대체
+    x = RIGHT(t, z); // x는 z의 오른쪽 자식 노드
+    rbtree_transplant(t, z, RIGHT(t, z)); // z를 z의 오른쪽 자식 노드로 대체
   }
-  else if(z->right == t->nil)
+  else if(RIGHT(t, z) == t->nil)
   {
-    x = z->left; // x는 z의 왼쪽 자식 노드
-    rbtree_transplant(t, z, z->left); // z를 z의 왼쪽 자식 노드로 대체
+    x = LEFT(t, z); // x는 z의 왼쪽 자식 노드
+    rbtree_transplant(t, z, LEFT(t, z)); // z를 z의 왼쪽 자식 노드로 대체
   }
   else //
   {
-    y = z->right; // y는 z의 오른쪽 자식 노드
-    while(y->left != t->nil) y = y->left; // y를 y의 왼쪽 자식 노드로 업데이트
-    y_original_color = y->color; // y의 색을 저장
-    x = y->right; // x는 y의 오른쪽 자식 노드
-    if(y->parent == z) x->parent = y; // y의 부모 노드가 z이면 x의 부모 노드를 y로 만듦
+    y = RIGHT(t, z); // y는 z의 오른쪽 자식 노드
+    while(LEFT(t, y) != t->nil) y = LEFT(t, y); // y를 y의 왼쪽 자식 노드로 업데이트
+    y_original_color = COLOR(y); // y의 색을 저장
+    x = RIGHT(t, y); // x는 y의 오른쪽 자식 노드
+    if(PARENT(t, y) == z) SET_PARENT(t, x, y); // y의 부모 노드가 z이면 x의 부모 노드를 y로 만듦
     else // y->parent != z
     {
-      rbtree_transplant(t, y, y->right); // y를 y의 오른쪽 자식 노드로 대체
-      y->right = z->right; // y의 오른쪽 자식 노드를 z의 오른쪽 자식 노드로 만듦
-      y->right->parent = y; // y의 오른쪽 자식 노드의 부모 노드를 y로 만듦
+      rbtree_transplant(t, y, RIGHT(t, y)); // y를 y의 오른쪽 자식 노드로 대체
+      SET_RIGHT(t, y, RIGHT(t, z)); // y의 오른쪽 자식 노드를 z의 오른쪽 자식 노드로 만듦
+      SET_PARENT(t, RIGHT(t, y), y); // y의 오른쪽 자식 노드의 부모 노드를 y로 만듦
     }
     rbtree_transplant(t, z, y); // z를 y로 대체
-    y->left = z->left; // y의 왼쪽 자식 노드를 z의 왼쪽 자식 노드로 만듦
-    y->left->parent = y; // y의 왼쪽 자식 노드의 부모 노드를 y로 만듦
-    y->color = z->color; // y의 색을 z의 색으로 만듦
+    SET_LEFT(t, y, LEFT(t, z)); // y의 왼쪽 자식 노드를 z의 왼쪽 자식 노드로 만듦
+    SET_PARENT(t, LEFT(t, y), y); // y의 왼쪽 자식 노드의 부모 노드를 y로 만듦
+    SET_COLOR(y, COLOR(z)); // y의 색을 z의 색으로 만듦
+#ifdef RBTREE_ORDER_STAT
+    y->size = z->size; // y가 z 자리를 차지하므로 서브트리 크기도 물려받음
+#endif
   }
+#ifdef RBTREE_INTERVAL
+  for(node_t *p = PARENT(t, x); p != t->nil; p = PARENT(t, p)) pull_hi(t, p); // x의 부모가 모양이 바뀐 가장 낮은 노드 (z 또는 y의 원래 부모, 또는 y)
+#endif
   if(y_original_color == RBTREE_BLACK) rbtree_delete_fixup(t, x); // y의 색이 검은색이면 불균형을 해결
 
   if(t->root == z) t->root = (y_original_color == RBTREE_BLACK) ? x : y;
-  free(z); // z를 해제
+}
+
+// 트리에서 노드를 삭제하는 함수
+// RBTREE_COUNTED이면 같은 key가 여럿 담긴 노드는 수만 하나 줄임
+// RBTREE_TOMBSTONE이면 떼어내지 않고 tombstone으로 표시만 하므로 회전과 fixup이 없음 (rbtree_compact로 정리)
+int rbtree_erase(rbtree *t, node_t *z) {
+  STAT_ADD(t, erases, 1);
+#ifdef RBTREE_COUNTED
+  if(z->count > 1)
+  {
+    add_copies(t, z, -1);
+    return 0;
+  }
+#endif
+#ifdef RBTREE_TOMBSTONE
+  if(!DEAD(z)) set_dead(t, z, 1); // 이미 tombstone이면 그대로 둠
+#else
+  rbtree_remove_node(t, z); // z를 트리에서 떼어냄
+  release_node(t, z); // z를 할당기에 반납
+#endif
   return 0; // 성공적으로 삭제하면 0을 반환
 }
 
-// 트리를 중위 순회하는 함수 (재귀적)
-int inorder_traversal(const rbtree *t, node_t *x, key_t *arr, int *index, const size_t n) {
-  if(x != t->nil) // x가 NIL 노드가 아닌 동안 반복
+// 최소(right가 0) 또는 최대 노드를 반환하는 함수
+// 그 자리의 tombstone은 떼어내므로 pop을 반복해도 같은 tombstone을 계속 건너뛰지 않음
+static node_t *live_end(rbtree *t, int right) {
+  node_t *x;
+  while((x = right ? t->max : t->min) != t->nil && DEAD(x))
+  {
+    rbtree_remove_node(t, x);
+    release_node(t, x);
+#ifdef RBTREE_TOMBSTONE
+    t->tombstones--;
+#endif
+  }
+  return x;
+}
+
+// 최소 key를 꺼내서 지우는 함수 (비어 있지 않으면 1과 key, 비어 있으면 0)
+// 최소 노드를 기억해 두므로 root에서 내려가지 않고 O(1) + 삭제 fixup
+int rbtree_pop_min(rbtree *t, key_t *key) {
+  node_t *x = live_end(t, 0);
+  if(x == t->nil) return 0;
+  *key = x->key;
+  rbtree_erase(t, x);
+  return 1;
+}
+
+// 최대 key를 꺼내서 지우는 함수
+int rbtree_pop_max(rbtree *t, key_t *key) {
+  node_t *x = live_end(t, 1);
+  if(x == t->nil) return 0;
+  *key = x->key;
+  rbtree_erase(t, x);
+  return 1;
+}
+
+// 중위 순서에서 x 다음 노드를 찾는 함수 (없으면 NULL, tombstone도 그대로 돌려줌)
+static node_t *next_node(const rbtree *t, const node_t *x) {
+  if(RIGHT(t, x) != t->nil) // 오른쪽 서브트리가 있으면 그 중 가장 왼쪽 노드
+  {
+    x = RIGHT(t, x);
+    while(LEFT(t, x) != t->nil) x = LEFT(t, x);
+    return (node_t *)x;
+  }
+
+  node_t *y = PARENT(t, x); // 없으면 x가 왼쪽 서브트리에 속하는 첫 조상
+  while(y != t->nil && x == RIGHT(t, y))
   {
-    if(!inorder_traversal(t, x->left, arr, index, n)) return 0; // 왼쪽 서브트리 방문
+    x = y;
+    y = PARENT(t, y);
+  }
+  return (y == t->nil) ? NULL : y;
+}
 
-    if(*index >= n) return 0; // 배열의 크기를 초과하면 0 반환
-    arr[(*index)++] = x->key; // x의 키를 배열에 저장
+// 중위 순서에서 x 이전 노드를 찾는 함수 (없으면 NULL, tombstone도 그대로 돌려줌)
+static node_t *prev_node(const rbtree *t, const node_t *x) {
+  if(LEFT(t, x) != t->nil) // 왼쪽 서브트리가 있으면 그 중 가장 오른쪽 노드
+  {
+    x = LEFT(t, x);
+    while(RIGHT(t, x) != t->nil) x = RIGHT(t, x);
+    return (node_t *)x;
+  }
 
-    if(!inorder_traversal(t, x->right, arr, index, n)) return 0; // 오른쪽 서브트리 방문
+  node_t *y = PARENT(t, x); // 없으면 x가 오른쪽 서브트리에 속하는 첫 조상
+  while(y != t->nil && x == LEFT(t, y))
+  {
+    x = y;
+    y = PARENT(t, y);
   }
-  return 1; // 성공적으로 순회하면 1 반환
-} 
+  return (y == t->nil) ? NULL : y;
+}
+
+// 중위 순서에서 x 다음 노드를 찾는 함수 (없으면 NULL, tombstone은 건너뜀)
+node_t *rbtree_successor(const rbtree *t, const node_t *x) {
+  node_t *y = next_node(t, x);
+  while(y != NULL && DEAD(y)) y = next_node(t, y);
+  return y;
+}
+
+// 중위 순서에서 x 이전 노드를 찾는 함수 (없으면 NULL, tombstone은 건너뜀)
+node_t *rbtree_predecessor(const rbtree *t, const node_t *x) {
+  node_t *y = prev_node(t, x);
+  while(y != NULL && DEAD(y)) y = prev_node(t, y);
+  return y;
+}
+
+// tombstone x와 같은 key를 가진 살아 있는 노드를 찾는 함수 (없으면 NULL)
+// 같은 key는 중위 순서에서 붙어 있으므로 x의 양옆만 key가 달라질 때까지 확인함 (key가 모두 다르면 이웃 두 개)
+static node_t *live_equal(const rbtree *t, const node_t *x) {
+  for(node_t *p = prev_node(t, x); p != NULL && p->key == x->key; p = prev_node(t, p))
+    if(!DEAD(p)) return p;
+  for(node_t *p = next_node(t, x); p != NULL && p->key == x->key; p = next_node(t, p))
+    if(!DEAD(p)) return p;
+  return NULL;
+}
+
+// 반복자를 최소값 노드에 놓는 함수
+node_t *rbtree_iter_begin(rbtree_iter *it, const rbtree *t) {
+  it->tree = t;
+  node_t *x = rbtree_min(t);
+  it->node = (x == t->nil) ? NULL : x; // 빈 트리면 NULL
+  return it->node;
+}
+
+// 반복자를 최대값 노드에 놓는 함수
+node_t *rbtree_iter_rbegin(rbtree_iter *it, const rbtree *t) {
+  it->tree = t;
+  node_t *x = rbtree_max(t);
+  it->node = (x == t->nil) ? NULL : x; // 빈 트리면 NULL
+  return it->node;
+}
+
+// 반복자를 다음 노드로 옮기는 함수
+node_t *rbtree_iter_next(rbtree_iter *it) {
+  if(it->node != NULL) it->node = rbtree_successor(it->tree, it->node);
+  return it->node;
+}
+
+// 반복자를 이전 노드로 옮기는 함수
+node_t *rbtree_iter_prev(rbtree_iter *it) {
+  if(it->node != NULL) it->node = rbtree_predecessor(it->tree, it->node);
+  return it->node;
+}
 
 // 트리를 배열로 변환하는 함수
 int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) 
 {
-  int index = 0;
-  if(!inorder_traversal(t, t->root, arr, &index, n)) return -1;
+  rbtree_iter it;
+  size_t index = 0;
+  for(node_t *x = rbtree_iter_begin(&it, t); x != NULL; x = rbtree_iter_next(&it)) // 재귀 없이 중위 순회
+  {
+    for(size_t c = 0; c < COPIES(x); c++) // RBTREE_COUNTED이면 같은 key를 수만큼 펼침
+    {
+      if(index >= n) return -1; // 배열의 크기를 초과하면 -1 반환
+      arr[index++] = x->key; // x의 키를 배열에 저장
+    }
+  }
   return 0;
-}
\ No newline at end of file
+}
+
+// rbtree_to_array_parallel에서 thread 하나가 한 번에 가져가는 조각
+// 서브트리 하나이거나, 서브트리들 사이에 놓이는 조상 노드 하나
+typedef struct {
+  node_t *x;
+  int single; // 1이면 x 노드 하나만
+  size_t count; // 조각의 key 수
+  size_t offset; // 배열에서 조각이 시작하는 자리
+} to_array_piece_t;
+
+// rbtree_to_array_parallel의 thread들이 함께 보는 일
+typedef struct {
+  const rbtree *t;
+  to_array_piece_t *pieces;
+  size_t npieces;
+  size_t next; // 아직 아무도 가져가지 않은 첫 조각 (thread마다 atomic하게 하나씩 가져감)
+  int fill; // 0이면 조각의 key 수를 세고, 1이면 배열에 채움
+  key_t *arr;
+  size_t n;
+} to_array_job_t;
+
+// x 서브트리의 key 수를 세는 함수 (오른쪽은 반복문으로 내려감)
+static size_t count_below(const rbtree *t, const node_t *x) {
+  size_t c = 0;
+  while(x != t->nil)
+  {
+    c += count_below(t, LEFT(t, x)) + COPIES(x);
+    x = RIGHT(t, x);
+  }
+  return c;
+}
+
+// x 서브트리의 key를 arr[i]부터 순서대로 쓰고 다음 자리를 반환하는 함수 (n칸을 넘으면 멈춤)
+static size_t fill_below(const rbtree *t, const node_t *x, key_t *arr, size_t i, const size_t n) {
+  while(x != t->nil && i < n)
+  {
+    __builtin_prefetch(RIGHT(t, x)); // 왼쪽을 다 쓰는 동안 오른쪽 자식을 미리 올림
+    i = fill_below(t, LEFT(t, x), arr, i, n);
+    for(size_t c = 0; c < COPIES(x) && i < n; c++) arr[i++] = x->key;
+    x = RIGHT(t, x);
+  }
+  return i;
+}
+
+// x를 depth 단계 아래에서 잘라 중위 순서대로 조각을 만드는 함수
+// 잘린 서브트리 사이에는 그 위의 조상 노드가 한 개짜리 조각으로 들어감
+static void cut_pieces(const rbtree *t, node_t *x, int depth, to_array_piece_t *pieces, size_t *np) {
+  if(x == t->nil) return;
+  if(depth == 0)
+  {
+    pieces[(*np)++] = (to_array_piece_t){x, 0, 0, 0};
+    return;
+  }
+  cut_pieces(t, LEFT(t, x), depth - 1, pieces, np);
+  pieces[(*np)++] = (to_array_piece_t){x, 1, 0, 0};
+  cut_pieces(t, RIGHT(t, x), depth - 1, pieces, np);
+}
+
+// 남은 조각이 없을 때까지 하나씩 가져가서 처리하는 함수 (먼저 끝난 thread가 다음 조각을 가져감)
+static void *to_array_worker(void *arg) {
+  to_array_job_t *job = (to_array_job_t *)arg;
+  const rbtree *t = job->t;
+  size_t i;
+  while((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->npieces)
+  {
+    to_array_piece_t *p = &job->pieces[i];
+    if(!job->fill) p->count = p->single ? COPIES(p->x) : count_below(t, p->x);
+    else if(p->offset >= job->n) continue; // 배열 밖에 놓일 조각
+    else if(p->single)
+    {
+      for(size_t c = 0, j = p->offset; c < COPIES(p->x) && j < job->n; c++) job->arr[j++] = p->x->key;
+    }
+    else fill_below(t, p->x, job->arr, p->offset, job->n);
+  }
+  return NULL;
+}
+
+// nthreads - 1개의 thread를 만들어 현재 thread와 함께 job을 끝내는 함수
+static void to_array_run(to_array_job_t *job, pthread_t *tids, const int nthreads) {
+  int spawned = 0;
+  job->next = 0;
+  while(spawned < nthreads - 1 && pthread_create(&tids[spawned], NULL, to_array_worker, job) == 0) spawned++; // 만들 수 없으면 있는 thread로만 처리
+  to_array_worker(job);
+  for(int i = 0; i < spawned; i++) pthread_join(tids[i], NULL);
+}
+
+// rbtree_to_array와 같지만 서브트리마다 배열의 자리를 정해 두고 최대 nthreads개의 thread가 나누어 채우는 함수
+// RBTREE_ORDER_STAT이면 서브트리 크기로 바로 자리를 정하고, 아니면 먼저 병렬로 key 수를 셈
+// nthreads는 PARALLEL_MAX_THREADS까지 (조각 표와 thread 목록이 nthreads에 비례함)
+int rbtree_to_array_parallel(const rbtree *t, key_t *arr, const size_t n, int nthreads) {
+  if(nthreads <= 1 || t->count < TO_ARRAY_PARALLEL_MIN) return rbtree_to_array(t, arr, n); // thread를 만드는 비용이 더 큼
+  if(nthreads > PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  int depth = 0;
+  while(((size_t)1 << depth) < (size_t)nthreads * TO_ARRAY_PIECES) depth++; // 서브트리 조각이 thread마다 TO_ARRAY_PIECES개쯤
+  to_array_piece_t *pieces = (to_array_piece_t *)malloc((((size_t)2 << depth) - 1) * sizeof(to_array_piece_t));
+  pthread_t *tids = (pthread_t *)malloc((nthreads - 1) * sizeof(pthread_t));
+  if(pieces == NULL || tids == NULL)
+  {
+    free(pieces);
+    free(tids);
+    return rbtree_to_array(t, arr, n);
+  }
+
+  to_array_job_t job = {t, pieces, 0, 0, 0, arr, n};
+  cut_pieces(t, t->root, depth, pieces, &job.npieces);
+#ifdef RBTREE_ORDER_STAT
+  for(size_t i = 0; i < job.npieces; i++) pieces[i].count = pieces[i].single ? COPIES(pieces[i].x) : pieces[i].x->size;
+#else
+  to_array_run(&job, tids, nthreads);
+#endif
+  size_t total = 0;
+  for(size_t i = 0; i < job.npieces; i++) // 앞 조각들의 key 수를 더한 곳이 이 조각의 시작 자리
+  {
+    pieces[i].offset = total;
+    total += pieces[i].count;
+  }
+  job.fill = 1;
+  to_array_run(&job, tids, nthreads);
+  free(pieces);
+  free(tids);
+  return total > n ? -1 : 0; // 배열이 작으면 앞의 n개만 채우고 -1 반환
+}
+
+// key 이상인 첫 노드를 찾는 함수 (없으면 NULL)
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+  node_t *res = NULL; // 지금까지 찾은 후보
+  node_t *p = t->root;
+  size_t depth = 0; // RBTREE_STATS용 경로 길이
+  STAT_ADD(t, lookups, 1);
+  while(p != t->nil)
+  {
+    depth++;
+    if(p->key < key) p = RIGHT(t, p); // 작으면 오른쪽에서 찾음
+    else // 크거나 같으면 후보로 기억하고 더 앞쪽(왼쪽)을 찾음
+    {
+      res = p;
+      p = LEFT(t, p);
+    }
+  }
+  STAT_PATH(t, depth, depth); // 노드마다 비교 한 번
+  if(res != NULL && DEAD(res)) res = rbtree_successor(t, res); // tombstone이면 다음 살아 있는 노드
+  return res;
+}
+
+// key보다 큰 첫 노드를 찾는 함수 (없으면 NULL)
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+  node_t *res = NULL; // 지금까지 찾은 후보
+  node_t *p = t->root;
+  size_t depth = 0; // RBTREE_STATS용 경로 길이
+  STAT_ADD(t, lookups, 1);
+  while(p != t->nil)
+  {
+    depth++;
+    if(p->key <= key) p = RIGHT(t, p); // 작거나 같으면 오른쪽에서 찾음
+    else // 크면 후보로 기억하고 더 앞쪽(왼쪽)을 찾음
+    {
+      res = p;
+      p = LEFT(t, p);
+    }
+  }
+  STAT_PATH(t, depth, depth); // 노드마다 비교 한 번
+  if(res != NULL && DEAD(res)) res = rbtree_successor(t, res); // tombstone이면 다음 살아 있는 노드
+  return res;
+}
+
+// key와 같은 노드들의 구간 [*first, *last)를 구하는 함수 (last가 NULL이면 끝까지)
+void rbtree_equal_range(const rbtree *t, const key_t key, node_t **first, node_t **last) {
+  *first = rbtree_lower_bound(t, key);
+  *last = rbtree_upper_bound(t, key);
+  if(*first == *last) *first = *last = NULL; // 같은 key가 없으면 빈 구간
+}
+
+// [lo, hi) 구간의 노드마다 cb를 호출하는 함수 (cb가 0이 아닌 값을 반환하면 중단)
+size_t rbtree_range_foreach(const rbtree *t, const key_t lo, const key_t hi, int (*cb)(node_t *, void *), void *ctx) {
+  size_t count = 0;
+  for(node_t *x = rbtree_lower_bound(t, lo); x != NULL && x->key < hi; x = rbtree_successor(t, x)) // 한 번만 내려간 뒤 hi에서 멈춤
+  {
+    count++;
+    if(cb(x, ctx)) break;
+  }
+  return count; // cb를 호출한 횟수 반환
+}
+
+// [lo, hi) 구간의 key를 최대 cap개까지 out에 담는 함수
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+  size_t count = 0;
+  for(node_t *x = rbtree_lower_bound(t, lo); x != NULL && x->key < hi && count < cap; x = rbtree_successor(t, x))
+    for(size_t c = 0; c < COPIES(x) && count < cap; c++) out[count++] = x->key; // 같은 key는 수만큼 펼침
+  return count; // out에 담은 개수 반환
+}
+
+// 트리의 key 수를 구하는 함수 (RBTREE_COUNTED이면 노드 수가 아니라 같은 key까지 센 수)
+size_t rbtree_size(const rbtree *t) {
+  return t->count;
+}
+
+// key보다 작은 key의 개수를 구하는 함수
+size_t rbtree_rank(const rbtree *t, const key_t key) {
+  size_t rank = 0;
+#ifdef RBTREE_ORDER_STAT
+  node_t *p = t->root;
+  while(p != t->nil)
+  {
+    if(p->key < key) // p와 p의 왼쪽 서브트리는 모두 key보다 작음
+    {
+      rank += LEFT(t, p)->size + COPIES(p);
+      p = RIGHT(t, p);
+    }
+    else p = LEFT(t, p);
+  }
+#else
+  // 서브트리 크기가 없으면 앞에서부터 셈 (O(rank))
+  rbtree_iter it;
+  for(node_t *x = rbtree_iter_begin(&it, t); x != NULL && x->key < key; x = rbtree_iter_next(&it)) rank += COPIES(x);
+#endif
+  return rank;
+}
+
+// k번째(0부터 시작)로 작은 key가 담긴 노드를 찾는 함수 (없으면 NULL)
+node_t *rbtree_select(const rbtree *t, size_t k) {
+  if(k >= t->count) return NULL; // 범위를 벗어나면 NULL 반환
+#ifdef RBTREE_ORDER_STAT
+  node_t *p = t->root;
+  while(p != t->nil)
+  {
+    size_t left = LEFT(t, p)->size; // p보다 앞에 있는 key 수
+    if(k < left) p = LEFT(t, p); // 왼쪽 서브트리 안에 있음
+    else if(k < left + COPIES(p)) return p; // p가 k번째
+    else // 오른쪽 서브트리에서 남은 순서를 찾음
+    {
+      k -= left + COPIES(p);
+      p = RIGHT(t, p);
+    }
+  }
+  return NULL;
+#else
+  // 서브트리 크기가 없으면 앞에서부터 k칸 이동 (O(k))
+  node_t *x = rbtree_min(t);
+  for(; k >= COPIES(x); x = rbtree_successor(t, x)) k -= COPIES(x);
+  return x;
+#endif
+}
+
+// [lo, hi) 구간에 있는 key의 개수를 구하는 함수
+size_t rbtree_count_range(const rbtree *t, const key_t lo, const key_t hi) {
+  if(hi <= lo) return 0; // 빈 구간
+  return rbtree_rank(t, hi) - rbtree_rank(t, lo);
+}
+
+#ifdef RBTREE_INTERVAL
+// 구간 [lo, hi]를 추가하는 함수 (노드의 key가 lo, hi < lo이면 NULL)
+node_t *rbtree_interval_insert(rbtree *t, const key_t lo, const key_t hi) {
+  if(hi < lo) return NULL;
+  node_t *x = rbtree_insert(t, lo); // 점 구간 [lo, lo]로 넣은 뒤 끝만 늘림
+  if(x != NULL && x->hi != hi) set_hi(t, x, hi);
+  return x;
+}
+
+// x 서브트리에서 [lo, hi]와 겹치는 구간을 key 순서대로 cb에 넘기는 함수 (cb가 멈추라고 하면 1 반환)
+static int overlap_below(const rbtree *t, node_t *x, const key_t lo, const key_t hi, int (*cb)(node_t *, void *), void *ctx, size_t *count) {
+  while(x != t->nil && lo <= x->max_hi) // 서브트리의 구간이 모두 lo 전에 끝나면 내려가지 않음
+  {
+    if(overlap_below(t, LEFT(t, x), lo, hi, cb, ctx, count)) return 1;
+    if(hi < x->key) return 0; // x와 오른쪽 서브트리의 구간은 모두 hi 뒤에 시작
+    if(lo <= x->hi && !DEAD(x))
+    {
+      (*count)++;
+      if(cb(x, ctx)) return 1;
+    }
+    x = RIGHT(t, x);
+  }
+  return 0;
+}
+
+// [lo, hi]와 겹치는 구간(key <= hi이고 lo <= 끝)의 노드를 key 순서대로 cb에 넘기고 호출한 횟수를 반환하는 함수
+// cb가 0이 아닌 값을 반환하면 멈춤. 점 p를 지나는 구간은 lo == hi == p로 찾음 (stabbing query)
+// max_hi가 lo보다 작은 서브트리와 key가 hi보다 큰 노드의 오른쪽은 건너뜀
+size_t rbtree_interval_overlap(const rbtree *t, const key_t lo, const key_t hi, int (*cb)(node_t *, void *), void *ctx) {
+  size_t count = 0;
+  if(lo <= hi) overlap_below(t, t->root, lo, hi, cb, ctx, &count);
+  return count;
+}
+#endif
+
+// 정렬된 배열 arr[lo, hi)로 완전 균형 서브트리를 만드는 함수
+// 노드를 중위 순서대로 할당하므로 메모리 순서와 key 순서가 같음
+// RBTREE_COUNTED이면 arr은 서로 다른 key이고 copies[i]가 arr[i]의 수
+static node_t *build_balanced(rbtree *t, const key_t *arr, const size_t *copies, size_t lo, size_t hi, int depth, int red_depth) {
+  if(lo == hi) return t->nil; // 빈 구간이면 NIL 노드 반환
+
+  size_t mid = lo + (hi - lo) / 2; // 가운데 원소가 서브트리의 root
+  node_t *left = build_balanced(t, arr, copies, lo, mid, depth + 1, red_depth); // 왼쪽 서브트리
+  if(left == NULL) return NULL; // 할당에 실패하면 NULL 반환
+
+  node_t *x = alloc_node(t);
+  if(x == NULL) return NULL;
+  x->key = arr[mid];
+#ifdef RBTREE_COUNTED
+  x->count = copies[mid];
+#elif defined(RBTREE_TOMBSTONE)
+  x->dead = 0;
+#endif
+  SET_COLOR(x, (depth == red_depth) ? RBTREE_RED : RBTREE_BLACK); // 덜 채워진 마지막 층만 빨간색
+  SET_LEFT(t, x, left);
+  if(left != t->nil) SET_PARENT(t, left, x);
+
+  node_t *right = build_balanced(t, arr, copies, mid + 1, hi, depth + 1, red_depth); // 오른쪽 서브트리
+  if(right == NULL) return NULL;
+  SET_RIGHT(t, x, right);
+  if(right != t->nil) SET_PARENT(t, right, x);
+#ifdef RBTREE_ORDER_STAT
+  x->size = left->size + right->size + COPIES(x); // 양쪽 서브트리와 x의 key 수
+#endif
+#ifdef RBTREE_INTERVAL
+  x->hi = x->key; // 배열의 key는 점 구간
+  pull_hi(t, x);
+#endif
+  return x;
+}
+
+// 정렬된 배열로부터 트리를 O(n)에 만드는 함수
+rbtree *rbtree_from_sorted(const key_t *arr, const size_t n) {
+  rbtree *t = create_rbtree(RBTREE_DEFAULT_SLAB, n + 1); // 이후 삽입도 pool에서 할당 (압축 노드는 NIL까지 n + 1칸을 예약)
+  if(t == NULL || n == 0) return t;
+
+  const key_t *keys = arr;
+  size_t *copies = NULL, m = n; // 만들 노드 수
+#ifdef RBTREE_COUNTED
+  // 같은 key끼리 묶어 노드 하나에 담음
+  key_t *uniq = (key_t *)malloc(n * sizeof(key_t));
+  copies = (size_t *)malloc(n * sizeof(size_t));
+  if(uniq == NULL || copies == NULL)
+  {
+    free(uniq);
+    free(copies);
+    delete_rbtree(t);
+    return NULL;
+  }
+  m = 0;
+  for(size_t i = 0; i < n; i++)
+  {
+    if(m > 0 && uniq[m - 1] == arr[i]) copies[m - 1]++;
+    else
+    {
+      uniq[m] = arr[i];
+      copies[m++] = 1;
+    }
+  }
+  keys = uniq;
+#endif
+
+  // 가운데 분할로 만든 트리는 모든 NIL까지의 깊이가 red_depth 또는 red_depth + 1
+  // red_depth 층을 빨간색으로 칠하면 위쪽 층은 모두 검은색이라 black height가 같아짐
+  int red_depth = 0;
+  for(size_t k = m + 1; k > 1; k >>= 1) red_depth++; // floor(log2(m + 1))
+
+  node_t *root = NULL;
+  if(reserve_nodes(t, m)) root = build_balanced(t, keys, copies, 0, m, 0, red_depth); // 노드 m개를 한 번에 할당
+#ifdef RBTREE_COUNTED
+  free(uniq);
+  free(copies);
+#endif
+  if(root == NULL) // 할당에 실패하면 NULL 반환 (만들던 노드는 slab과 함께 해제)
+  {
+    delete_rbtree(t);
+    return NULL;
+  }
+  SET_PARENT(t, root, t->nil);
+  t->root = root;
+  find_ends(t);
+  t->count = n;
+  return t;
+}
+
+// qsort에 넘기는 key 비교 함수
+static int compare_keys(const void *a, const void *b) {
+  const key_t x = *(const key_t *)a;
+  const key_t y = *(const key_t *)b;
+  return (x > y) - (x < y);
+}
+
+// 정렬되지 않은 배열로부터 트리를 만드는 함수 (정렬 후 rbtree_from_sorted)
+rbtree *rbtree_from_array(const key_t *arr, const size_t n) {
+  key_t *sorted = (key_t *)malloc((n ? n : 1) * sizeof(key_t)); // 정렬용 복사본
+  if(sorted == NULL) return NULL;
+
+  for(size_t i = 0; i < n; i++) sorted[i] = arr[i];
+  qsort(sorted, n, sizeof(key_t), compare_keys);
+
+  rbtree *t = rbtree_from_sorted(sorted, n);
+  free(sorted);
+  return t;
+}
+
+// 서브트리 x를 독립된 서브트리의 root로 떼어내는 함수
+// join/split은 root가 검은색인 서브트리만 다루므로 빨간 root는 검은색으로 바꾸고 black height(*bh)를 1 늘림
+// (black height: root에서 NIL까지 경로의 검은 노드 수, root 포함 NIL 제외)
+static node_t *detach_root(rbtree *t, node_t *x, size_t *bh) {
+  if(x == t->nil) return x; // 여러 트리가 같이 쓰는 NIL에는 쓰지 않음
+  SET_PARENT(t, x, t->nil);
+  if(COLOR(x) == RBTREE_RED)
+  {
+    SET_COLOR(x, RBTREE_BLACK);
+    (*bh)++;
+  }
+  return x;
+}
+
+// 트리의 black height를 구하고 root를 join/split에 넘길 수 있는 상태로 만드는 함수
+// join/split이 트리 모양을 통째로 바꾸므로 root를 다시 정한 쪽에서 find_ends로 최소/최대 노드를 맞춤
+static node_t *tree_root(rbtree *t, size_t *bh) {
+  *bh = 0;
+  for(node_t *x = t->root; x != t->nil; x = LEFT(t, x)) // 어느 경로든 검은 노드 수는 같음
+    if(COLOR(x) == RBTREE_BLACK) (*bh)++;
+  return detach_root(t, t->root, bh);
+}
+
+// l의 모든 key <= x->key <= r의 모든 key일 때 l, x, r을 하나의 서브트리로 합치는 함수
+// l, r은 root가 검은색이고 부모가 NIL인 서브트리이고 lbh, rbh는 각각의 black height
+// 높은 쪽의 가장자리를 따라 낮은 쪽과 black height가 같은 검은 노드까지 내려가 x를 빨간색으로 끼우고
+// rbtree_insert_fixup으로 균형을 맞추므로 O(|lbh - rbh| + 1)
+static node_t *join_node(rbtree *t, node_t *l, size_t lbh, node_t *x, node_t *r, size_t rbh, size_t *bh) {
+  if(lbh == rbh) // 높이가 같으면 x를 검은 root로 씀
+  {
+    SET_LEFT(t, x, l);
+    SET_RIGHT(t, x, r);
+    SET_PARENT(t, x, t->nil);
+    SET_COLOR(x, RBTREE_BLACK);
+    if(l != t->nil) SET_PARENT(t, l, x);
+    if(r != t->nil) SET_PARENT(t, r, x);
+#ifdef RBTREE_ORDER_STAT
+    x->size = l->size + r->size + COPIES(x);
+#endif
+#ifdef RBTREE_INTERVAL
+    pull_hi(t, x);
+#endif
+    *bh = lbh + 1;
+    return x;
+  }
+
+  int right = lbh > rbh; // l이 높으면 l의 오른쪽 가장자리, r이 높으면 r의 왼쪽 가장자리를 따라 내려감
+  node_t *c = right ? l : r; // 높은 쪽에서 x의 자식이 될 노드
+  node_t *o = right ? r : l; // 낮은 쪽 서브트리
+  const size_t target = right ? rbh : lbh;
+  size_t h = right ? lbh : rbh; // c의 black height
+  node_t *p = t->nil;
+  while(COLOR(c) != RBTREE_BLACK || h != target)
+  {
+    if(COLOR(c) == RBTREE_BLACK) h--;
+    p = c;
+    c = right ? RIGHT(t, c) : LEFT(t, c);
+  }
+
+  // p 아래 c 자리에 x를 넣고 c와 o를 x의 자식으로 만듦
+  if(right)
+  {
+    SET_LEFT(t, x, c);
+    SET_RIGHT(t, x, o);
+    SET_RIGHT(t, p, x);
+  }
+  else
+  {
+    SET_LEFT(t, x, o);
+    SET_RIGHT(t, x, c);
+    SET_LEFT(t, p, x);
+  }
+  SET_PARENT(t, x, p);
+  if(c != t->nil) SET_PARENT(t, c, x);
+  if(o != t->nil) SET_PARENT(t, o, x);
+  SET_COLOR(x, RBTREE_RED);
+#ifdef RBTREE_ORDER_STAT
+  x->size = c->size + o->size + COPIES(x);
+  for(node_t *q = p; q != t->nil; q = PARENT(t, q)) q->size += o->size + COPIES(x); // x 위의 조상들은 o와 x만큼 커짐
+#endif
+#ifdef RBTREE_INTERVAL
+  for(node_t *q = x; q != t->nil; q = PARENT(t, q)) pull_hi(t, q); // x와 조상들은 o와 x의 구간을 새로 담음
+#endif
+
+  // 회전이 root를 바꾸면 sub.root에 반영됨 (t->root는 건드리지 않음)
+  // rbtree_union_parallel에서는 여러 thread가 같은 t로 부르므로 *t를 복사하지 않고 필요한 필드만 채움
+  rbtree sub = {.root = right ? l : r, .nil = t->nil, .pool = t->pool};
+  *bh = (right ? lbh : rbh) + rbtree_insert_fixup(&sub, x);
+#ifdef RBTREE_STATS
+  STAT_ADD(t, rotations, sub.stats.rotations); // sub에 센 fixup 횟수를 t에 더함
+  STAT_ADD(t, insert_fixup_loops, sub.stats.insert_fixup_loops);
+#endif
+  return sub.root;
+}
+
+// 서브트리 x(black height bh)를 key 미만(*l)과 key 이상(*r)으로 나누는 함수 (strict이면 key 이하와 key 초과)
+// key까지의 경로를 따라 내려가면서 경로 밖의 서브트리를 join으로 다시 붙이며, join 비용이 높이 차이로 상쇄되어 O(log n)
+static void split_node(rbtree *t, node_t *x, size_t bh, const key_t key, int strict,
+                       node_t **l, size_t *lbh, node_t **r, size_t *rbh) {
+  if(x == t->nil)
+  {
+    *l = *r = t->nil;
+    *lbh = *rbh = 0;
+    return;
+  }
+  size_t xlbh = bh - (COLOR(x) == RBTREE_BLACK), xrbh = xlbh;
+  node_t *xl = detach_root(t, LEFT(t, x), &xlbh);
+  node_t *xr = detach_root(t, RIGHT(t, x), &xrbh);
+
+  if(strict ? key < x->key : key <= x->key) // x와 오른쪽 서브트리는 *r로 감
+  {
+    node_t *m;
+    size_t mbh;
+    split_node(t, xl, xlbh, key, strict, l, lbh, &m, &mbh);
+    *r = join_node(t, m, mbh, x, xr, xrbh, rbh);
+  }
+  else // x와 왼쪽 서브트리는 *l로 감
+  {
+    node_t *m;
+    size_t mbh;
+    split_node(t, xr, xrbh, key, strict, &m, &mbh, r, rbh);
+    *l = join_node(t, xl, xlbh, x, m, mbh, lbh);
+  }
+}
+
+// 서브트리 x에서 가장 오른쪽 노드를 떼어 *last에 담고 나머지 서브트리를 반환하는 함수
+static node_t *split_last(rbtree *t, node_t *x, size_t bh, node_t **last, size_t *rest_bh) {
+  size_t xlbh = bh - (COLOR(x) == RBTREE_BLACK), xrbh = xlbh;
+  node_t *xl = detach_root(t, LEFT(t, x), &xlbh);
+  if(RIGHT(t, x) == t->nil) // x가 가장 오른쪽 노드
+  {
+    *last = x;
+    *rest_bh = xlbh;
+    return xl;
+  }
+  node_t *xr = detach_root(t, RIGHT(t, x), &xrbh);
+  size_t mbh;
+  node_t *m = split_last(t, xr, xrbh, last, &mbh);
+  return join_node(t, xl, xlbh, x, m, mbh, rest_bh);
+}
+
+// l의 모든 key <= r의 모든 key일 때 가운데 노드 없이 두 서브트리를 합치는 함수
+static node_t *join2(rbtree *t, node_t *l, size_t lbh, node_t *r, size_t rbh, size_t *bh) {
+  if(l == t->nil)
+  {
+    *bh = rbh;
+    return r;
+  }
+  node_t *last;
+  size_t mbh;
+  node_t *m = split_last(t, l, lbh, &last, &mbh); // l의 최대 노드를 가운데 노드로 씀
+  return join_node(t, m, mbh, last, r, rbh, bh);
+}
+
+// 서브트리의 노드를 모두 할당기에 반납하고 반납한 key 수를 반환하는 함수
+// 너비 우선으로 돌면서 queue에 넣는 자식을 prefetch 하므로, 꺼낼 때쯤이면 cache에 와 있음
+static size_t release_subtree(rbtree *t, node_t *x) {
+  if(x == t->nil) return 0;
+  node_t *local[RELEASE_QUEUE_LOCAL]; // 작은 서브트리는 malloc 없이 처리
+  node_t **q = local;
+  size_t cap = RELEASE_QUEUE_LOCAL, head = 0, tail = 0, n = 0;
+  q[tail++] = x;
+  while(head < tail)
+  {
+    if(tail + 2 > cap) // queue가 차면 두 배로 늘림
+    {
+      node_t **bigger = (node_t **)malloc(2 * cap * sizeof(node_t *));
+      if(bigger == NULL) break; // 늘릴 수 없으면 남은 서브트리는 release_flat으로 반납
+      memcpy(bigger, q, tail * sizeof(node_t *));
+      if(q != local) free(q);
+      q = bigger;
+      cap *= 2;
+    }
+    node_t *y = q[head++];
+    node_t *l = LEFT(t, y), *r = RIGHT(t, y);
+    n += COPIES(y);
+    if(l != t->nil)
+    {
+      __builtin_prefetch(l, 1);
+      q[tail++] = l;
+    }
+    if(r != t->nil)
+    {
+      __builtin_prefetch(r, 1);
+      q[tail++] = r;
+    }
+    release_node(t, y);
+  }
+  while(head < tail) n += release_flat(t, q[head++]);
+  if(q != local) free(q);
+  return n;
+}
+
+// src의 서브트리 x를 dst의 할당기에 복사하는 함수 (할당에 실패하면 *failed를 1로 만듦)
+static node_t *clone_subtree(rbtree *dst, const rbtree *src, const node_t *x, node_t *parent, int *failed) {
+  if(x == src->nil || *failed) return dst->nil;
+  node_t *y = alloc_node(dst);
+  if(y == NULL)
+  {
+    *failed = 1;
+    return dst->nil;
+  }
+  y->key = x->key;
+#ifdef RBTREE_COUNTED
+  y->count = x->count;
+#elif defined(RBTREE_TOMBSTONE)
+  y->dead = x->dead;
+#endif
+  SET_COLOR(y, COLOR(x));
+  SET_PARENT(dst, y, parent);
+#ifdef RBTREE_ORDER_STAT
+  y->size = x->size;
+#endif
+#ifdef RBTREE_INTERVAL
+  y->hi = x->hi;
+  y->max_hi = x->max_hi;
+#endif
+  SET_LEFT(dst, y, clone_subtree(dst, src, LEFT(src, x), y, failed));
+  SET_RIGHT(dst, y, clone_subtree(dst, src, RIGHT(src, x), y, failed));
+  return y;
+}
+
+#ifndef RBTREE_COMPACT
+// 서브트리 x의 NIL 링크를 nil로 바꾸는 함수
+static void relink_nil(rbtree *src, node_t *x, node_t *nil) {
+  if(x == src->nil) return;
+  relink_nil(src, LEFT(src, x), nil);
+  relink_nil(src, RIGHT(src, x), nil);
+  if(LEFT(src, x) == src->nil) SET_LEFT(src, x, nil);
+  if(RIGHT(src, x) == src->nil) SET_RIGHT(src, x, nil);
+}
+#endif
+
+// src가 dst와 같은 할당기와 NIL을 쓰도록 바꾸는 함수 (src의 내용은 그대로, 성공하면 0)
+// src가 할당기를 혼자 쓰고 할당 방식이 같으면 노드는 그대로 두고 NIL 링크만 바꾸어 slab을 넘기고,
+// 그렇지 않으면 (calloc과 slab이 섞였거나, 압축 노드의 저장소가 다르면) dst의 할당기로 복사함
+static int adopt_tree(rbtree *dst, rbtree *src) {
+  node_pool_t *sp = src->pool, *dp = dst->pool;
+  if(sp == dp) return 0;
+
+#ifndef RBTREE_COMPACT
+  if(sp->refs == 1 && (sp->slab_nodes == 0) == (dp->slab_nodes == 0))
+  {
+    relink_nil(src, src->root, dst->nil);
+    if(src->root == src->nil) src->root = dst->nil;
+    else SET_PARENT(src, src->root, dst->nil);
+    if(sp->slabs != NULL) // src의 slab을 dst의 현재 slab 뒤에 이어 붙임 (반납 목록의 노드는 다시 쓰지 않음)
+    {
+      node_slab_t *tail = sp->slabs;
+      while(tail->next != NULL) tail = tail->next;
+      if(dp->slabs == NULL)
+      {
+        dp->slabs = sp->slabs;
+        dp->used = sp->used;
+      }
+      else
+      {
+        tail->next = dp->slabs->next;
+        dp->slabs->next = sp->slabs;
+      }
+      sp->slabs = NULL;
+    }
+    if(sp->spare != NULL) // 비워 둔 slab도 넘김
+    {
+      node_slab_t *tail = sp->spare;
+      while(tail->next != NULL) tail = tail->next;
+      tail->next = dp->spare;
+      dp->spare = sp->spare;
+    }
+    free(sp);
+    src->pool = dp;
+    src->nil = dst->nil;
+    if(src->root == src->nil) src->min = src->max = src->nil; // 빈 트리는 새 NIL을 가리킴
+    dp->refs++;
+    return 0;
+  }
+#endif
+
+  int failed = 0;
+  node_t *copy = clone_subtree(dst, src, src->root, dst->nil, &failed);
+  if(failed) // 복사하던 노드를 돌려주고 아무것도 바꾸지 않음
+  {
+    release_subtree(dst, copy);
+    return -1;
+  }
+  if(sp->slab_nodes == 0) release_flat(src, src->root);
+  if(--sp->refs == 0) destroy_pool(sp);
+  src->pool = dp;
+  src->nil = dst->nil;
+  src->root = copy;
+  find_ends(src); // 노드가 복사본으로 바뀜
+  dp->refs++;
+  return 0;
+}
+
+// 두 트리가 같은 할당기를 쓰도록 노드 수가 적은 쪽을 많은 쪽으로 옮기는 함수
+static int share_pool(rbtree *a, rbtree *b) {
+  if(a->count < b->count) return adopt_tree(b, a);
+  return adopt_tree(a, b);
+}
+
+// t1의 모든 key <= key <= t2의 모든 key일 때 t1, key, t2를 하나로 합치는 함수
+// 결과는 t1에 담기고 t2는 해제됨. 조건이 맞지 않거나 할당에 실패하면 NULL 반환 (t1, t2의 key는 그대로)
+// 같은 할당기를 쓰는 트리끼리는 (rbtree_split 결과 등) O(log n), 아니면 작은 쪽을 옮기는 비용이 더 듦
+rbtree *rbtree_join(rbtree *t1, const key_t key, rbtree *t2) {
+  if(t1 == t2) return NULL;
+  PURGE(t1);
+  PURGE(t2);
+  node_t *max = rbtree_max(t1), *min = rbtree_min(t2);
+  if((max != t1->nil && key < max->key) || (min != t2->nil && min->key < key)) return NULL; // 순서가 맞지 않음
+  if(share_pool(t1, t2) != 0) return NULL;
+
+  node_t *x = alloc_node(t1);
+  if(x == NULL) return NULL;
+  x->key = key;
+#ifdef RBTREE_INTERVAL
+  x->hi = key; // rbtree_insert처럼 점 구간
+#endif
+#ifdef RBTREE_COUNTED
+  x->count = 1;
+#elif defined(RBTREE_TOMBSTONE)
+  x->dead = 0;
+#endif
+
+  size_t lbh, rbh, bh;
+  node_t *l = tree_root(t1, &lbh);
+  node_t *r = tree_root(t2, &rbh);
+  t1->root = join_node(t1, l, lbh, x, r, rbh, &bh);
+  find_ends(t1);
+  t1->count += t2->count + 1;
+  t2->root = t2->nil;
+  t2->count = 0;
+  delete_rbtree(t2);
+#ifdef RBTREE_COUNTED
+  // t1의 최대나 t2의 최소가 key와 같았으면 바로 옆 노드이므로 x에 합침
+  node_t *next[2] = {rbtree_predecessor(t1, x), rbtree_successor(t1, x)};
+  for(int i = 0; i < 2; i++)
+  {
+    if(next[i] == NULL || next[i]->key != key) continue;
+    size_t c = next[i]->count;
+    rbtree_remove_node(t1, next[i]);
+    release_node(t1, next[i]);
+    add_copies(t1, x, c);
+  }
+#endif
+  return t1;
+}
+
+// t를 key 미만(t에 남음)과 key 이상(반환하는 새 트리)으로 나누는 함수 (할당에 실패하면 NULL)
+// 새 트리는 t와 할당기와 NIL을 같이 쓰고 노드를 옮기거나 새로 할당하지 않음 (둘 다 delete_rbtree로 해제)
+// RBTREE_ORDER_STAT이면 O(log n), 아니면 노드 수를 맞추느라 작은 쪽 크기만큼 더 듦
+rbtree *rbtree_split(rbtree *t, const key_t key) {
+  rbtree *r = (rbtree *)calloc(1, sizeof(rbtree));
+  if(r == NULL) return NULL;
+  PURGE(t);
+  r->pool = t->pool;
+  r->nil = t->nil;
+  t->pool->refs++;
+
+  size_t bh, lbh, rbh;
+  node_t *root = tree_root(t, &bh);
+  split_node(t, root, bh, key, 0, &t->root, &lbh, &r->root, &rbh);
+  find_ends(t);
+  find_ends(r);
+
+#ifdef RBTREE_ORDER_STAT
+  r->count = r->root->size;
+#else
+  // 양쪽을 한 칸씩 번갈아 세어 먼저 끝나는 (작은) 쪽의 크기로 나머지를 구함
+  rbtree_iter il, ir;
+  node_t *a = rbtree_iter_begin(&il, t), *b = rbtree_iter_begin(&ir, r);
+  size_t n = 0;
+  while(a != NULL && b != NULL)
+  {
+    a = rbtree_iter_next(&il);
+    b = rbtree_iter_next(&ir);
+    n++;
+  }
+#ifdef RBTREE_COUNTED
+  // 노드 수가 아니라 key 수를 구해야 하므로 작은 쪽의 key를 다시 셈
+  n = 0;
+  for(node_t *x = rbtree_iter_begin(&il, (b == NULL) ? r : t); x != NULL; x = rbtree_iter_next(&il)) n += x->count;
+#endif
+  r->count = (b == NULL) ? n : t->count - n;
+#endif
+  t->count -= r->count;
+  return r;
+}
+
+// union에서 b를 a의 key 미만(*bl)과 이상(*br)으로 나누는 함수
+// RBTREE_COUNTED이면 b에 a와 같은 key의 노드가 (하나) 있으면 떼어서 a에 합치고 *garbage 목록(right로 연결)에 모음
+// 병렬 합집합이 thread 안에서 할당기를 건드리지 않도록 반납은 호출한 쪽이 나중에 함
+static void union_split(rbtree *t, node_t *a, node_t *b, size_t bbh,
+                        node_t **bl, size_t *blbh, node_t **br, size_t *brbh, node_t **garbage) {
+  split_node(t, b, bbh, a->key, 0, bl, blbh, br, brbh);
+#ifdef RBTREE_COUNTED
+  node_t *eq;
+  size_t eqbh;
+  split_node(t, *br, *brbh, a->key, 1, &eq, &eqbh, br, brbh);
+  if(eq != t->nil)
+  {
+    a->count += eq->count;
+    SET_RIGHT(t, eq, *garbage);
+    *garbage = eq;
+  }
+#else
+  (void)garbage; // 같은 key를 합치는 RBTREE_COUNTED에서만 씀
+#endif
+}
+
+// union_split이 모은 노드를 할당기에 반납하는 함수
+static void release_garbage(rbtree *t, node_t *garbage) {
+  while(garbage != t->nil)
+  {
+    node_t *next = RIGHT(t, garbage);
+    release_node(t, garbage);
+    garbage = next;
+  }
+}
+
+// 두 서브트리의 key를 모두 합치는 함수 (multiset이므로 같은 key도 모두 남음)
+// a의 root key로 b를 나누고 양쪽을 재귀로 합친 뒤 a의 root로 다시 join하므로 O(m log(n/m + 1))
+static node_t *union_node(rbtree *t, node_t *a, size_t abh, node_t *b, size_t bbh, size_t *bh, node_t **garbage) {
+  if(a == t->nil)
+  {
+    *bh = bbh;
+    return b;
+  }
+  if(b == t->nil)
+  {
+    *bh = abh;
+    return a;
+  }
+  size_t albh = abh - (COLOR(a) == RBTREE_BLACK), arbh = albh;
+  node_t *al = detach_root(t, LEFT(t, a), &albh);
+  node_t *ar = detach_root(t, RIGHT(t, a), &arbh);
+  node_t *bl, *br;
+  size_t blbh, brbh, lbh, rbh;
+  union_split(t, a, b, bbh, &bl, &blbh, &br, &brbh, garbage);
+
+  node_t *l = union_node(t, al, albh, bl, blbh, &lbh, garbage);
+  node_t *r = union_node(t, ar, arbh, br, brbh, &rbh, garbage);
+  return join_node(t, l, lbh, a, r, rbh, bh);
+}
+
+// a의 노드 중 key가 b에도 있는 것만 남기는 함수 (나머지 노드는 반납하고 그 수를 *freed에 더함)
+// b의 root key로 a를 key 미만/같음/초과로 나누고 양쪽을 재귀로 처리
+static node_t *intersection_node(rbtree *t, node_t *a, size_t abh, node_t *b, size_t bbh, size_t *bh, size_t *freed) {
+  if(a == t->nil || b == t->nil)
+  {
+    *freed += release_subtree(t, a) + release_subtree(t, b);
+    *bh = 0;
+    return t->nil;
+  }
+  const key_t key = b->key;
+  size_t blbh = bbh - (COLOR(b) == RBTREE_BLACK), brbh = blbh;
+  node_t *bl = detach_root(t, LEFT(t, b), &blbh);
+  node_t *br = detach_root(t, RIGHT(t, b), &brbh);
+  *freed += COPIES(b);
+  release_node(t, b);
+
+  node_t *lt, *ge, *eq, *gt;
+  size_t ltbh, gebh, eqbh, gtbh, lbh, rbh, mbh;
+  split_node(t, a, abh, key, 0, &lt, &ltbh, &ge, &gebh);
+  split_node(t, ge, gebh, key, 1, &eq, &eqbh, &gt, &gtbh);
+
+  node_t *l = intersection_node(t, lt, ltbh, bl, blbh, &lbh, freed);
+  node_t *r = intersection_node(t, gt, gtbh, br, brbh, &rbh, freed);
+  node_t *m = join2(t, l, lbh, eq, eqbh, &mbh); // key와 같은 a의 노드는 모두 남음
+  return join2(t, m, mbh, r, rbh, bh);
+}
+
+// a의 노드 중 key가 b에 없는 것만 남기는 함수 (나머지 노드는 반납하고 그 수를 *freed에 더함)
+static node_t *difference_node(rbtree *t, node_t *a, size_t abh, node_t *b, size_t bbh, size_t *bh, size_t *freed) {
+  if(a == t->nil || b == t->nil)
+  {
+    *freed += release_subtree(t, b);
+    *bh = (a == t->nil) ? 0 : abh;
+    return a;
+  }
+  const key_t key = b->key;
+  size_t blbh = bbh - (COLOR(b) == RBTREE_BLACK), brbh = blbh;
+  node_t *bl = detach_root(t, LEFT(t, b), &blbh);
+  node_t *br = detach_root(t, RIGHT(t, b), &brbh);
+  *freed += COPIES(b);
+  release_node(t, b);
+
+  node_t *lt, *ge, *eq, *gt;
+  size_t ltbh, gebh, eqbh, gtbh, lbh, rbh;
+  split_node(t, a, abh, key, 0, &lt, &ltbh, &ge, &gebh);
+  split_node(t, ge, gebh, key, 1, &eq, &eqbh, &gt, &gtbh);
+  *freed += release_subtree(t, eq); // key와 같은 a의 노드는 모두 빠짐
+
+  node_t *l = difference_node(t, lt, ltbh, bl, blbh, &lbh, freed);
+  node_t *r = difference_node(t, gt, gtbh, br, brbh, &rbh, freed);
+  return join2(t, l, lbh, r, rbh, bh);
+}
+
+// 두 트리에 집합 연산 op를 적용해 결과를 t1에 담고 t2를 해제하는 함수
+static rbtree *set_operation(rbtree *t1, rbtree *t2, int op) {
+  if(t1 == t2) return NULL;
+  PURGE(t1);
+  PURGE(t2);
+  if(share_pool(t1, t2) != 0) return NULL;
+
+  size_t abh, bbh, bh, freed = 0;
+  node_t *a = tree_root(t1, &abh);
+  node_t *b = tree_root(t2, &bbh);
+  node_t *garbage = t1->nil;
+  if(op == SET_UNION) t1->root = union_node(t1, a, abh, b, bbh, &bh, &garbage);
+  else if(op == SET_INTERSECTION) t1->root = intersection_node(t1, a, abh, b, bbh, &bh, &freed);
+  else t1->root = difference_node(t1, a, abh, b, bbh, &bh, &freed);
+  find_ends(t1);
+
+  release_garbage(t1, garbage); // 합쳐진 노드의 key는 남으므로 freed에 넣지 않음
+  t1->count = t1->count + t2->count - freed;
+  t2->root = t2->nil;
+  t2->count = 0;
+  delete_rbtree(t2);
+  return t1;
+}
+
+// t1에 t2의 key를 모두 더하는 함수 (같은 key도 모두 남음, t2의 노드를 그대로 옮겨 씀)
+// 결과는 t1에 담기고 t2는 해제됨. 할당에 실패하면 NULL 반환 (할당기가 다른 트리를 복사해야 할 때만)
+rbtree *rbtree_union(rbtree *t1, rbtree *t2) {
+  return set_operation(t1, t2, SET_UNION);
+}
+
+// t1에서 key가 t2에도 있는 노드만 남기는 함수 (결과는 t1, t2는 해제됨)
+rbtree *rbtree_intersection(rbtree *t1, rbtree *t2) {
+  return set_operation(t1, t2, SET_INTERSECTION);
+}
+
+// t1에서 key가 t2에 있는 노드를 모두 빼는 함수 (결과는 t1, t2는 해제됨)
+rbtree *rbtree_difference(rbtree *t1, rbtree *t2) {
+  return set_operation(t1, t2, SET_DIFFERENCE);
+}
+
+// 병렬 합집합에서 thread 하나가 맡는 일
+typedef struct {
+  rbtree *t;
+  node_t *a, *b, *result;
+  size_t abh, bbh, bh;
+  int depth;
+  node_t *garbage; // 이 thread가 합친 노드 목록 (union_split)
+} union_task_t;
+
+static node_t *union_parallel_node(rbtree *t, node_t *a, size_t abh, node_t *b, size_t bbh, size_t *bh, int depth, node_t **garbage);
+
+static void *union_task(void *arg) {
+  union_task_t *u = (union_task_t *)arg;
+  u->result = union_parallel_node(u->t, u->a, u->abh, u->b, u->bbh, &u->bh, u->depth, &u->garbage);
+  return NULL;
+}
+
+// union_node와 같지만 depth가 남아 있으면 왼쪽 절반을 새 thread에 맡기는 함수
+// 양쪽은 서로 다른 노드만 만지고, 할당/반납이 없으며 NIL에는 쓰지 않으므로 lock이 필요 없음
+static node_t *union_parallel_node(rbtree *t, node_t *a, size_t abh, node_t *b, size_t bbh, size_t *bh, int depth, node_t **garbage) {
+  if(depth == 0 || a == t->nil || b == t->nil) return union_node(t, a, abh, b, bbh, bh, garbage);
+
+  size_t albh = abh - (COLOR(a) == RBTREE_BLACK), arbh = albh;
+  node_t *al = detach_root(t, LEFT(t, a), &albh);
+  node_t *ar = detach_root(t, RIGHT(t, a), &arbh);
+  node_t *bl, *br;
+  size_t blbh, brbh, rbh;
+  union_split(t, a, b, bbh, &bl, &blbh, &br, &brbh, garbage);
+
+  union_task_t left = {t, al, bl, NULL, albh, blbh, 0, depth - 1, t->nil};
+  pthread_t tid;
+  int spawned = pthread_create(&tid, NULL, union_task, &left) == 0;
+  if(!spawned) union_task(&left); // thread를 만들 수 없으면 여기서 처리
+  node_t *r = union_parallel_node(t, ar, arbh, br, brbh, &rbh, depth - 1, garbage);
+  if(spawned) pthread_join(tid, NULL);
+  if(left.garbage != t->nil) // 왼쪽 thread의 목록을 앞에 이어 붙임
+  {
+    node_t *tail = left.garbage;
+    while(RIGHT(t, tail) != t->nil) tail = RIGHT(t, tail);
+    SET_RIGHT(t, tail, *garbage);
+    *garbage = left.garbage;
+  }
+  return join_node(t, left.result, left.bh, a, r, rbh, bh);
+}
+
+// rbtree_union과 같지만 최대 nthreads개의 thread로 나누어 합치는 함수 (nthreads는 PARALLEL_MAX_THREADS까지)
+rbtree *rbtree_union_parallel(rbtree *t1, rbtree *t2, int nthreads) {
+  if(t1 == t2) return NULL;
+  if(nthreads > PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  PURGE(t1);
+  PURGE(t2);
+  if(share_pool(t1, t2) != 0) return NULL;
+
+  int depth = 0;
+  while(((size_t)1 << depth) < (size_t)(nthreads > 1 ? nthreads : 1)) depth++; // 재귀 한 단계마다 thread 수가 두 배
+  size_t abh, bbh, bh;
+  node_t *a = tree_root(t1, &abh);
+  node_t *b = tree_root(t2, &bbh);
+  node_t *garbage = t1->nil;
+  t1->root = union_parallel_node(t1, a, abh, b, bbh, &bh, depth, &garbage);
+  find_ends(t1);
+  release_garbage(t1, garbage);
+
+  t1->count += t2->count;
+  t2->root = t2->nil;
+  t2->count = 0;
+  delete_rbtree(t2);
+  return t1;
+}
+
+// [lo, hi) 구간의 노드를 모두 삭제하고 삭제한 수를 반환하는 함수
+// lo와 hi에서 두 번 split 한 뒤 가운데 서브트리를 통째로 반납하고 양쪽을 join하므로
+// 노드마다 탐색과 fixup을 하지 않고 O(log n + k)
+size_t rbtree_erase_range(rbtree *t, const key_t lo, const key_t hi) {
+  if(!(lo < hi) || t->root == t->nil) return 0;
+  PURGE(t);
+
+  size_t bh, lbh, gebh, mbh, rbh;
+  node_t *l, *ge, *m, *r;
+  node_t *root = tree_root(t, &bh);
+  split_node(t, root, bh, lo, 0, &l, &lbh, &ge, &gebh); // lo 미만 | lo 이상
+  split_node(t, ge, gebh, hi, 0, &m, &mbh, &r, &rbh); // [lo, hi) | hi 이상
+  size_t n = release_subtree(t, m);
+  t->root = join2(t, l, lbh, r, rbh, &bh);
+  find_ends(t);
+  t->count -= n;
+  return n;
+}
+
+#ifndef NDEBUG
+// 노드 주소 순서로 정렬하는 qsort 비교 함수
+static int comp_node_addr(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)*(node_t *const *)a, y = (uintptr_t)*(node_t *const *)b;
+  return (x > y) - (x < y);
+}
+
+// nodes에 같은 노드가 두 번 있는지 검사하는 함수 (assert에서만 씀, 배열을 못 만들면 검사하지 않음)
+static int distinct_nodes(node_t *const *nodes, const size_t n) {
+  node_t **v = (node_t **)malloc((n ? n : 1) * sizeof(node_t *));
+  if(v == NULL) return 1;
+  memcpy(v, nodes, n * sizeof(node_t *));
+  qsort(v, n, sizeof(node_t *), comp_node_addr);
+  size_t i = 1;
+  while(i < n && v[i - 1] != v[i]) i++;
+  free(v);
+  return i >= n;
+}
+#endif
+
+// 트리의 노드 n개(nodes, 중복 없이)를 삭제하고 삭제한 key 수를 반환하는 함수
+// 탐색 없이 노드마다 rbtree_erase를 부르는 반복문이며, 두 단계로 prefetch 함
+// ERASE_BATCH_AHEAD개 앞의 노드 자체를 먼저 당겨 오고, 그 절반만큼 앞의 (이미 와 있는) 노드는
+// 부모와 두 자식까지 당겨 옴 (떼어낼 때 후계자를 찾고 링크를 고치며 읽는 노드들)
+// 그래서 지금 노드를 떼어내고 fixup 하는 동안 뒤 노드들의 cache miss가 함께 진행됨
+// 같은 노드가 두 번 있으면 이미 반납한 노드를 다시 지우게 되므로 debug 빌드에서는 assert로 막음
+// RBTREE_TOMBSTONE이면 이미 tombstone인 노드는 세지 않음
+size_t rbtree_erase_batch(rbtree *t, node_t **nodes, const size_t n) {
+  assert(distinct_nodes(nodes, n));
+  const size_t before = t->count;
+  for(size_t i = 0; i < n; i++)
+  {
+    if(i + ERASE_BATCH_AHEAD < n) __builtin_prefetch(nodes[i + ERASE_BATCH_AHEAD], 1);
+    if(i + ERASE_BATCH_AHEAD / 2 < n) // 앞서 prefetch 한 노드는 이미 와 있으므로 링크를 따라가도 기다리지 않음
+    {
+      node_t *x = nodes[i + ERASE_BATCH_AHEAD / 2];
+      __builtin_prefetch(PARENT(t, x), 1);
+      __builtin_prefetch(LEFT(t, x), 1);
+      __builtin_prefetch(RIGHT(t, x), 1);
+    }
+    rbtree_erase(t, nodes[i]);
+  }
+  return before - t->count;
+}
+
+#ifdef RBTREE_TOMBSTONE
+// 중위 순서로 놓인 노드 v[lo, hi)를 완전 균형 서브트리로 다시 잇는 함수 (build_balanced와 같은 모양, 할당 없음)
+static node_t *link_balanced(rbtree *t, node_t **v, size_t lo, size_t hi, int depth, int red_depth) {
+  if(lo == hi) return t->nil;
+
+  size_t mid = lo + (hi - lo) / 2;
+  node_t *x = v[mid];
+  node_t *left = link_balanced(t, v, lo, mid, depth + 1, red_depth);
+  node_t *right = link_balanced(t, v, mid + 1, hi, depth + 1, red_depth);
+  SET_COLOR(x, (depth == red_depth) ? RBTREE_RED : RBTREE_BLACK);
+  SET_LEFT(t, x, left);
+  SET_RIGHT(t, x, right);
+  if(left != t->nil) SET_PARENT(t, left, x);
+  if(right != t->nil) SET_PARENT(t, right, x);
+#ifdef RBTREE_ORDER_STAT
+  x->size = left->size + right->size + COPIES(x);
+#endif
+#ifdef RBTREE_INTERVAL
+  pull_hi(t, x);
+#endif
+  return x;
+}
+#endif
+
+// tombstone이 전체(살아 있는 key + tombstone)의 max_ratio보다 많으면 모두 떼어내고 떼어낸 수를 반환하는 함수
+// 살아 있는 노드는 할당을 옮기지 않고 O(n)에 완전 균형 트리로 다시 이으므로 들고 있던 노드 포인터는 그대로 쓸 수 있음
+size_t rbtree_compact(rbtree *t, double max_ratio) {
+#ifdef RBTREE_TOMBSTONE
+  const size_t dead = t->tombstones;
+  const size_t total = t->count + dead; // 노드 수 이상 (COUNTED이면 같은 key도 셈)
+  if(dead == 0 || (double)dead <= max_ratio * (double)total) return 0;
+
+  node_t *x = t->root;
+  while(LEFT(t, x) != t->nil) x = LEFT(t, x); // tombstone도 포함한 첫 노드
+  node_t **v = (node_t **)malloc(total * sizeof(node_t *));
+  if(v == NULL) // 배열을 못 만들면 tombstone을 하나씩 떼어냄
+  {
+    while(x != NULL)
+    {
+      node_t *nx = next_node(t, x);
+      if(DEAD(x))
+      {
+        rbtree_remove_node(t, x);
+        release_node(t, x);
+      }
+      x = nx;
+    }
+    t->tombstones = 0;
+    return dead;
+  }
+
+  // 살아 있는 노드는 앞에서부터, tombstone은 뒤에서부터 담음 (순회가 부모를 거쳐 올라가므로 다 돈 뒤에 반납)
+  size_t m = 0, d = total;
+  for(; x != NULL; x = next_node(t, x))
+  {
+    if(DEAD(x)) v[--d] = x;
+    else v[m++] = x;
+  }
+  for(size_t i = d; i < total; i++) release_node(t, v[i]);
+  int red_depth = 0;
+  for(size_t k = m + 1; k > 1; k >>= 1) red_depth++; // floor(log2(m + 1))
+  t->root = link_balanced(t, v, 0, m, 0, red_depth);
+  if(t->root != t->nil) SET_PARENT(t, t->root, t->nil);
+  find_ends(t); // 노드는 그대로지만 모양이 바뀜
+  t->tombstones = 0;
+  free(v);
+  return dead;
+#else
+  (void)t;
+  (void)max_ratio;
+  return 0;
+#endif
+}
+
+#define RBTREE_FNV_OFFSET 14695981039346656037ULL // FNV-1a 64비트 초기값
+#define RBTREE_FNV_PRIME 1099511628211ULL
+
+// FNV-1a 해시에 len 바이트를 더하는 함수
+static uint64_t fnv1a(uint64_t h, const void *p, size_t len) {
+  const unsigned char *b = (const unsigned char *)p;
+  for(size_t i = 0; i < len; i++) h = (h ^ b[i]) * RBTREE_FNV_PRIME;
+  return h;
+}
+
+// Eytzinger 순서(k의 자식이 2k, 2k+1)에서 중위 순서로 첫 위치를 구하는 함수 (n이 0이면 0)
+static size_t eytzinger_first(const size_t n) {
+  if(n == 0) return 0;
+  size_t k = 1;
+  while(2 * k <= n) k = 2 * k; // 가장 왼쪽으로 내려감
+  return k;
+}
+
+// 중위 순서로 다음 위치를 구하는 함수 (없으면 0)
+static size_t eytzinger_next(size_t k, const size_t n) {
+  if(2 * k + 1 <= n) // 오른쪽 서브트리의 가장 왼쪽
+  {
+    k = 2 * k + 1;
+    while(2 * k <= n) k = 2 * k;
+    return k;
+  }
+  while(k & 1) k >>= 1; // 왼쪽 자식이 될 때까지 올라감
+  return k >> 1;
+}
+
+// 트리를 중위 순회하면서 key를 keys의 Eytzinger 위치에 바로 쓰는 함수 (중간 배열 없음)
+// checksum이 NULL이 아니면 key 순서대로 FNV-1a 해시를 계산함
+static void eytzinger_store(const rbtree *t, key_t *keys, uint64_t *checksum) {
+  size_t k = eytzinger_first(t->count);
+  uint64_t h = RBTREE_FNV_OFFSET;
+  rbtree_iter it;
+  for(node_t *x = rbtree_iter_begin(&it, t); x != NULL; x = rbtree_iter_next(&it))
+  {
+    for(size_t c = 0; c < COPIES(x); c++) // 같은 key는 수만큼 펼침
+    {
+      keys[k] = x->key;
+      k = eytzinger_next(k, t->count);
+      if(checksum != NULL) h = fnv1a(h, &x->key, sizeof(key_t));
+    }
+  }
+  if(checksum != NULL) *checksum = h;
+}
+
+// 트리의 key를 읽기 전용 배열로 복사하는 함수 (이후 트리를 바꿔도 snapshot은 그대로)
+rbtree_frozen *rbtree_freeze(const rbtree *t) {
+  const size_t n = t->count;
+  rbtree_frozen *f = (rbtree_frozen *)calloc(1, sizeof(rbtree_frozen));
+  // 1번부터 쓰고, find가 배열 끝 너머를 prefetch 하므로 cache line 단위로 맞춰 할당
+  size_t bytes = ((n + 1) * sizeof(key_t) + 63) / 64 * 64;
+  key_t *keys = (key_t *)aligned_alloc(64, bytes);
+  if(f == NULL || keys == NULL) // 할당에 실패하면 NULL 반환
+  {
+    free(f);
+    free(keys);
+    return NULL;
+  }
+
+  eytzinger_store(t, keys, NULL);
+  f->keys = keys;
+  f->n = n;
+  return f;
+}
+
+// snapshot을 해제하는 함수
+void delete_rbtree_frozen(rbtree_frozen *f) {
+  if(f == NULL) return;
+  if(f->map != NULL) munmap(f->map, f->map_size); // rbtree_frozen_open으로 연 파일
+  else free(f->keys);
+  free(f);
+}
+
+// key 이상인 첫 key의 위치를 구하는 함수 (없으면 0)
+// 비교 결과를 그대로 다음 위치 계산에 써서 분기가 없고, 16단계 아래의 cache line을 미리 읽어 둠
+static size_t frozen_lower_bound(const rbtree_frozen *f, const key_t key) {
+  const key_t *keys = f->keys;
+  size_t k = 1;
+  while(k <= f->n)
+  {
+    __builtin_prefetch(keys + 16 * k); // 4단계 아래 자손 16개가 한 cache line에 모여 있음
+    k = 2 * k + (keys[k] < key);
+  }
+  return k >> __builtin_ffsll(~k); // 마지막으로 왼쪽으로 내려간 위치로 되돌아감
+}
+
+// snapshot에 key가 있는지 확인하는 함수
+int rbtree_frozen_find(const rbtree_frozen *f, const key_t key) {
+  size_t k = frozen_lower_bound(f, key);
+  return k != 0 && f->keys[k] == key;
+}
+
+// key 이상인 첫 key를 구하는 함수 (있으면 1과 그 key)
+int rbtree_frozen_lower_bound(const rbtree_frozen *f, const key_t key, key_t *out) {
+  size_t k = frozen_lower_bound(f, key);
+  if(k == 0) return 0;
+  *out = f->keys[k];
+  return 1;
+}
+
+// [lo, hi) 구간의 key를 최대 cap개까지 out에 담는 함수 (rbtree_range와 같음)
+size_t rbtree_frozen_range(const rbtree_frozen *f, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+  size_t count = 0;
+  for(size_t k = frozen_lower_bound(f, lo); k != 0 && f->keys[k] < hi && count < cap; k = eytzinger_next(k, f->n))
+    out[count++] = f->keys[k];
+  return count; // out에 담은 개수 반환
+}
+
+// 저장 파일 형식 (version 1)
+//   [0, 64)  file_header_t
+//   [64, ..) key_t keys[n + 1]: rbtree_frozen과 같은 Eytzinger 배열 (keys[0]은 0)
+// 자식의 위치가 2k, 2k+1로 정해져 있어 링크를 따로 저장하지 않으며,
+// rbtree_frozen_open은 파일을 mmap 한 그대로 snapshot으로 씀
+#define RBTREE_FILE_MAGIC "RBTREE\0\0"
+#define RBTREE_FILE_VERSION 1
+#define RBTREE_FILE_BYTE_ORDER 0x01020304u // 저장한 기계와 byte order가 다르면 값이 달라짐
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t key_size; // sizeof(key_t)
+  uint32_t reserved;
+  uint64_t count; // key 수
+  uint64_t checksum; // key 순서로 계산한 FNV-1a
+  unsigned char pad[24]; // key 배열이 cache line 경계에서 시작하도록 64바이트로 맞춤
+} file_header_t;
+
+// 트리를 path 파일에 저장하는 함수 (성공하면 0, 실패하면 -1)
+// path.tmp를 전체 크기로 미리 할당한 뒤 mmap 해서 key를 바로 쓰므로 파일 크기만큼의 buffer가 따로 들지 않고,
+// disk가 모자라면 쓰기 전에 posix_fallocate에서 실패함
+// msync 한 뒤 rename으로 바꾸므로, 중간에 죽어도 path는 이전 파일 그대로이고
+// rbtree_frozen_open으로 이전 파일을 mmap 해 둔 쪽도 그대로 읽을 수 있음
+int rbtree_save(const rbtree *t, const char *path) {
+  const size_t n = t->count;
+  const size_t size = sizeof(file_header_t) + (n + 1) * sizeof(key_t);
+  char *tmp = (char *)malloc(strlen(path) + sizeof(".tmp"));
+  if(tmp == NULL) return -1;
+  strcpy(tmp, path);
+  strcat(tmp, ".tmp");
+
+  int err = -1;
+  int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+  {
+    free(tmp);
+    return -1;
+  }
+  void *map = MAP_FAILED;
+  if(posix_fallocate(fd, 0, (off_t)size) == 0) // 0으로 채워지므로 keys[0]과 pad는 쓰지 않아도 됨
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(map != MAP_FAILED)
+  {
+    // key는 중위 순회로 한 번 읽으면서 mapping의 Eytzinger 위치에 바로 씀
+    file_header_t *h = (file_header_t *)map;
+    eytzinger_store(t, (key_t *)((unsigned char *)map + sizeof(file_header_t)), &h->checksum);
+    memcpy(h->magic, RBTREE_FILE_MAGIC, sizeof(h->magic));
+    h->version = RBTREE_FILE_VERSION;
+    h->byte_order = RBTREE_FILE_BYTE_ORDER;
+    h->key_size = sizeof(key_t);
+    h->count = n;
+    err = msync(map, size, MS_SYNC); // rename 전에 내용이 disk에 있어야 함
+    if(munmap(map, size) != 0) err = -1;
+  }
+  if(close(fd) != 0) err = -1;
+  if(err == 0) err = rename(tmp, path);
+  if(err != 0) unlink(tmp);
+  free(tmp);
+  return err == 0 ? 0 : -1;
+}
+
+// 저장 파일을 읽기 전용으로 mmap 하고 header를 검사하는 함수 (실패하면 NULL)
+static file_header_t *map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) return NULL;
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(file_header_t))
+  {
+    close(fd);
+    return NULL;
+  }
+  *size = st.st_size;
+  void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) return NULL;
+
+  // key 배열 크기는 파일 크기에서 구하고 count와 비교만 함 (count로 곱하면 조작된 header에서 넘칠 수 있음)
+  file_header_t *h = (file_header_t *)map;
+  const size_t avail = *size - sizeof(file_header_t);
+  if(memcmp(h->magic, RBTREE_FILE_MAGIC, sizeof(h->magic)) != 0 || h->version != RBTREE_FILE_VERSION ||
+     h->byte_order != RBTREE_FILE_BYTE_ORDER || h->key_size != sizeof(key_t) ||
+     avail % sizeof(key_t) != 0 || avail / sizeof(key_t) < 1 || // keys[0] 자리도 없으면 잘린 파일
+     h->count != avail / sizeof(key_t) - 1)
+  {
+    munmap(map, *size);
+    return NULL;
+  }
+  return h;
+}
+
+// 저장 파일을 snapshot으로 여는 함수 (node마다 파싱이나 할당 없이 파일을 그대로 씀)
+// checksum은 모든 page를 읽어야 하므로 검사하지 않음 (header와 파일 크기만 검사, rbtree_load는 checksum도 검사함)
+rbtree_frozen *rbtree_frozen_open(const char *path) {
+  size_t size;
+  file_header_t *h = map_file(path, &size);
+  if(h == NULL) return NULL;
+
+  rbtree_frozen *f = (rbtree_frozen *)calloc(1, sizeof(rbtree_frozen));
+  if(f == NULL)
+  {
+    munmap(h, size);
+    return NULL;
+  }
+  f->keys = (key_t *)((unsigned char *)h + sizeof(file_header_t));
+  f->n = h->count;
+  f->map = h;
+  f->map_size = size;
+  return f;
+}
+
+// 저장 파일로 트리를 다시 만드는 함수 (checksum이 맞지 않으면 NULL)
+rbtree *rbtree_load(const char *path) {
+  size_t size;
+  file_header_t *h = map_file(path, &size);
+  if(h == NULL) return NULL;
+
+  const size_t n = h->count;
+  const key_t *keys = (const key_t *)((unsigned char *)h + sizeof(file_header_t));
+  key_t *sorted = (key_t *)malloc((n ? n : 1) * sizeof(key_t));
+  if(sorted == NULL)
+  {
+    munmap(h, size);
+    return NULL;
+  }
+
+  // Eytzinger 배열을 중위 순서로 읽으면 정렬된 순서가 됨
+  uint64_t checksum = RBTREE_FNV_OFFSET;
+  size_t k = eytzinger_first(n);
+  for(size_t i = 0; i < n; i++, k = eytzinger_next(k, n))
+  {
+    sorted[i] = keys[k];
+    checksum = fnv1a(checksum, &sorted[i], sizeof(key_t));
+  }
+
+  rbtree *t = NULL;
+  if(checksum == h->checksum) t = rbtree_from_sorted(sorted, n); // 노드를 한 번에 할당해 O(n)에 생성
+  free(sorted);
+  munmap(h, size);
+  return t;
+}
+
+// 내부 동작 횟수를 JSON 객체 하나로 out에 쓰는 함수 (RBTREE_STATS 없이 빌드하면 아무것도 쓰지 않고 -1 반환)
+int rbtree_stats_dump(const rbtree *t, FILE *out) {
+#ifdef RBTREE_STATS
+  // 다른 thread가 세는 중이어도 읽을 수 있게 필드마다 atomic으로 읽음 (필드끼리 같은 순간의 값은 아님)
+  rbtree_stats snap;
+  const size_t *src = (const size_t *)&t->stats;
+  size_t *dst = (size_t *)&snap;
+  for(size_t i = 0; i < sizeof(snap) / sizeof(size_t); i++) dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  const rbtree_stats *s = &snap;
+  size_t ops = s->inserts + s->lookups;
+  fprintf(out, "{\"size\": %zu, \"inserts\": %zu, \"erases\": %zu, \"lookups\": %zu, ", t->count, s->inserts, s->erases, s->lookups);
+  fprintf(out, "\"compares\": %zu, \"compares_per_op\": %.2f, ", s->compares, ops ? (double)s->compares / ops : 0.0);
+  fprintf(out, "\"rotations\": %zu, \"insert_fixup_loops\": %zu, \"delete_fixup_loops\": %zu, ", s->rotations, s->insert_fixup_loops, s->delete_fixup_loops);
+  fprintf(out, "\"allocs\": %zu, \"frees\": %zu, \"depth\": [", s->allocs, s->frees);
+  size_t last = RBTREE_STATS_DEPTHS; // 뒤쪽의 0인 칸은 생략
+  while(last > 0 && s->depth[last - 1] == 0) last--;
+  for(size_t d = 0; d < last; d++) fprintf(out, "%s%zu", d ? ", " : "", s->depth[d]);
+  fprintf(out, "]}\n");
+  return 0;
+#else
+  (void)t;
+  (void)out;
+  return -1;
+#endif
+}
+
+// 내부 동작 횟수를 0으로 되돌리는 함수
+void rbtree_stats_reset(rbtree *t) {
+#ifdef RBTREE_STATS
+  memset(&t->stats, 0, sizeof(t->stats));
+#else
+  (void)t;
+#endif
+}
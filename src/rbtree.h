@@ -2,32 +2,193 @@
 #define _RBTREE_H_
 
 #include <stddef.h>
+#include <stdio.h>
 
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
 typedef int key_t;
 
+#if defined(RBTREE_INTERVAL) && defined(RBTREE_COUNTED)
+#error "RBTREE_INTERVAL keeps one interval per node; build without RBTREE_COUNTED"
+#endif
+
+#ifdef RBTREE_COMPACT
+#include <stdint.h>
+
+// 압축 노드 (16바이트): 링크는 트리 노드 저장소의 32비트 인덱스이고
+// color는 parent 인덱스의 최하위 비트에 들어감
+// 링크는 rbtree_left / rbtree_right / rbtree_parent / rbtree_color로 읽음
+typedef struct node_t {
+  key_t key;
+  uint32_t parent_color;
+  uint32_t left, right;
+#ifdef RBTREE_ORDER_STAT
+  uint32_t size;  // 이 노드를 root로 하는 서브트리의 key 수
+#endif
+#ifdef RBTREE_INTERVAL
+  key_t hi, max_hi;  // 구간 [key, hi]의 끝과 서브트리에서 가장 큰 hi
+#endif
+#ifdef RBTREE_COUNTED
+  uint32_t count;  // 이 노드에 담긴 같은 key의 수
+#elif defined(RBTREE_TOMBSTONE)
+  uint8_t dead;  // rbtree_erase로 지워진 노드 (rbtree_compact까지 자리만 차지)
+#endif
+} node_t;
+#else
 typedef struct node_t {
+#if defined(RBTREE_TOMBSTONE) && !defined(RBTREE_COUNTED)
+  unsigned char color;  // color_t (dead와 같은 4바이트에 넣어 노드를 32바이트로 유지)
+  unsigned char dead;  // rbtree_erase로 지워진 노드 (rbtree_compact까지 자리만 차지)
+#else
   color_t color;
+#endif
   key_t key;
   struct node_t *parent, *left, *right;
+#ifdef RBTREE_ORDER_STAT
+  size_t size;  // 이 노드를 root로 하는 서브트리의 key 수
+#endif
+#ifdef RBTREE_INTERVAL
+  key_t hi;  // 노드가 나타내는 구간 [key, hi]의 끝 (rbtree_insert로 넣으면 key와 같음)
+  key_t max_hi;  // 이 노드를 root로 하는 서브트리에서 가장 큰 hi
+#endif
+#ifdef RBTREE_COUNTED
+  size_t count;  // 이 노드에 담긴 같은 key의 수 (RBTREE_TOMBSTONE이면 0인 노드가 tombstone)
+#endif
 } node_t;
+#endif
+
+// 노드 할당기 (sentinel 노드와 slab 목록을 가짐)
+typedef struct node_pool_t node_pool_t;
+
+#ifdef RBTREE_STATS
+#define RBTREE_STATS_DEPTHS 64  // 경로 길이 histogram 칸 수 (마지막 칸은 그 이상을 모두 셈)
+
+// -DRBTREE_STATS로 빌드하면 트리마다 모으는 내부 동작 횟수
+typedef struct {
+  size_t inserts, erases, lookups;  // rbtree_insert, rbtree_erase, 탐색(find/lower_bound/upper_bound) 호출 수
+  size_t compares;  // 삽입과 탐색에서 key를 비교한 횟수
+  size_t rotations;  // left_rotate + right_rotate
+  size_t insert_fixup_loops, delete_fixup_loops;  // fixup 반복문이 돈 횟수 (재색칠하며 올라간 단계)
+  size_t allocs, frees;  // 할당기에서 노드를 꺼내고 반납한 횟수
+  size_t depth[RBTREE_STATS_DEPTHS];  // 삽입과 탐색이 내려간 노드 수별 횟수
+} rbtree_stats;
+#endif
 
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  node_pool_t *pool;
+  size_t count;  // 전체 key 수 (RBTREE_COUNTED이면 같은 key를 한 노드에 담으므로 노드 수보다 많을 수 있음)
+  node_t *min, *max;  // 가장 왼쪽/오른쪽 노드 (빈 트리면 nil, 트리를 바꾸는 함수가 항상 맞춰 둠)
+#ifdef RBTREE_TOMBSTONE
+  size_t tombstones;  // 지워졌다고 표시만 하고 남아 있는 노드 수 (count에는 들어가지 않음)
+#endif
+#ifdef RBTREE_STATS
+  rbtree_stats stats;  // relaxed atomic으로 더하므로 read lock만 잡은 여러 thread가 같이 세도 빠지지 않음
+#endif
 } rbtree;
 
 rbtree *new_rbtree(void);
+rbtree *new_rbtree_pool(size_t);
+rbtree *rbtree_from_sorted(const key_t *, const size_t);
+rbtree *rbtree_from_array(const key_t *, const size_t);
 void delete_rbtree(rbtree *);
+void rbtree_clear(rbtree *);
+size_t rbtree_compact(rbtree *, double);
 
 node_t *rbtree_insert(rbtree *, const key_t);
 node_t *rbtree_find(const rbtree *, const key_t);
+node_t *rbtree_insert_hint(rbtree *, node_t *, const key_t);
+node_t *rbtree_find_near(const rbtree *, const node_t *, const key_t);
+size_t rbtree_find_batch(const rbtree *, const key_t *, const size_t, node_t **);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 int rbtree_erase(rbtree *, node_t *);
+int rbtree_pop_min(rbtree *, key_t *);  // 비어 있지 않으면 1과 최소 key를 꺼냄
+int rbtree_pop_max(rbtree *, key_t *);  // 비어 있지 않으면 1과 최대 key를 꺼냄
+size_t rbtree_erase_range(rbtree *, const key_t, const key_t);  // RBTREE_TOMBSTONE이면 tombstone을 먼저 정리함 (rbtree_join 위 설명)
+size_t rbtree_erase_batch(rbtree *, node_t **, const size_t);  // 서로 다른 노드들을 prefetch 하며 하나씩 지우고 지운 key 수를 반환
+
+// 노드 레이아웃과 상관없이 링크와 색을 읽는 함수 (자식이 없으면 nil)
+node_t *rbtree_left(const rbtree *, const node_t *);
+node_t *rbtree_right(const rbtree *, const node_t *);
+node_t *rbtree_parent(const rbtree *, const node_t *);
+color_t rbtree_color(const node_t *);
+
+// 노드 메모리를 직접 관리하는 경우 (rbtree_gen.h 참고)
+void rbtree_insert_node(rbtree *, node_t *, node_t *, int);
+void rbtree_remove_node(rbtree *, node_t *);
 
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
+int rbtree_to_array_parallel(const rbtree *, key_t *, const size_t, int);  // 최대 nthreads개의 thread로 나누어 채움 (-pthread)
+
+node_t *rbtree_lower_bound(const rbtree *, const key_t);
+node_t *rbtree_upper_bound(const rbtree *, const key_t);
+void rbtree_equal_range(const rbtree *, const key_t, node_t **, node_t **);
+size_t rbtree_range(const rbtree *, const key_t, const key_t, key_t *, const size_t);
+size_t rbtree_range_foreach(const rbtree *, const key_t, const key_t, int (*)(node_t *, void *), void *);
+
+// RBTREE_ORDER_STAT으로 빌드하면 O(log n), 아니면 순회로 계산
+size_t rbtree_size(const rbtree *);
+size_t rbtree_rank(const rbtree *, const key_t);
+node_t *rbtree_select(const rbtree *, size_t);
+size_t rbtree_count_range(const rbtree *, const key_t, const key_t);
+
+#ifdef RBTREE_INTERVAL
+// -DRBTREE_INTERVAL로 빌드하면 노드마다 닫힌 구간 [key, hi]를 담는 interval tree
+// 서브트리의 가장 큰 hi를 회전과 삽입/삭제, join/split에서 함께 고침 (O(log n) 유지)
+node_t *rbtree_interval_insert(rbtree *, const key_t, const key_t);  // [lo, hi] 추가 (hi < lo이면 NULL)
+size_t rbtree_interval_overlap(const rbtree *, const key_t, const key_t, int (*)(node_t *, void *), void *);  // [lo, hi]와 겹치는 구간을 key 순서대로 cb에 넘김
+#endif
+
+// 중위 순회 반복자 (parent 링크를 따라 이동, 끝에 도달하면 node는 NULL)
+typedef struct {
+  const rbtree *tree;
+  node_t *node;
+} rbtree_iter;
+
+node_t *rbtree_successor(const rbtree *, const node_t *);
+node_t *rbtree_predecessor(const rbtree *, const node_t *);
+
+node_t *rbtree_iter_begin(rbtree_iter *, const rbtree *);
+node_t *rbtree_iter_rbegin(rbtree_iter *, const rbtree *);
+node_t *rbtree_iter_next(rbtree_iter *);
+node_t *rbtree_iter_prev(rbtree_iter *);
+
+// black height를 이용한 join/split과 집합 연산 (결과는 첫 번째 트리에 담기고 두 번째 트리는 해제됨)
+// RBTREE_TOMBSTONE이면 tombstone이 남은 트리는 먼저 rbtree_compact(t, 0)으로 정리하므로 O(n)이 더 듦
+// (join/split이 O(log n)이려면 그 전에 rbtree_compact를 불러 두거나 tombstone이 없어야 함, rbtree_erase_range도 같음)
+rbtree *rbtree_join(rbtree *, const key_t, rbtree *);
+rbtree *rbtree_split(rbtree *, const key_t);
+rbtree *rbtree_union(rbtree *, rbtree *);
+rbtree *rbtree_intersection(rbtree *, rbtree *);
+rbtree *rbtree_difference(rbtree *, rbtree *);
+rbtree *rbtree_union_parallel(rbtree *, rbtree *, int);
+
+// 트리를 Eytzinger 순서(k의 자식이 2k, 2k+1)의 배열로 복사한 읽기 전용 snapshot
+typedef struct {
+  key_t *keys;  // keys[1..n] (keys[0]은 쓰지 않음)
+  size_t n;
+  void *map;  // rbtree_frozen_open으로 연 경우 mmap 한 파일
+  size_t map_size;
+} rbtree_frozen;
+
+rbtree_frozen *rbtree_freeze(const rbtree *);
+void delete_rbtree_frozen(rbtree_frozen *);
+int rbtree_frozen_find(const rbtree_frozen *, const key_t);
+int rbtree_frozen_lower_bound(const rbtree_frozen *, const key_t, key_t *);
+size_t rbtree_frozen_range(const rbtree_frozen *, const key_t, const key_t, key_t *, const size_t);
+
+// 버전과 checksum이 있는 binary 파일로 저장/복원 (파일은 rbtree_frozen 배열을 그대로 담음)
+// rbtree_save는 path.tmp에 쓴 뒤 rename하므로 실패해도 이전 파일이 남음
+// checksum은 rbtree_load만 검사하고, rbtree_frozen_open은 mmap 그대로 쓰느라 header와 크기만 검사함
+int rbtree_save(const rbtree *, const char *);
+rbtree *rbtree_load(const char *);
+rbtree_frozen *rbtree_frozen_open(const char *);
+
+// 내부 동작 횟수를 JSON으로 내보내고 0으로 되돌리는 함수 (RBTREE_STATS 없이 빌드하면 -1 반환)
+int rbtree_stats_dump(const rbtree *, FILE *);
+void rbtree_stats_reset(rbtree *);
 
 
 
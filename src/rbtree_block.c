@@ -0,0 +1,280 @@
+#include "rbtree_block.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define BLOCK_PAD INT_MAX // 빈 칸의 값 (어떤 key보다도 작지 않으므로 세지 않음)
+#define BLOCK_MERGE (RBTREE_BLOCK_KEYS / 4) // 이보다 적어지면 이웃 블록과 합침
+#define BLOCK_MERGED (RBTREE_BLOCK_KEYS * 3 / 4) // 합친 블록이 이만큼을 넘으면 합치지 않음 (곧 다시 나뉘지 않도록)
+
+#define BLOCK_SLAB 2048 // slab 하나에 들어가는 블록 수
+
+#define BLOCK(x) ((rbtree_block_node *)(x))
+
+struct rbtree_block_slab {
+  rbtree_block_slab *next;
+  rbtree_block_node blocks[BLOCK_SLAB]; // 헤더끼리 모아 둠 (내려가는 동안 읽는 부분)
+  key_t keys[BLOCK_SLAB][RBTREE_BLOCK_KEYS] __attribute__((aligned(64))); // blocks[i].keys는 keys[i]
+};
+
+// 블록에서 key보다 작은 key의 수(= key가 들어갈 자리)를 구하는 함수
+// 빈 칸은 BLOCK_PAD로 채워 두었으므로 n과 상관없이 블록 전체를 비교해도 됨
+static inline int block_rank(const rbtree_block_node *b, const key_t key) {
+#if defined(__AVX2__)
+  const __m256i k = _mm256_set1_epi32(key);
+  int r = 0;
+  for(int i = 0; i < RBTREE_BLOCK_KEYS; i += 8) // 8개씩 key > keys[i]를 비교해서 참인 칸 수를 셈
+  {
+    __m256i v = _mm256_load_si256((const __m256i *)(b->keys + i));
+    r += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v))));
+  }
+  return r;
+#elif defined(__SSE2__)
+  const __m128i k = _mm_set1_epi32(key);
+  int r = 0;
+  for(int i = 0; i < RBTREE_BLOCK_KEYS; i += 4) // 4개씩
+  {
+    __m128i v = _mm_load_si128((const __m128i *)(b->keys + i));
+    r += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v))));
+  }
+  return r;
+#else
+  int lo = 0, hi = b->n; // SIMD가 없으면 이진 탐색
+  while(lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if(b->keys[mid] < key) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+#endif
+}
+
+// 첫 key가 key 이하인 마지막 블록을 찾는 함수 (없으면 NULL)
+// key가 트리에 있다면 이 블록에 있음 (앞 블록의 key는 모두 이 블록의 첫 key 이하이므로)
+static rbtree_block_node *floor_block(const rbtree *t, const key_t key) {
+  node_t *res = NULL;
+  node_t *x = t->root;
+  while(x != t->nil) // 링크와 같은 cache line에 있는 link.key만 읽음
+  {
+    if(x->key <= key)
+    {
+      res = x;
+      x = x->right;
+    }
+    else x = x->left;
+  }
+  return BLOCK(res);
+}
+
+// 빈 블록을 할당하는 함수 (반납된 블록이 있으면 다시 씀)
+static rbtree_block_node *new_block(rbtree_block *bt) {
+  rbtree_block_node *b = bt->free_list;
+  if(b != NULL) bt->free_list = BLOCK(b->link.right);
+  else
+  {
+    if(bt->slabs == NULL || bt->used == BLOCK_SLAB) // 현재 slab을 다 쓰면 새 slab을 할당
+    {
+      rbtree_block_slab *slab = (rbtree_block_slab *)aligned_alloc(64, sizeof(rbtree_block_slab));
+      if(slab == NULL) return NULL;
+      slab->next = bt->slabs;
+      bt->slabs = slab;
+      bt->used = 0;
+    }
+    b = &bt->slabs->blocks[bt->used];
+    b->keys = bt->slabs->keys[bt->used++]; // 반납했다가 다시 쓸 때도 그대로 유지됨
+  }
+  b->n = 0;
+  for(int i = 0; i < RBTREE_BLOCK_KEYS; i++) b->keys[i] = BLOCK_PAD;
+  return b;
+}
+
+// 블록 b의 i번째 자리에 key를 넣는 함수 (b에 빈 칸이 있어야 함)
+static void block_put(rbtree_block_node *b, const int i, const key_t key) {
+  memmove(b->keys + i + 1, b->keys + i, (b->n - i) * sizeof(key_t));
+  b->keys[i] = key;
+  b->n++;
+  b->link.key = b->keys[0];
+}
+
+// 블록 b의 i번째 key를 빼는 함수
+static void block_take(rbtree_block_node *b, const int i) {
+  memmove(b->keys + i, b->keys + i + 1, (b->n - i - 1) * sizeof(key_t));
+  b->keys[--b->n] = BLOCK_PAD;
+  b->link.key = b->keys[0];
+}
+
+// 중위 순서에서 b 바로 뒤에 c를 붙이는 함수 (회전과 fixup은 rbtree_insert_node가 함)
+static void link_after(rbtree *t, rbtree_block_node *b, rbtree_block_node *c) {
+  node_t *y = &b->link;
+  int left = 0;
+  if(y->right != t->nil) // 오른쪽 서브트리가 있으면 그 중 가장 왼쪽 노드의 왼쪽 자리
+  {
+    y = y->right;
+    while(y->left != t->nil) y = y->left;
+    left = 1;
+  }
+  rbtree_insert_node(t, y, &c->link, left);
+}
+
+// 블록을 트리에서 떼어내고 반납하는 함수
+static void unlink_block(rbtree_block *bt, rbtree_block_node *b) {
+  rbtree_remove_node(bt->tree, &b->link);
+  b->link.right = (node_t *)bt->free_list;
+  bt->free_list = b;
+}
+
+// 빈 트리를 생성하는 함수
+rbtree_block *new_rbtree_block(void) {
+  rbtree_block *bt = (rbtree_block *)calloc(1, sizeof(rbtree_block));
+  if(bt == NULL) return NULL;
+  bt->tree = new_rbtree(); // 블록은 여기서 할당하므로 트리의 할당기는 쓰지 않음
+  if(bt->tree == NULL)
+  {
+    free(bt);
+    return NULL;
+  }
+  return bt;
+}
+
+// 트리와 모든 블록을 해제하는 함수
+void delete_rbtree_block(rbtree_block *bt) {
+  if(bt == NULL) return;
+  bt->tree->root = bt->tree->nil; // 블록은 slab째로 해제하므로 delete_rbtree가 노드를 하나씩 free하지 않게 비움
+  delete_rbtree(bt->tree);
+  while(bt->slabs != NULL)
+  {
+    rbtree_block_slab *next = bt->slabs->next;
+    free(bt->slabs);
+    bt->slabs = next;
+  }
+  free(bt);
+}
+
+// key를 추가하는 함수
+int rbtree_block_insert(rbtree_block *bt, const key_t key) {
+  rbtree *t = bt->tree;
+  rbtree_block_node *b = floor_block(t, key);
+  if(b == NULL) // 모든 블록의 첫 key보다 작으면 첫 블록의 맨 앞에 넣음
+  {
+    node_t *m = rbtree_min(t);
+    if(m == t->nil) // 빈 트리
+    {
+      if((b = new_block(bt)) == NULL) return -1;
+      block_put(b, 0, key);
+      rbtree_insert_node(t, t->nil, &b->link, 0);
+      bt->count++;
+      return 0;
+    }
+    b = BLOCK(m);
+  }
+
+  int i = block_rank(b, key);
+  if(b->n < RBTREE_BLOCK_KEYS) block_put(b, i, key);
+  else if(i == RBTREE_BLOCK_KEYS && &b->link == rbtree_max(t)) // 가득 찬 최대 블록 뒤에 붙는 key는 새 블록에 혼자 넣음 (순서대로 넣으면 블록이 꽉 찬 채로 남음)
+  {
+    rbtree_block_node *c = new_block(bt);
+    if(c == NULL) return -1;
+    block_put(c, 0, key);
+    link_after(t, b, c);
+  }
+  else // 가득 찬 블록은 뒤쪽 절반을 새 블록으로 옮긴 뒤 넣음
+  {
+    rbtree_block_node *c = new_block(bt);
+    if(c == NULL) return -1;
+    const int h = RBTREE_BLOCK_KEYS / 2;
+    memcpy(c->keys, b->keys + h, (RBTREE_BLOCK_KEYS - h) * sizeof(key_t));
+    c->n = RBTREE_BLOCK_KEYS - h;
+    c->link.key = c->keys[0];
+    for(int j = h; j < RBTREE_BLOCK_KEYS; j++) b->keys[j] = BLOCK_PAD;
+    b->n = h;
+    link_after(t, b, c);
+    if(i <= h) block_put(b, i, key); // 같은 key가 두 블록에 걸쳐도 순서만 맞으면 됨
+    else block_put(c, i - h, key);
+  }
+  bt->count++;
+  return 0;
+}
+
+// key가 있는지 확인하는 함수
+int rbtree_block_find(const rbtree_block *bt, const key_t key) {
+  const rbtree_block_node *b = floor_block(bt->tree, key);
+  if(b == NULL) return 0;
+  int i = block_rank(b, key);
+  return i < b->n && b->keys[i] == key;
+}
+
+// key 하나를 지우는 함수
+int rbtree_block_erase(rbtree_block *bt, const key_t key) {
+  rbtree *t = bt->tree;
+  rbtree_block_node *b = floor_block(t, key);
+  if(b == NULL) return 0;
+  int i = block_rank(b, key);
+  if(i == b->n || b->keys[i] != key) return 0;
+
+  block_take(b, i);
+  bt->count--;
+  if(b->n == 0) unlink_block(bt, b);
+  else if(b->n < BLOCK_MERGE) // 너무 비었으면 뒤 블록을 당겨 오거나 앞 블록에 붙임
+  {
+    rbtree_block_node *s = BLOCK(rbtree_successor(t, &b->link));
+    rbtree_block_node *p = BLOCK(rbtree_predecessor(t, &b->link));
+    if(s != NULL && b->n + s->n <= BLOCK_MERGED)
+    {
+      memcpy(b->keys + b->n, s->keys, s->n * sizeof(key_t));
+      b->n += s->n;
+      unlink_block(bt, s);
+    }
+    else if(p != NULL && p->n + b->n <= BLOCK_MERGED)
+    {
+      memcpy(p->keys + p->n, b->keys, b->n * sizeof(key_t));
+      p->n += b->n;
+      unlink_block(bt, b);
+    }
+  }
+  return 1;
+}
+
+// 최소 key를 구하는 함수
+int rbtree_block_min(const rbtree_block *bt, key_t *out) {
+  node_t *m = rbtree_min(bt->tree);
+  if(m == bt->tree->nil) return 0;
+  *out = BLOCK(m)->keys[0];
+  return 1;
+}
+
+// 최대 key를 구하는 함수
+int rbtree_block_max(const rbtree_block *bt, key_t *out) {
+  node_t *m = rbtree_max(bt->tree);
+  if(m == bt->tree->nil) return 0;
+  *out = BLOCK(m)->keys[BLOCK(m)->n - 1];
+  return 1;
+}
+
+// 전체 key 수를 반환하는 함수 (O(1))
+size_t rbtree_block_size(const rbtree_block *bt) {
+  return bt->count;
+}
+
+// 트리를 배열로 변환하는 함수 (블록 단위로 복사)
+int rbtree_block_to_array(const rbtree_block *bt, key_t *arr, const size_t n) {
+  const rbtree *t = bt->tree;
+  size_t index = 0;
+  rbtree_iter it;
+  for(node_t *x = rbtree_iter_begin(&it, t); x != NULL; x = rbtree_iter_next(&it))
+  {
+    const rbtree_block_node *b = BLOCK(x);
+    if(index + b->n > n) // 배열의 크기를 초과하면 들어가는 만큼만 채우고 -1 반환
+    {
+      memcpy(arr + index, b->keys, (n - index) * sizeof(key_t));
+      return -1;
+    }
+    memcpy(arr + index, b->keys, b->n * sizeof(key_t));
+    index += b->n;
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef _RBTREE_BLOCK_H_
+#define _RBTREE_BLOCK_H_
+
+#include <stddef.h>
+
+#include "rbtree.h"
+
+#ifdef RBTREE_COMPACT
+#error "rbtree_block needs pointer-linked nodes; build without RBTREE_COMPACT"
+#endif
+
+// 노드 하나에 정렬된 key를 여러 개(block) 담는 RB tree ("fat node")
+//
+// 블록마다 node_t를 첫 멤버로 두고 회전과 fixup은 rbtree.c의
+// rbtree_insert_node / rbtree_remove_node를 그대로 씀 (rbtree_gen.h와 같은 방식)
+// link.key에는 블록의 첫 key를 두므로 내려가는 동안에는 노드 헤더만 읽고,
+// 마지막 블록 하나에서만 key 배열을 SIMD(AVX2 / SSE2, 없으면 이진 탐색)로 비교함
+//
+// 헤더와 key 배열은 slab 안의 따로 된 배열에 둠 (헤더끼리 촘촘히 모여 있어야
+// 내려가는 경로가 밟는 cache line과 page가 적음. 한 블록에 함께 두면 헤더마다
+// key 배열만큼 떨어져서 key 비교를 줄인 이득보다 miss가 더 늘어남)
+//
+// 블록이 가득 차면 반으로 나누고 (최대 블록 뒤에 붙는 key는 새 블록 하나로),
+// RBTREE_BLOCK_KEYS / 4 밑으로 줄면 이웃 블록과 합침
+// key 하나하나의 노드가 없으므로 find/erase는 node pointer 대신 key로 동작함
+#ifndef RBTREE_BLOCK_KEYS
+#define RBTREE_BLOCK_KEYS 32  // 블록당 key 수 (8의 배수, 8~32. 16개가 cache line 하나)
+#endif
+
+#if RBTREE_BLOCK_KEYS % 8 != 0 || RBTREE_BLOCK_KEYS < 8 || RBTREE_BLOCK_KEYS > 32
+#error "RBTREE_BLOCK_KEYS must be 8, 16, 24 or 32"
+#endif
+
+typedef struct {
+  node_t link;  // 반드시 첫 멤버 (link.key는 keys[0])
+  int n;  // 채워진 key 수 (1 이상)
+  key_t *keys;  // slab의 key 배열 중 이 블록 몫 (RBTREE_BLOCK_KEYS칸, keys[n..]은 가장 큰 key 값으로 채움)
+} rbtree_block_node;
+
+typedef struct rbtree_block_slab rbtree_block_slab;
+
+typedef struct {
+  rbtree *tree;  // 블록들의 트리 (tree->count는 블록 수)
+  size_t count;  // 전체 key 수
+  rbtree_block_slab *slabs;  // 블록 헤더와 key 배열을 연속으로 잘라 쓰는 slab 목록 (가장 최근 slab이 맨 앞)
+  size_t used;  // 가장 최근 slab에서 쓴 블록 수
+  rbtree_block_node *free_list;  // 반납된 블록 (link.right로 연결)
+} rbtree_block;
+
+rbtree_block *new_rbtree_block(void);
+void delete_rbtree_block(rbtree_block *);
+
+int rbtree_block_insert(rbtree_block *, const key_t);  // 성공하면 0, 할당 실패면 -1
+int rbtree_block_find(const rbtree_block *, const key_t);  // 있으면 1, 없으면 0
+int rbtree_block_erase(rbtree_block *, const key_t);  // key 하나를 지웠으면 1, 없으면 0
+int rbtree_block_min(const rbtree_block *, key_t *);  // 비어 있지 않으면 1과 최소 key
+int rbtree_block_max(const rbtree_block *, key_t *);  // 비어 있지 않으면 1과 최대 key
+size_t rbtree_block_size(const rbtree_block *);
+int rbtree_block_to_array(const rbtree_block *, key_t *, const size_t);  // 배열이 작으면 -1
+
+#endif  // _RBTREE_BLOCK_H_
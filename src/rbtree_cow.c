@@ -0,0 +1,342 @@
+#include "rbtree_cow.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define COW_MAX_DEPTH 128 // 높이는 2log2(n+1)을 넘지 않으므로 순회 stack은 이만큼이면 충분
+#define COW_COPIES_PER_LEVEL 6 // 갱신 한 번이 한 층에서 복사하거나 새로 만드는 노드 수의 상한 (경로 노드, 형제, 회전되는 손자)
+
+#define IS_RED(x) ((x) != NULL && (x)->color == RBTREE_RED)
+
+// 노드의 참조를 하나 늘리는 함수
+static void hold(cow_node_t *x) {
+  if(x != NULL) __atomic_add_fetch(&x->refs, 1, __ATOMIC_RELAXED);
+}
+
+// 노드의 참조를 하나 줄이고, 마지막 참조였으면 해제하면서 자식의 참조도 줄이는 함수
+// 다른 thread가 다른 버전을 놓는 중일 수 있으므로 참조 수는 atomic으로 바꿈
+static void release(cow_node_t *x) {
+  while(x != NULL && __atomic_sub_fetch(&x->refs, 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    release(x->left); // 재귀 깊이는 트리 높이까지
+    cow_node_t *r = x->right;
+    free(x);
+    x = r; // 오른쪽은 반복으로
+  }
+}
+
+// key가 count개인 트리를 한 번 갱신할 때 쓰는 노드 수의 상한을 구하는 함수
+static size_t spare_need(const size_t count) {
+  size_t height = 2; // LLRB의 높이는 2log2(n+1) 이하 (삽입할 노드 한 층 포함)
+  for(size_t k = count + 1; k > 1; k >>= 1) height += 2;
+  return COW_COPIES_PER_LEVEL * height;
+}
+
+// 갱신 한 번에 필요한 노드를 미리 받아 두는 함수 (실패하면 -1, 이미 받아 둔 노드는 그대로 둠)
+// 갱신 도중에 할당이 실패하면 반쯤 고친 트리를 되돌릴 수 없으므로 시작하기 전에 확보함
+static int reserve(rbtree_cow *t) {
+  const size_t need = spare_need(t->count);
+  while(t->spares < need)
+  {
+    cow_node_t *x = (cow_node_t *)malloc(sizeof(cow_node_t));
+    if(x == NULL) return -1;
+    x->right = t->spare;
+    t->spare = x;
+    t->spares++;
+  }
+  return 0;
+}
+
+// 받아 둔 노드를 하나 꺼내는 함수
+// reserve가 갱신 한 번에 쓰는 노드 수의 상한만큼 받아 두므로 목록이 비는 일은 없음 (여기서 할당하면 실패를 되돌릴 수 없음)
+static cow_node_t *take(rbtree_cow *t) {
+  cow_node_t *x = t->spare;
+  assert(x != NULL);
+  t->spare = x->right;
+  t->spares--;
+  return x;
+}
+
+// 트리에서 빠진 (혼자 쓰던) 노드를 받아 둔 목록으로 돌려놓는 함수
+static void put(rbtree_cow *t, cow_node_t *x) {
+  x->right = t->spare;
+  t->spare = x;
+  t->spares++;
+}
+
+// 받아 둔 노드를 다음 갱신에 필요한 만큼만 남기고 해제하는 함수
+// 지운 노드가 모두 목록으로 돌아오므로, 줄어든 트리가 가장 컸을 때의 메모리를 계속 쥐고 있지 않게 함
+static void trim(rbtree_cow *t) {
+  const size_t need = spare_need(t->count);
+  while(t->spares > need)
+  {
+    cow_node_t *x = t->spare;
+    t->spare = x->right;
+    t->spares--;
+    free(x);
+  }
+}
+
+// x를 고칠 수 있게 만드는 함수 (혼자 쓰는 노드면 그대로, 다른 버전과 함께 쓰면 복사본)
+// x는 이미 고칠 수 있는 부모의 자식이거나 root여야 함 (그래야 refs가 1일 때 다른 버전에서 닿을 수 없음)
+static cow_node_t *own(rbtree_cow *t, cow_node_t *x) {
+  if(x == NULL || __atomic_load_n(&x->refs, __ATOMIC_ACQUIRE) == 1) return x;
+
+  cow_node_t *y = take(t);
+  y->refs = 1;
+  y->color = x->color;
+  y->key = x->key;
+  y->left = x->left;
+  y->right = x->right;
+  hold(y->left); // 자식은 x와 y가 함께 가리킴
+  hold(y->right);
+  release(x); // 부모는 이제 x 대신 y를 가리킴
+  return y;
+}
+
+// h를 왼쪽으로 회전하는 함수 (h는 고칠 수 있어야 하고, 오른쪽 자식은 여기서 고칠 수 있게 만듦)
+static cow_node_t *rotate_left(rbtree_cow *t, cow_node_t *h) {
+  cow_node_t *x = own(t, h->right);
+  h->right = x->left;
+  x->left = h;
+  x->color = h->color;
+  h->color = RBTREE_RED;
+  return x;
+}
+
+// h를 오른쪽으로 회전하는 함수
+static cow_node_t *rotate_right(rbtree_cow *t, cow_node_t *h) {
+  cow_node_t *x = own(t, h->left);
+  h->left = x->right;
+  x->right = h;
+  x->color = h->color;
+  h->color = RBTREE_RED;
+  return x;
+}
+
+// h와 두 자식의 색을 뒤집는 함수 (2-3 tree에서 4-노드를 나누거나 3-노드 둘을 합치는 것)
+static void flip_colors(rbtree_cow *t, cow_node_t *h) {
+  h->color = (h->color == RBTREE_RED) ? RBTREE_BLACK : RBTREE_RED;
+  h->left = own(t, h->left);
+  h->right = own(t, h->right);
+  h->left->color = (h->left->color == RBTREE_RED) ? RBTREE_BLACK : RBTREE_RED;
+  h->right->color = (h->right->color == RBTREE_RED) ? RBTREE_BLACK : RBTREE_RED;
+}
+
+// 올라오면서 left-leaning 모양을 되돌리는 함수 (빨간 오른쪽 링크, 연속된 빨간 링크, 4-노드를 정리)
+static cow_node_t *balance(rbtree_cow *t, cow_node_t *h) {
+  if(IS_RED(h->right) && !IS_RED(h->left)) h = rotate_left(t, h);
+  if(IS_RED(h->left) && IS_RED(h->left->left)) h = rotate_right(t, h);
+  if(IS_RED(h->left) && IS_RED(h->right)) flip_colors(t, h);
+  return h;
+}
+
+// h 아래에 key를 넣고 새 서브트리 root를 반환하는 함수
+static cow_node_t *insert_below(rbtree_cow *t, cow_node_t *h, const key_t key) {
+  if(h == NULL)
+  {
+    cow_node_t *z = take(t);
+    z->refs = 1;
+    z->color = RBTREE_RED;
+    z->key = key;
+    z->left = z->right = NULL;
+    return z;
+  }
+  h = own(t, h); // 내려가는 경로는 모두 복사됨
+  if(key < h->key) h->left = insert_below(t, h->left, key);
+  else h->right = insert_below(t, h->right, key); // 같은 key는 오른쪽
+  return balance(t, h);
+}
+
+// h의 왼쪽 자식이나 손자가 빨간색이 되도록 빌려오는 함수 (왼쪽으로 내려가기 전)
+static cow_node_t *move_red_left(rbtree_cow *t, cow_node_t *h) {
+  flip_colors(t, h);
+  if(IS_RED(h->right->left))
+  {
+    h->right = rotate_right(t, h->right);
+    h = rotate_left(t, h);
+    flip_colors(t, h);
+  }
+  return h;
+}
+
+// h의 오른쪽 자식이나 손자가 빨간색이 되도록 빌려오는 함수 (오른쪽으로 내려가기 전)
+static cow_node_t *move_red_right(rbtree_cow *t, cow_node_t *h) {
+  flip_colors(t, h);
+  if(IS_RED(h->left->left))
+  {
+    h = rotate_right(t, h);
+    flip_colors(t, h);
+  }
+  return h;
+}
+
+// h 서브트리의 최소 노드를 빼는 함수
+static cow_node_t *delete_min(rbtree_cow *t, cow_node_t *h) {
+  h = own(t, h);
+  if(h->left == NULL) // 최소 노드는 빨간 잎이므로 그냥 빠짐
+  {
+    cow_node_t *r = h->right;
+    put(t, h);
+    return r;
+  }
+  if(!IS_RED(h->left) && !IS_RED(h->left->left)) h = move_red_left(t, h);
+  h->left = delete_min(t, h->left);
+  return balance(t, h);
+}
+
+// h 서브트리에서 key 하나를 빼는 함수 (key가 서브트리에 있어야 함)
+static cow_node_t *delete_below(rbtree_cow *t, cow_node_t *h, const key_t key) {
+  h = own(t, h);
+  if(key < h->key)
+  {
+    if(!IS_RED(h->left) && !IS_RED(h->left->left)) h = move_red_left(t, h);
+    h->left = delete_below(t, h->left, key);
+  }
+  else
+  {
+    if(IS_RED(h->left)) h = rotate_right(t, h);
+    if(key == h->key && h->right == NULL) // 잎이면 그냥 빠짐
+    {
+      cow_node_t *l = h->left;
+      put(t, h);
+      return l;
+    }
+    cow_node_t *at = h;
+    if(!IS_RED(h->right) && !IS_RED(h->right->left)) h = move_red_right(t, h);
+    // move_red_right가 회전했으면 h는 왼쪽에서 올라온 노드이고 at은 오른쪽 자식이 됨
+    // 같은 key가 여럿이면 올라온 노드도 key와 같을 수 있지만 그 자리에서 빼면 오른쪽 서브트리가 빌려온 빨간색을 잃으므로 at까지 내려감
+    if(h == at && key == h->key) // 오른쪽 서브트리의 최소 key로 바꾸고 그 노드를 뺌
+    {
+      cow_node_t *m = h->right;
+      while(m->left != NULL) m = m->left;
+      h->key = m->key;
+      h->right = delete_min(t, h->right);
+    }
+    else h->right = delete_below(t, h->right, key);
+  }
+  return balance(t, h);
+}
+
+// 빈 버전을 생성하는 함수
+rbtree_cow *new_rbtree_cow(void) {
+  return (rbtree_cow *)calloc(1, sizeof(rbtree_cow));
+}
+
+// t의 지금 내용을 담은 새 버전을 만드는 함수 (root 참조만 늘리므로 O(1))
+// t를 고치는 thread에서 (또는 그 thread와 같은 lock 안에서) 호출해야 함
+rbtree_cow *rbtree_snapshot(const rbtree_cow *t) {
+  rbtree_cow *s = (rbtree_cow *)calloc(1, sizeof(rbtree_cow));
+  if(s == NULL) return NULL;
+  s->root = t->root;
+  s->count = t->count;
+  hold(s->root);
+  return s;
+}
+
+// 버전을 놓는 함수 (다른 버전도 가리키는 노드는 참조 수만 줄어듦)
+void delete_rbtree_cow(rbtree_cow *t) {
+  if(t == NULL) return;
+  release(t->root);
+  while(t->spare != NULL)
+  {
+    cow_node_t *x = t->spare;
+    t->spare = x->right;
+    free(x);
+  }
+  free(t);
+}
+
+// key를 추가하는 함수
+int rbtree_cow_insert(rbtree_cow *t, const key_t key) {
+  if(reserve(t) != 0) return -1;
+  t->root = insert_below(t, t->root, key);
+  t->root->color = RBTREE_BLACK; // balance가 돌려준 root는 이미 고칠 수 있는 노드
+  t->count++;
+  return 0;
+}
+
+// key 하나를 지우는 함수
+int rbtree_cow_erase(rbtree_cow *t, const key_t key) {
+  if(!rbtree_cow_find(t, key)) return 0; // delete_below는 key가 있다고 가정함
+  if(reserve(t) != 0) return -1;
+  cow_node_t *r = own(t, t->root);
+  if(!IS_RED(r->left) && !IS_RED(r->right)) r->color = RBTREE_RED; // root가 2-노드면 빌려올 수 있게 임시로 빨간색
+  r = delete_below(t, r, key);
+  if(IS_RED(r))
+  {
+    r = own(t, r); // 지운 root의 자식이 올라왔으면 다른 버전과 함께 쓰는 노드일 수 있음
+    r->color = RBTREE_BLACK;
+  }
+  t->root = r;
+  t->count--;
+  trim(t); // 갱신 도중에는 받아 둔 수가 상한 아래로 내려가면 안 되므로 끝난 뒤에 줄임
+  return 1;
+}
+
+// key가 있는지 확인하는 함수
+int rbtree_cow_find(const rbtree_cow *t, const key_t key) {
+  for(const cow_node_t *p = t->root; p != NULL; p = (key < p->key) ? p->left : p->right)
+    if(p->key == key) return 1;
+  return 0;
+}
+
+// key 이상인 첫 key를 찾는 함수
+int rbtree_cow_lower_bound(const rbtree_cow *t, const key_t key, key_t *out) {
+  const cow_node_t *res = NULL;
+  for(const cow_node_t *p = t->root; p != NULL;)
+  {
+    if(p->key < key) p = p->right;
+    else // p가 후보이고 더 작은 후보는 왼쪽에 있음
+    {
+      res = p;
+      p = p->left;
+    }
+  }
+  if(res != NULL) *out = res->key;
+  return res != NULL;
+}
+
+// 최소 key를 읽는 함수
+int rbtree_cow_min(const rbtree_cow *t, key_t *out) {
+  const cow_node_t *p = t->root;
+  if(p == NULL) return 0;
+  while(p->left != NULL) p = p->left;
+  *out = p->key;
+  return 1;
+}
+
+// 최대 key를 읽는 함수
+int rbtree_cow_max(const rbtree_cow *t, key_t *out) {
+  const cow_node_t *p = t->root;
+  if(p == NULL) return 0;
+  while(p->right != NULL) p = p->right;
+  *out = p->key;
+  return 1;
+}
+
+// 전체 key 수를 구하는 함수
+size_t rbtree_cow_size(const rbtree_cow *t) {
+  return t->count;
+}
+
+// 버전을 배열로 변환하는 함수 (부모 포인터가 없으므로 stack으로 중위 순회)
+int rbtree_cow_to_array(const rbtree_cow *t, key_t *arr, const size_t n) {
+  const cow_node_t *stack[COW_MAX_DEPTH];
+  int top = 0;
+  size_t index = 0;
+  const cow_node_t *p = t->root;
+  while(p != NULL || top > 0)
+  {
+    while(p != NULL) // 왼쪽 끝까지 내려가며 쌓음
+    {
+      stack[top++] = p;
+      p = p->left;
+    }
+    p = stack[--top];
+    if(index >= n) return -1; // 배열의 크기를 초과하면 -1 반환
+    arr[index++] = p->key;
+    p = p->right;
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _RBTREE_COW_H_
+#define _RBTREE_COW_H_
+
+#include <stddef.h>
+
+#include "rbtree.h"
+
+// 경로 복사(path copying)로 버전을 남기는 persistent RB tree
+//
+// rbtree_snapshot은 root의 참조 수만 올리므로 O(1)이고, 이후 insert/erase는
+// 다른 버전과 함께 쓰는 노드를 고치지 않고 root에서 바뀌는 곳까지의 경로만
+// 복사함 (O(log n)개). 혼자 쓰는 노드는 그 자리에서 고침
+//
+// 노드는 부모 포인터 없이 자식만 가리키고 (여러 부모가 한 노드를 함께 가리킬 수
+// 있음) 가리키는 부모와 버전의 수를 refs에 셈. 마지막 참조가 사라지면 해제됨
+// 균형은 left-leaning RB tree(2-3 tree와 같은 모양)로 맞추므로 재귀로 내려가며
+// 회전/색 뒤집기만 하면 되고 부모를 따라 올라갈 필요가 없음
+//
+// 한 버전(rbtree_cow)은 한 thread만 고쳐야 하지만, 다른 버전은 다른 thread에서
+// lock 없이 읽고 delete_rbtree_cow로 놓을 수 있음 (refs는 atomic으로 바꿈)
+// 노드는 slab pool이 아니라 malloc으로 할당함 (어느 thread에서든 해제되므로)
+typedef struct cow_node_t {
+  unsigned refs;  // 이 노드를 가리키는 부모 노드와 버전의 수
+  color_t color;
+  key_t key;
+  struct cow_node_t *left, *right;  // 없으면 NULL
+} cow_node_t;
+
+typedef struct {
+  cow_node_t *root;
+  size_t count;  // 전체 key 수
+  cow_node_t *spare;  // 갱신 중에 할당이 실패하지 않도록 미리 받아 둔 노드 (right로 연결)
+  size_t spares;
+} rbtree_cow;
+
+rbtree_cow *new_rbtree_cow(void);
+rbtree_cow *rbtree_snapshot(const rbtree_cow *);  // 지금 내용의 새 버전 (O(1), 실패하면 NULL)
+void delete_rbtree_cow(rbtree_cow *);  // 버전을 놓음 (다른 버전이 쓰지 않는 노드만 해제)
+
+int rbtree_cow_insert(rbtree_cow *, const key_t);  // 성공하면 0, 할당 실패면 -1 (트리는 그대로)
+int rbtree_cow_erase(rbtree_cow *, const key_t);  // key 하나를 지웠으면 1, 없으면 0, 할당 실패면 -1
+int rbtree_cow_find(const rbtree_cow *, const key_t);  // 있으면 1, 없으면 0
+int rbtree_cow_lower_bound(const rbtree_cow *, const key_t, key_t *);  // key 이상인 첫 key가 있으면 1
+int rbtree_cow_min(const rbtree_cow *, key_t *);  // 비어 있지 않으면 1과 최소 key
+int rbtree_cow_max(const rbtree_cow *, key_t *);  // 비어 있지 않으면 1과 최대 key
+size_t rbtree_cow_size(const rbtree_cow *);
+int rbtree_cow_to_array(const rbtree_cow *, key_t *, const size_t);  // 배열이 작으면 -1
+
+#endif  // _RBTREE_COW_H_
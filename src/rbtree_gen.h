@@ -0,0 +1,157 @@
+#ifndef _RBTREE_GEN_H_
+#define _RBTREE_GEN_H_
+
+#include <stdlib.h>
+
+#include "rbtree.h"
+
+#ifdef RBTREE_COMPACT
+#error "RBTREE_DEFINE needs pointer-linked nodes; build without RBTREE_COMPACT"
+#endif
+
+// 타입별 key/value RB tree를 만드는 매크로 (BSD tree.h의 RB_GENERATE 방식)
+//
+//   RBTREE_DEFINE(name, KeyT, ValT, cmp)
+//
+// name, name_node 타입과 name_new, name_insert, name_find 등의 static inline
+// 함수를 만든다. cmp(a, b)는 a < b, a == b, a > b일 때 각각 음수, 0, 양수를
+// 반환하는 함수나 매크로이며, 호출하는 곳에 그대로 펼쳐져 inline 된다.
+//
+// 회전과 fixup은 rbtree.c의 rbtree_insert_node / rbtree_remove_node를 그대로
+// 쓰고, 여기서는 타입이 정해진 탐색만 만든다. name_node의 첫 멤버가 node_t
+// 이므로 rbtree_successor 등이 돌려준 node_t *를 그대로 변환해서 쓸 수 있다.
+// link.key는 비교에 쓰지 않지만 rbtree_insert_node가 읽을 수 있으므로
+// (RBTREE_INTERVAL이면 hi/max_hi를 채움) 새 노드마다 0으로 둔다.
+
+// 산술 타입 key에 쓸 수 있는 기본 비교
+#define RBTREE_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
+#define RBTREE_DEFINE(name, KeyT, ValT, cmp)                                  \
+  typedef struct name##_node {                                                \
+    node_t link; /* 반드시 첫 멤버 */                                         \
+    KeyT key;                                                                 \
+    ValT val;                                                                 \
+  } name##_node;                                                              \
+                                                                              \
+  typedef struct name {                                                       \
+    rbtree *tree;                                                             \
+  } name;                                                                     \
+                                                                              \
+  static inline name##_node *name##_node_of(const rbtree *t, node_t *p) {     \
+    return (p == NULL || p == t->nil) ? NULL : (name##_node *)p;              \
+  }                                                                           \
+                                                                              \
+  /* 노드마다 calloc/free 하는 트리 위에 만듦 (delete_rbtree가 free로 해제) */ \
+  static inline name *name##_new(void) {                                      \
+    name *m = (name *)malloc(sizeof(name));                                   \
+    if (m == NULL) return NULL;                                               \
+    m->tree = new_rbtree();                                                   \
+    if (m->tree == NULL) {                                                    \
+      free(m);                                                                \
+      return NULL;                                                            \
+    }                                                                         \
+    return m;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline void name##_delete(name *m) {                                 \
+    delete_rbtree(m->tree);                                                   \
+    free(m);                                                                  \
+  }                                                                           \
+                                                                              \
+  static inline size_t name##_size(const name *m) {                           \
+    return rbtree_size(m->tree);                                              \
+  }                                                                           \
+                                                                              \
+  /* 같은 key가 있어도 하나 더 추가 (multimap) */                             \
+  static inline name##_node *name##_insert(name *m, KeyT key, ValT val) {     \
+    rbtree *t = m->tree;                                                      \
+    node_t *y = t->nil;                                                       \
+    node_t *x = t->root;                                                      \
+    int left = 0;                                                             \
+    while (x != t->nil) {                                                     \
+      y = x;                                                                  \
+      left = cmp(key, ((name##_node *)x)->key) < 0;                           \
+      x = left ? x->left : x->right;                                          \
+    }                                                                         \
+    name##_node *z = (name##_node *)malloc(sizeof(name##_node));              \
+    if (z == NULL) return NULL;                                               \
+    z->link.key = 0;                                                          \
+    z->key = key;                                                             \
+    z->val = val;                                                             \
+    rbtree_insert_node(t, y, &z->link, left);                                 \
+    return z;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* 같은 key가 있으면 값만 바꾸고, 없으면 추가 (map) */                      \
+  static inline name##_node *name##_put(name *m, KeyT key, ValT val) {        \
+    rbtree *t = m->tree;                                                      \
+    node_t *y = t->nil;                                                       \
+    node_t *x = t->root;                                                      \
+    int c = 0;                                                                \
+    while (x != t->nil) {                                                     \
+      y = x;                                                                  \
+      c = cmp(key, ((name##_node *)x)->key);                                  \
+      if (c == 0) {                                                           \
+        ((name##_node *)x)->val = val;                                        \
+        return (name##_node *)x;                                              \
+      }                                                                       \
+      x = (c < 0) ? x->left : x->right;                                       \
+    }                                                                         \
+    name##_node *z = (name##_node *)malloc(sizeof(name##_node));              \
+    if (z == NULL) return NULL;                                               \
+    z->link.key = 0;                                                          \
+    z->key = key;                                                             \
+    z->val = val;                                                             \
+    rbtree_insert_node(t, y, &z->link, c < 0);                                \
+    return z;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline name##_node *name##_find(const name *m, KeyT key) {           \
+    const rbtree *t = m->tree;                                                \
+    node_t *x = t->root;                                                      \
+    while (x != t->nil) {                                                     \
+      int c = cmp(key, ((name##_node *)x)->key);                              \
+      if (c == 0) return (name##_node *)x;                                    \
+      x = (c < 0) ? x->left : x->right;                                       \
+    }                                                                         \
+    return NULL;                                                              \
+  }                                                                           \
+                                                                              \
+  /* key 이상인 첫 노드 */                                                    \
+  static inline name##_node *name##_lower_bound(const name *m, KeyT key) {    \
+    const rbtree *t = m->tree;                                                \
+    node_t *res = NULL;                                                       \
+    node_t *x = t->root;                                                      \
+    while (x != t->nil) {                                                     \
+      if (cmp(((name##_node *)x)->key, key) < 0) {                            \
+        x = x->right;                                                         \
+      } else {                                                                \
+        res = x;                                                              \
+        x = x->left;                                                          \
+      }                                                                       \
+    }                                                                         \
+    return (name##_node *)res;                                                \
+  }                                                                           \
+                                                                              \
+  static inline void name##_erase(name *m, name##_node *p) {                  \
+    rbtree_remove_node(m->tree, &p->link);                                    \
+    free(p);                                                                  \
+  }                                                                           \
+                                                                              \
+  static inline name##_node *name##_min(const name *m) {                      \
+    return name##_node_of(m->tree, rbtree_min(m->tree));                      \
+  }                                                                           \
+                                                                              \
+  static inline name##_node *name##_max(const name *m) {                      \
+    return name##_node_of(m->tree, rbtree_max(m->tree));                      \
+  }                                                                           \
+                                                                              \
+  static inline name##_node *name##_next(const name *m, name##_node *p) {     \
+    return name##_node_of(m->tree, rbtree_successor(m->tree, &p->link));      \
+  }                                                                           \
+                                                                              \
+  static inline name##_node *name##_prev(const name *m, name##_node *p) {     \
+    return name##_node_of(m->tree, rbtree_predecessor(m->tree, &p->link));    \
+  }
+
+#endif  // _RBTREE_GEN_H_
@@ -0,0 +1,237 @@
+#include "rbtree_sync.h"
+
+#include <stdlib.h>
+
+#define WALK_RETRY -1 // 읽는 도중 트리가 바뀌어 결과를 믿을 수 없음
+#define WALK_LOCKED -2 // tombstone에서 멈춤 (같은 key나 다음 노드를 찾아야 하므로 lock을 잡고 다시 읽음)
+#define WALK_MAX_DEPTH 128 // RB tree의 높이는 2log2(n+1)을 넘지 않으므로 이보다 깊으면 꼬인 경로
+#define OPTIMISTIC_TRIES 16 // 이만큼 실패하면 writer lock을 잡고 읽음
+
+// lock 없이 읽는 쪽의 필드 읽기
+// writer가 동시에 고치는 중일 수 있으므로 한 번씩만 읽고, 버전 검사 전까지는 결과를 쓰지 않음
+#ifdef RBTREE_COMPACT
+// 압축 노드는 인덱스를 저장소 주소로 바꿈 (0으로 채워진 칸은 nil을 가리킴)
+#define LOAD_LEFT(t, x) rbtree_left(t, x)
+#define LOAD_RIGHT(t, x) rbtree_right(t, x)
+#else
+#define LOAD_LEFT(t, x) __atomic_load_n(&(x)->left, __ATOMIC_RELAXED)
+#define LOAD_RIGHT(t, x) __atomic_load_n(&(x)->right, __ATOMIC_RELAXED)
+#endif
+#define LOAD_KEY(x) __atomic_load_n(&(x)->key, __ATOMIC_RELAXED)
+#if defined(RBTREE_TOMBSTONE) && defined(RBTREE_COUNTED)
+#define LOAD_DEAD(x) (__atomic_load_n(&(x)->count, __ATOMIC_RELAXED) == 0)
+#elif defined(RBTREE_TOMBSTONE)
+#define LOAD_DEAD(x) __atomic_load_n(&(x)->dead, __ATOMIC_RELAXED)
+#else
+#define LOAD_DEAD(x) 0
+#endif
+
+// thread 공유 트리를 생성하는 함수
+rbtree_sync *new_rbtree_sync(rbtree_sync_mode_t mode) {
+  rbtree_sync *s = (rbtree_sync *)calloc(1, sizeof(rbtree_sync));
+  if(s == NULL) return NULL;
+
+  // lock 없이 읽는 쪽이 삭제된 노드를 밟아도 안전하도록 노드 메모리를 트리가 끝까지 들고 있는 pool을 씀
+  s->tree = new_rbtree_pool(0);
+  if(s->tree == NULL)
+  {
+    free(s);
+    return NULL;
+  }
+  s->mode = mode;
+  pthread_rwlock_init(&s->rwlock, NULL);
+  pthread_mutex_init(&s->write_lock, NULL);
+  return s;
+}
+
+// 트리와 lock을 해제하는 함수 (다른 thread가 더 이상 쓰지 않을 때 호출)
+void delete_rbtree_sync(rbtree_sync *s) {
+  if(s == NULL) return;
+  pthread_rwlock_destroy(&s->rwlock);
+  pthread_mutex_destroy(&s->write_lock);
+  delete_rbtree(s->tree);
+  free(s);
+}
+
+// 쓰기 구간을 시작하는 함수 (optimistic 모드는 버전을 홀수로 만듦)
+static void write_begin(rbtree_sync *s) {
+  if(s->mode == RBTREE_SYNC_RWLOCK)
+  {
+    pthread_rwlock_wrlock(&s->rwlock);
+    return;
+  }
+  pthread_mutex_lock(&s->write_lock);
+  __atomic_store_n(&s->seq, __atomic_load_n(&s->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // 트리 수정이 홀수 버전보다 먼저 보이지 않게 함
+}
+
+// 쓰기 구간을 끝내는 함수 (optimistic 모드는 버전을 다시 짝수로 만듦)
+static void write_end(rbtree_sync *s) {
+  if(s->mode == RBTREE_SYNC_RWLOCK)
+  {
+    pthread_rwlock_unlock(&s->rwlock);
+    return;
+  }
+  __atomic_store_n(&s->seq, __atomic_load_n(&s->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&s->write_lock);
+}
+
+// key를 찾아 내려가는 함수 (찾으면 1, 없으면 0, 경로가 꼬였으면 WALK_RETRY, tombstone이면 WALK_LOCKED)
+static int walk_find(const rbtree *t, key_t key, key_t *out) {
+  node_t *nil = t->nil;
+  node_t *p = __atomic_load_n(&t->root, __ATOMIC_RELAXED);
+
+  for(int depth = 0; depth < WALK_MAX_DEPTH; depth++)
+  {
+    if(p == NULL) return WALK_RETRY; // 아직 초기화되지 않은 노드
+    if(p == nil) return 0;
+    key_t k = LOAD_KEY(p);
+    if(k == key)
+    {
+      if(LOAD_DEAD(p)) return WALK_LOCKED;
+      *out = k;
+      return 1;
+    }
+    node_t *l = LOAD_LEFT(t, p), *r = LOAD_RIGHT(t, p); // 두 자식을 먼저 읽어 두면 분기 대신 cmov로 고름
+    p = (key < k) ? l : r;
+  }
+  return WALK_RETRY;
+}
+
+// 왼쪽(최소) 또는 오른쪽(최대) 끝까지 내려가는 함수
+static int walk_edge(const rbtree *t, int left, key_t *out) {
+  node_t *nil = t->nil;
+  node_t *p = __atomic_load_n(&t->root, __ATOMIC_RELAXED);
+  if(p == NULL) return WALK_RETRY;
+  if(p == nil) return 0; // 빈 트리
+
+  for(int depth = 0; depth < WALK_MAX_DEPTH; depth++)
+  {
+    node_t *c = left ? LOAD_LEFT(t, p) : LOAD_RIGHT(t, p);
+    if(c == NULL) return WALK_RETRY;
+    if(c == nil)
+    {
+      if(LOAD_DEAD(p)) return WALK_LOCKED;
+      *out = LOAD_KEY(p);
+      return 1;
+    }
+    p = c;
+  }
+  return WALK_RETRY;
+}
+
+static int walk_min(const rbtree *t, key_t key, key_t *out) {
+  (void)key; // find와 같은 모양으로 부르려고 받기만 함
+  return walk_edge(t, 1, out);
+}
+
+static int walk_max(const rbtree *t, key_t key, key_t *out) {
+  (void)key;
+  return walk_edge(t, 0, out);
+}
+
+// walk가 WALK_LOCKED를 반환했을 때 lock을 잡은 채로 쓰는 함수들 (tombstone을 건너뛰는 공개 함수를 그대로 부름)
+static int exact_find(const rbtree *t, key_t key, key_t *out) {
+  node_t *p = rbtree_find(t, key);
+  if(p != NULL) *out = p->key;
+  return p != NULL;
+}
+
+static int exact_min(const rbtree *t, key_t key, key_t *out) {
+  (void)key;
+  node_t *p = rbtree_min(t);
+  if(p != t->nil) *out = p->key;
+  return p != t->nil;
+}
+
+static int exact_max(const rbtree *t, key_t key, key_t *out) {
+  (void)key;
+  node_t *p = rbtree_max(t);
+  if(p != t->nil) *out = p->key;
+  return p != t->nil;
+}
+
+// 모드에 맞게 lock을 잡거나 버전을 확인하면서 walk를 실행하는 함수
+// walk가 tombstone을 만나면 lock을 잡은 상태에서 exact로 다시 읽음
+static int sync_read(rbtree_sync *s, int (*walk)(const rbtree *, key_t, key_t *), int (*exact)(const rbtree *, key_t, key_t *), key_t key, key_t *out) {
+  key_t k = 0;
+  int r;
+
+  if(s->mode == RBTREE_SYNC_RWLOCK)
+  {
+    pthread_rwlock_rdlock(&s->rwlock);
+    r = walk(s->tree, key, &k);
+    if(r == WALK_LOCKED) r = exact(s->tree, key, &k);
+    pthread_rwlock_unlock(&s->rwlock);
+  }
+  else
+  {
+    for(int i = 0; i < OPTIMISTIC_TRIES; i++)
+    {
+      unsigned v = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+      if(v & 1) continue; // writer가 고치는 중
+      r = walk(s->tree, key, &k);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE); // 트리 읽기가 버전 재확인보다 먼저 끝나게 함
+      if(r == WALK_LOCKED) break; // 버전과 상관없이 lock을 잡고 다시 읽음
+      if(r != WALK_RETRY && __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == v) goto done; // 그동안 바뀐 것이 없음
+    }
+    pthread_mutex_lock(&s->write_lock); // writer가 계속 겹치면 lock을 잡고 읽음
+    r = walk(s->tree, key, &k);
+    if(r == WALK_LOCKED) r = exact(s->tree, key, &k);
+    pthread_mutex_unlock(&s->write_lock);
+  }
+
+done:
+  if(r == 1 && out != NULL) *out = k;
+  return r;
+}
+
+// key를 추가하는 함수
+int rbtree_sync_insert(rbtree_sync *s, const key_t key) {
+  write_begin(s);
+  node_t *p = rbtree_insert(s->tree, key);
+  write_end(s);
+  return p == NULL ? -1 : 0;
+}
+
+// key 하나를 지우는 함수
+int rbtree_sync_erase(rbtree_sync *s, const key_t key) {
+  write_begin(s);
+  node_t *p = rbtree_find(s->tree, key);
+  if(p != NULL) rbtree_erase(s->tree, p);
+  write_end(s);
+  return p != NULL;
+}
+
+// key가 있는지 확인하는 함수
+int rbtree_sync_find(rbtree_sync *s, const key_t key) {
+  return sync_read(s, walk_find, exact_find, key, NULL);
+}
+
+// 최소 key를 읽는 함수
+int rbtree_sync_min(rbtree_sync *s, key_t *out) {
+  return sync_read(s, walk_min, exact_min, 0, out);
+}
+
+// 최대 key를 읽는 함수
+int rbtree_sync_max(rbtree_sync *s, key_t *out) {
+  return sync_read(s, walk_max, exact_max, 0, out);
+}
+
+// tombstone 비율이 max_ratio를 넘으면 정리하는 함수 (rbtree_compact를 write lock 안에서 부름)
+size_t rbtree_sync_compact(rbtree_sync *s, double max_ratio) {
+  write_begin(s);
+  size_t n = rbtree_compact(s->tree, max_ratio);
+  write_end(s);
+  return n;
+}
+
+// 전체 key 수를 읽는 함수
+size_t rbtree_sync_size(rbtree_sync *s) {
+  if(s->mode == RBTREE_SYNC_OPTIMISTIC) return __atomic_load_n(&s->tree->count, __ATOMIC_RELAXED);
+
+  pthread_rwlock_rdlock(&s->rwlock);
+  size_t n = s->tree->count;
+  pthread_rwlock_unlock(&s->rwlock);
+  return n;
+}
@@ -0,0 +1,36 @@
+#ifndef _RBTREE_SYNC_H_
+#define _RBTREE_SYNC_H_
+
+#include <pthread.h>
+
+#include "rbtree.h"
+
+// 여러 thread가 함께 쓰는 RB tree 핸들
+//
+// RBTREE_SYNC_RWLOCK: 읽기(find/min/max)는 read lock을 함께 잡고, 쓰기는 write lock
+// RBTREE_SYNC_OPTIMISTIC: 쓰기는 mutex와 seqlock 버전을 올리고, 읽기는 lock 없이
+//   트리를 내려간 뒤 버전이 바뀌었으면(회전이 겹쳤으면) 다시 읽음
+//
+// 읽는 동안 노드가 삭제될 수 있으므로 node_t *가 아니라 key 값과 결과만 돌려줌
+typedef enum { RBTREE_SYNC_RWLOCK, RBTREE_SYNC_OPTIMISTIC } rbtree_sync_mode_t;
+
+typedef struct {
+  rbtree *tree;  // 항상 new_rbtree_pool로 만든 트리 (노드 메모리가 delete 전까지 해제되지 않음)
+  rbtree_sync_mode_t mode;
+  pthread_rwlock_t rwlock;  // RBTREE_SYNC_RWLOCK
+  pthread_mutex_t write_lock;  // RBTREE_SYNC_OPTIMISTIC의 writer 사이 lock
+  unsigned seq;  // RBTREE_SYNC_OPTIMISTIC의 버전 (홀수면 쓰는 중)
+} rbtree_sync;
+
+rbtree_sync *new_rbtree_sync(rbtree_sync_mode_t);
+void delete_rbtree_sync(rbtree_sync *);
+
+int rbtree_sync_insert(rbtree_sync *, const key_t);  // 성공하면 0, 할당 실패면 -1
+int rbtree_sync_erase(rbtree_sync *, const key_t);  // key 하나를 지웠으면 1, 없으면 0
+int rbtree_sync_find(rbtree_sync *, const key_t);  // 있으면 1, 없으면 0
+int rbtree_sync_min(rbtree_sync *, key_t *);  // 비어 있지 않으면 1과 최소 key
+int rbtree_sync_max(rbtree_sync *, key_t *);  // 비어 있지 않으면 1과 최대 key
+size_t rbtree_sync_size(rbtree_sync *);
+size_t rbtree_sync_compact(rbtree_sync *, double);  // RBTREE_TOMBSTONE이 아니면 항상 0
+
+#endif  // _RBTREE_SYNC_H_
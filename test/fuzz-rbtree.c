@@ -0,0 +1,699 @@
+#include <assert.h>
+#include <rbtree.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Differential fuzzer: every operation is applied to the tree and to a plain
+// sorted array holding the same multiset, and the answers must agree. Every
+// check_every operations (and at the end) the whole tree is checked against
+// the red-black invariants and the array.
+//
+// The same interpreter runs in three ways:
+//   - libFuzzer: build with -DRBTREE_LIBFUZZER -fsanitize=fuzzer; each input
+//     is read as 3-byte ops (op, key, arg) over a small key range so that
+//     duplicates and splits at existing keys are common.
+//   - AFL or replay: `fuzz-rbtree FILE...` runs each file the same way
+//     (`afl-fuzz -i in -o out -- ./fuzz-rbtree @@`); no arguments reads stdin.
+//   - random: `fuzz-rbtree --random SEED OPS [CHECK_EVERY] [KEYS]` generates
+//     the ops itself over a larger key range, then prints the tree time per
+//     op kind as CSV so a slow path shows up next to a wrong one.
+//
+// The set operations run against a second tree built from a second sorted
+// array, and snapshots, saved files and loaded trees are compared with the
+// array the same way. Build with -DRBTREE_TOMBSTONE, -DRBTREE_COUNTED or
+// -DRBTREE_INTERVAL to fuzz those layouts (compact and interval ops only do
+// something there).
+
+#define FUZZ_MAX_OPS 4096     // longer inputs are cut (keeps libFuzzer fast)
+#define FUZZ_CHECK_EVERY 16   // invariant check interval for file inputs
+#define FUZZ_RANGE_OUT 64     // most keys one range/iterate op compares
+
+// number of keys a node stands for (tombstones are skipped by the iterators)
+#ifdef RBTREE_COUNTED
+#define COPIES(p) ((p)->count)
+#else
+#define COPIES(p) 1
+#endif
+
+enum {
+  OP_INSERT,
+  OP_INSERT_HINT,
+  OP_ERASE,
+  OP_FIND,
+  OP_BOUNDS,
+  OP_MINMAX,
+  OP_ERASE_RANGE,
+  OP_ERASE_BATCH,
+  OP_RANK,
+  OP_RANGE,
+  OP_ITER,
+  OP_SPLIT_JOIN,
+  OP_CLEAR,
+  OP_POP,
+  OP_UNION,
+  OP_INTERSECTION,
+  OP_DIFFERENCE,
+  OP_UNION_PARALLEL,
+  OP_COMPACT,
+  OP_FREEZE,
+  OP_SAVE_LOAD,
+  OP_TO_ARRAY,
+  OP_EQUAL_RANGE,
+  OP_FOREACH,
+  OP_CURSOR,
+  OP_INTERVAL,
+  OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+    "insert",      "insert_hint", "erase", "find",   "bounds",
+    "minmax",      "erase_range", "erase_batch", "rank", "range",
+    "iter",        "split_join",  "clear",       "pop",  "union",
+    "intersection", "difference", "union_parallel", "compact", "freeze",
+    "save_load",   "to_array",    "equal_range", "foreach", "cursor",
+    "interval"};
+
+typedef struct {
+  int op;
+  key_t key;
+  unsigned arg;
+} fuzz_op;
+
+typedef struct {
+  rbtree *t;
+  key_t *model;  // sorted, with duplicates
+  size_t n, cap;
+  size_t check_every, done;
+  size_t calls[OP_COUNT];
+  double ns[OP_COUNT];  // time spent in tree calls only
+} fuzz_state;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// index of the first model key >= key (> key when strict)
+static size_t model_bound(const fuzz_state *s, const key_t key,
+                          const int strict) {
+  size_t lo = 0, hi = s->n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (s->model[mid] < key || (strict && s->model[mid] == key)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void model_insert(fuzz_state *s, const key_t key) {
+  if (s->n == s->cap) {
+    s->cap = s->cap ? 2 * s->cap : 64;
+    s->model = realloc(s->model, s->cap * sizeof(key_t));
+    assert(s->model != NULL);
+  }
+  size_t i = model_bound(s, key, 1);
+  memmove(s->model + i + 1, s->model + i, (s->n - i) * sizeof(key_t));
+  s->model[i] = key;
+  s->n++;
+}
+
+// removes one copy of key; 0 if there was none
+static int model_erase(fuzz_state *s, const key_t key) {
+  size_t i = model_bound(s, key, 0);
+  if (i == s->n || s->model[i] != key) {
+    return 0;
+  }
+  memmove(s->model + i, s->model + i + 1, (s->n - i - 1) * sizeof(key_t));
+  s->n--;
+  return 1;
+}
+
+// removes [lo, hi) and returns how many keys went
+static size_t model_erase_range(fuzz_state *s, const key_t lo,
+                                const key_t hi) {
+  if (!(lo < hi) || s->n == 0) {
+    return 0;
+  }
+  size_t a = model_bound(s, lo, 0), b = model_bound(s, hi, 0);
+  memmove(s->model + a, s->model + b, (s->n - b) * sizeof(key_t));
+  s->n -= b - a;
+  return b - a;
+}
+
+// black height of p, checking key order, red-red links and equal black
+// height on every path
+static int check_node(const rbtree *t, const node_t *p, const node_t *lo,
+                      const node_t *hi) {
+  if (p == t->nil) {
+    return 0;
+  }
+  assert(lo == NULL || lo->key <= p->key);
+  assert(hi == NULL || p->key <= hi->key);
+  const node_t *l = rbtree_left(t, p), *r = rbtree_right(t, p);
+  assert(l == t->nil || rbtree_parent(t, l) == p);
+  assert(r == t->nil || rbtree_parent(t, r) == p);
+  if (rbtree_color(p) == RBTREE_RED) {
+    assert(l == t->nil || rbtree_color(l) == RBTREE_BLACK);
+    assert(r == t->nil || rbtree_color(r) == RBTREE_BLACK);
+  }
+#ifdef RBTREE_INTERVAL
+  key_t max_hi = p->hi;
+  if (l != t->nil && l->max_hi > max_hi) {
+    max_hi = l->max_hi;
+  }
+  if (r != t->nil && r->max_hi > max_hi) {
+    max_hi = r->max_hi;
+  }
+  assert(p->max_hi == max_hi);
+#endif
+  int lh = check_node(t, l, lo, p);
+  int rh = check_node(t, r, p, hi);
+  assert(lh == rh);
+  return lh + (rbtree_color(p) == RBTREE_BLACK);
+}
+
+// t should be a valid red-black tree holding exactly model[0, n)
+static void check_tree(const rbtree *t, const key_t *model, const size_t n) {
+  assert(t->root == t->nil || rbtree_color(t->root) == RBTREE_BLACK);
+  check_node(t, t->root, NULL, NULL);
+  assert(rbtree_size(t) == n);
+  key_t *got = malloc((n + 1) * sizeof(key_t));
+  assert(rbtree_to_array(t, got, n) == 0);
+  assert(n == 0 || memcmp(got, model, n * sizeof(key_t)) == 0);
+  free(got);
+
+  // the cached ends are always the leftmost and rightmost nodes (nil if empty)
+  const node_t *l = t->root, *r = t->root;
+  while (l != t->nil && rbtree_left(t, l) != t->nil) {
+    l = rbtree_left(t, l);
+  }
+  while (r != t->nil && rbtree_right(t, r) != t->nil) {
+    r = rbtree_right(t, r);
+  }
+  assert(t->min == l);
+  assert(t->max == r);
+}
+
+static void check_all(const fuzz_state *s) {
+  check_tree(s->t, s->model, s->n);
+}
+
+// a snapshot (frozen or opened from a file) should hold exactly the model,
+// and answer key and [key, hi) like it
+static void check_frozen(const fuzz_state *s, const rbtree_frozen *f,
+                         const key_t key, const key_t hi) {
+  assert(f != NULL && f->n == s->n);
+  key_t *all = malloc((s->n + 1) * sizeof(key_t)), got;
+  if (s->n > 0) {
+    assert(rbtree_frozen_range(f, s->model[0], s->model[s->n - 1] + 1, all,
+                               s->n) == s->n);
+    assert(memcmp(all, s->model, s->n * sizeof(key_t)) == 0);
+  }
+  size_t i = model_bound(s, key, 0);
+  assert(rbtree_frozen_find(f, key) == (i < s->n && s->model[i] == key));
+  assert(rbtree_frozen_lower_bound(f, key, &got) == (i < s->n));
+  assert(i == s->n || got == s->model[i]);
+  size_t m = rbtree_frozen_range(f, key, hi, all, FUZZ_RANGE_OUT);
+  assert(m == model_bound(s, hi, 0) - i || m == FUZZ_RANGE_OUT);
+  assert(m == 0 || memcmp(all, s->model + i, m * sizeof(key_t)) == 0);
+  free(all);
+}
+
+static int key_cmp(const void *a, const void *b) {
+  const key_t x = *(const key_t *)a, y = *(const key_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int has_key(const key_t *keys, const size_t n, const key_t key) {
+  return bsearch(&key, keys, n, sizeof(key_t), key_cmp) != NULL;
+}
+
+// keys of the second tree for a set op, sorted: up to 15 from key on, most
+// of them twice, plus for intersection every model key outside [key, hi) so
+// that the tree does not collapse to a handful of keys
+static key_t *other_keys(const fuzz_state *s, const fuzz_op *o,
+                         const key_t hi, size_t *m) {
+  const size_t own = o->arg % 16, step = 1 + (o->arg >> 4) % 4;
+  key_t *keys = malloc((own + s->n + 1) * sizeof(key_t));
+  *m = 0;
+  for (size_t j = 0; j < own; j++) {
+    keys[(*m)++] = o->key + (key_t)(j * step / 2);
+  }
+  for (size_t i = 0; o->op == OP_INTERSECTION && i < s->n; i++) {
+    if (s->model[i] < o->key || s->model[i] >= hi) {
+      keys[(*m)++] = s->model[i];
+    }
+  }
+  qsort(keys, *m, sizeof(key_t), key_cmp);
+  return keys;
+}
+
+// range_foreach visitor: each node must be the next model key
+typedef struct {
+  const fuzz_state *s;
+  size_t i;  // model index of the next key
+  size_t calls, stop;
+} visit_ctx;
+
+static int visit(node_t *p, void *arg) {
+  visit_ctx *v = arg;
+  assert(v->i < v->s->n && p->key == v->s->model[v->i]);
+  v->i += COPIES(p);
+  return ++v->calls == v->stop;
+}
+
+#ifdef RBTREE_INTERVAL
+// interval_overlap visitor: each node must overlap [lo, hi], in key order
+typedef struct {
+  key_t lo, hi, last;
+  size_t calls;
+} overlap_ctx;
+
+static int overlap_visit(node_t *p, void *arg) {
+  overlap_ctx *v = arg;
+  assert(p->key <= v->hi && v->lo <= p->hi);
+  assert(v->calls == 0 || v->last <= p->key);
+  v->last = p->key;
+  v->calls++;
+  return 0;
+}
+#endif
+
+static void run_op(fuzz_state *s, const fuzz_op *o) {
+  rbtree *t = s->t;
+  const key_t key = o->key;
+  const key_t hi = key + (key_t)(o->arg % 32);
+  node_t *p, *q;
+  size_t i, got;
+  key_t buf[FUZZ_RANGE_OUT];
+  double start = now_ns();
+
+  switch (o->op) {
+    case OP_INSERT:
+      p = rbtree_insert(t, key);
+      s->ns[o->op] += now_ns() - start;
+      assert(p != NULL && p->key == key);
+      model_insert(s, key);
+      break;
+    case OP_INSERT_HINT:  // hint at the neighbour arg says, or none
+      q = (o->arg & 1) ? rbtree_lower_bound(t, key) : rbtree_max(t);
+      p = rbtree_insert_hint(t, (q == t->nil) ? NULL : q, key);
+      s->ns[o->op] += now_ns() - start;
+      assert(p != NULL && p->key == key);
+      model_insert(s, key);
+      break;
+    case OP_ERASE:
+      p = rbtree_find(t, key);
+      if (p != NULL) {
+        rbtree_erase(t, p);
+      }
+      s->ns[o->op] += now_ns() - start;
+      assert((p != NULL) == model_erase(s, key));
+      break;
+    case OP_FIND:  // plain, from a finger, and batched
+      p = rbtree_find(t, key);
+      q = rbtree_find_near(t, rbtree_lower_bound(t, hi), key);
+      i = rbtree_find_batch(t, &key, 1, &p);
+      s->ns[o->op] += now_ns() - start;
+      i = model_bound(s, key, 0);
+      got = (i < s->n && s->model[i] == key);
+      assert((p != NULL) == got && (q != NULL) == got);
+      assert(p == NULL || (p->key == key && q->key == key));
+      break;
+    case OP_BOUNDS:
+      p = rbtree_lower_bound(t, key);
+      q = rbtree_upper_bound(t, key);
+      s->ns[o->op] += now_ns() - start;
+      i = model_bound(s, key, 0);
+      assert(i == s->n ? p == NULL : (p != NULL && p->key == s->model[i]));
+      i = model_bound(s, key, 1);
+      assert(i == s->n ? q == NULL : (q != NULL && q->key == s->model[i]));
+      break;
+    case OP_MINMAX:  // and erase one end, like a priority queue
+      p = rbtree_min(t);
+      q = rbtree_max(t);
+      assert((p == t->nil) == (s->n == 0) && (q == t->nil) == (s->n == 0));
+      if (s->n > 0) {
+        assert(p->key == s->model[0] && q->key == s->model[s->n - 1]);
+        rbtree_erase(t, (o->arg & 1) ? q : p);
+        s->ns[o->op] += now_ns() - start;
+        model_erase(s, (o->arg & 1) ? s->model[s->n - 1] : s->model[0]);
+      }
+      break;
+    case OP_ERASE_RANGE:
+      got = rbtree_erase_range(t, key, hi);
+      s->ns[o->op] += now_ns() - start;
+      assert(got == model_erase_range(s, key, hi));
+      break;
+    case OP_ERASE_BATCH: {  // up to 4 distinct keys from key on
+      node_t *nodes[4];
+      key_t keys[4];
+      size_t m = 0;
+      for (key_t k = key; k < key + 4; k++) {
+        if ((p = rbtree_find(t, k)) != NULL) {
+          nodes[m] = p;
+          keys[m++] = k;
+        }
+      }
+      assert(rbtree_erase_batch(t, nodes, m) == m);
+      s->ns[o->op] += now_ns() - start;
+      for (i = 0; i < m; i++) {
+        assert(model_erase(s, keys[i]));
+      }
+      break;
+    }
+    case OP_RANK:
+      got = rbtree_rank(t, key);
+      p = rbtree_select(t, s->n ? o->arg % s->n : 0);
+      i = rbtree_count_range(t, key, hi);
+      s->ns[o->op] += now_ns() - start;
+      assert(got == model_bound(s, key, 0));
+      assert(s->n == 0 ? p == NULL : p->key == s->model[o->arg % s->n]);
+      assert(i == model_bound(s, hi, 0) - model_bound(s, key, 0));
+      break;
+    case OP_RANGE:
+      got = rbtree_range(t, key, hi, buf, FUZZ_RANGE_OUT);
+      s->ns[o->op] += now_ns() - start;
+      i = model_bound(s, key, 0);
+      assert(got <= FUZZ_RANGE_OUT);
+      for (size_t j = 0; j < got; j++) {
+        assert(i + j < s->n && buf[j] == s->model[i + j] && buf[j] < hi);
+      }
+      assert(got == FUZZ_RANGE_OUT || i + got == s->n ||
+             s->model[i + got] >= hi);
+      break;
+    case OP_ITER:  // forward from the lower bound, backward from the max
+      i = model_bound(s, key, 0);
+      p = rbtree_lower_bound(t, key);
+      for (got = 0; got < FUZZ_RANGE_OUT && i + got < s->n;) {
+        assert(p != NULL && p->key == s->model[i + got]);
+        got += COPIES(p);
+        p = rbtree_successor(t, p);
+      }
+      assert(i + got < s->n || p == NULL);
+      p = rbtree_max(t);
+      for (got = 0; got < FUZZ_RANGE_OUT && got < s->n;) {
+        assert(p != NULL && p != t->nil);
+        assert(p->key == s->model[s->n - 1 - got]);
+        got += COPIES(p);
+        p = rbtree_predecessor(t, p);
+      }
+      assert(got < s->n || p == NULL || s->n == 0);
+      s->ns[o->op] += now_ns() - start;
+      break;
+    case OP_SPLIT_JOIN: {  // split at key, then join back with key between
+      rbtree *u = rbtree_split(t, key);
+      assert(u != NULL);
+      assert(rbtree_size(t) == model_bound(s, key, 0));
+      assert(rbtree_join(t, key, u) == t);
+      s->ns[o->op] += now_ns() - start;
+      model_insert(s, key);
+      break;
+    }
+    case OP_CLEAR:  // rare, or a long input would rarely grow the tree
+      if (o->arg != 0) {
+        return;
+      }
+      rbtree_clear(t);
+      s->ns[o->op] += now_ns() - start;
+      s->n = 0;
+      break;
+    case OP_POP:  // the low end, or the high end if arg is odd
+      got = (o->arg & 1) ? rbtree_pop_max(t, buf) : rbtree_pop_min(t, buf);
+      s->ns[o->op] += now_ns() - start;
+      assert(got == (s->n > 0));
+      if (got) {
+        assert(buf[0] == ((o->arg & 1) ? s->model[s->n - 1] : s->model[0]));
+        model_erase(s, buf[0]);
+      }
+      break;
+    case OP_UNION:  // with a second tree; the result is checked right away
+    case OP_INTERSECTION:
+    case OP_DIFFERENCE:
+    case OP_UNION_PARALLEL: {
+      size_t m, j = 0;
+      key_t *other = other_keys(s, o, hi, &m);
+      rbtree *u, *r;
+      if (o->arg & 0x80) {  // unsorted input, so from_array sorts it
+        key_t *rev = malloc((m + 1) * sizeof(key_t));
+        for (i = 0; i < m; i++) {
+          rev[i] = other[m - 1 - i];
+        }
+        u = rbtree_from_array(rev, m);
+        free(rev);
+      } else {
+        u = rbtree_from_sorted(other, m);
+      }
+      assert(u != NULL);
+      check_tree(u, other, m);
+      start = now_ns();
+      if (o->op == OP_UNION) {
+        r = rbtree_union(t, u);
+      } else if (o->op == OP_INTERSECTION) {
+        r = rbtree_intersection(t, u);
+      } else if (o->op == OP_DIFFERENCE) {
+        r = rbtree_difference(t, u);
+      } else {
+        r = rbtree_union_parallel(t, u, 1 + (int)(o->arg >> 5) % 4);
+      }
+      s->ns[o->op] += now_ns() - start;
+      assert(r == t);
+      if (o->op == OP_UNION || o->op == OP_UNION_PARALLEL) {
+        for (i = 0; i < m; i++) {
+          model_insert(s, other[i]);
+        }
+      } else {  // keep the model keys that are (or are not) in other
+        for (i = 0; i < s->n; i++) {
+          if (has_key(other, m, s->model[i]) == (o->op == OP_INTERSECTION)) {
+            s->model[j++] = s->model[i];
+          }
+        }
+        s->n = j;
+      }
+      free(other);
+      check_all(s);
+      break;
+    }
+    case OP_COMPACT: {  // drops every tombstone once they pass the ratio
+#ifdef RBTREE_TOMBSTONE
+      const size_t dead = t->tombstones;
+#else
+      const size_t dead = 0;
+#endif
+      got = rbtree_compact(t, (o->arg % 4) / 4.0);
+      s->ns[o->op] += now_ns() - start;
+      assert(got == 0 || got == dead);
+#ifdef RBTREE_TOMBSTONE
+      assert(t->tombstones == dead - got);
+#endif
+      check_all(s);
+      break;
+    }
+    case OP_FREEZE: {
+      rbtree_frozen *f = rbtree_freeze(t);
+      s->ns[o->op] += now_ns() - start;
+      check_frozen(s, f, key, hi);
+      delete_rbtree_frozen(f);
+      break;
+    }
+    case OP_SAVE_LOAD: {  // rare, since every save fsyncs
+      if (o->arg % 8 != 0) {
+        return;
+      }
+      char path[64];
+      snprintf(path, sizeof(path), "/tmp/fuzz-rbtree-%d.bin", (int)getpid());
+      assert(rbtree_save(t, path) == 0);
+      rbtree *u = rbtree_load(path);
+      rbtree_frozen *f = rbtree_frozen_open(path);
+      s->ns[o->op] += now_ns() - start;
+      assert(u != NULL);
+      check_tree(u, s->model, s->n);
+      check_frozen(s, f, key, hi);
+      delete_rbtree(u);
+      delete_rbtree_frozen(f);
+      remove(path);
+      break;
+    }
+    case OP_TO_ARRAY: {
+      key_t *arr = malloc((s->n + 1) * sizeof(key_t));
+      got = rbtree_to_array_parallel(t, arr, s->n, 1 + (int)(o->arg % 8));
+      s->ns[o->op] += now_ns() - start;
+      assert(got == 0);
+      assert(s->n == 0 || memcmp(arr, s->model, s->n * sizeof(key_t)) == 0);
+      free(arr);
+      break;
+    }
+    case OP_EQUAL_RANGE:
+      rbtree_equal_range(t, key, &p, &q);
+      s->ns[o->op] += now_ns() - start;
+      i = model_bound(s, key, 1) - model_bound(s, key, 0);
+      assert((p == NULL) == (i == 0));
+      assert(i == 0 ? q == NULL : q == rbtree_upper_bound(t, key));
+      for (got = 0; p != q; p = rbtree_successor(t, p)) {
+        assert(p != NULL && p->key == key);
+        got += COPIES(p);
+      }
+      assert(got == i);
+      break;
+    case OP_FOREACH: {  // stops after arg calls, or at hi
+      visit_ctx v = {s, model_bound(s, key, 0), 0, 1 + o->arg % FUZZ_RANGE_OUT};
+      got = rbtree_range_foreach(t, key, hi, visit, &v);
+      s->ns[o->op] += now_ns() - start;
+      assert(got == v.calls);
+      assert(v.calls == v.stop || v.i == model_bound(s, hi, 0));
+      break;
+    }
+    case OP_CURSOR: {  // rbtree_iter from each end
+      rbtree_iter it;
+      p = rbtree_iter_begin(&it, t);
+      for (got = 0; got < FUZZ_RANGE_OUT && got < s->n;) {
+        assert(p != NULL && p->key == s->model[got]);
+        got += COPIES(p);
+        p = rbtree_iter_next(&it);
+      }
+      assert(got < s->n || p == NULL);
+      p = rbtree_iter_rbegin(&it, t);
+      for (got = 0; got < FUZZ_RANGE_OUT && got < s->n;) {
+        assert(p != NULL && p->key == s->model[s->n - 1 - got]);
+        got += COPIES(p);
+        p = rbtree_iter_prev(&it);
+      }
+      assert(got < s->n || p == NULL);
+      s->ns[o->op] += now_ns() - start;
+      break;
+    }
+    case OP_INTERVAL: {  // one wide interval among the points, then erase it
+#ifdef RBTREE_INTERVAL
+      const key_t lo = key + (key_t)((o->arg >> 2) % 8) - 4;
+      overlap_ctx v = {lo, lo + (key_t)((o->arg >> 5) % 4), 0, 0};
+      p = rbtree_interval_insert(t, key, hi);
+      assert(p != NULL && p->key == key && p->hi == hi);
+      model_insert(s, key);
+      got = rbtree_interval_overlap(t, v.lo, v.hi, overlap_visit, &v);
+      s->ns[o->op] += now_ns() - start;
+      assert(got == v.calls);
+      i = model_bound(s, v.hi, 1) - model_bound(s, v.lo, 0);
+      assert(got == i + (key < v.lo && v.lo <= hi));
+      check_all(s);
+      rbtree_erase(t, p);
+      model_erase(s, key);
+      check_all(s);
+      break;
+#else
+      return;
+#endif
+    }
+  }
+  s->calls[o->op]++;
+  if (++s->done % s->check_every == 0) {
+    check_all(s);
+  }
+}
+
+static void fuzz_init(fuzz_state *s, const size_t check_every) {
+  memset(s, 0, sizeof(*s));
+  s->t = new_rbtree();
+  assert(s->t != NULL);
+  s->check_every = check_every;
+}
+
+static void fuzz_done(fuzz_state *s) {
+  check_all(s);
+  delete_rbtree(s->t);
+  free(s->model);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  fuzz_state s;
+  fuzz_init(&s, FUZZ_CHECK_EVERY);
+  for (size_t i = 0; i + 3 <= size && i / 3 < FUZZ_MAX_OPS; i += 3) {
+    fuzz_op o = {data[i] % OP_COUNT, (key_t)(int8_t)data[i + 1], data[i + 2]};
+    run_op(&s, &o);
+  }
+  fuzz_done(&s);
+  return 0;
+}
+
+#ifndef RBTREE_LIBFUZZER
+// runs the whole stream from fp as one input
+static void run_file(FILE *fp) {
+  size_t cap = 4096, n = 0, got;
+  uint8_t *data = malloc(cap);
+  while ((got = fread(data + n, 1, cap - n, fp)) > 0) {
+    n += got;
+    if (n == cap) {
+      data = realloc(data, cap *= 2);
+    }
+  }
+  LLVMFuzzerTestOneInput(data, n);
+  free(data);
+}
+
+// random ops over [0, keys); inserts outnumber erases until the tree holds
+// about keys / 2 keys, after which they balance out
+static void run_random(const unsigned int seed, const size_t ops,
+                       const size_t check_every, const size_t keys) {
+  // relative weights of each op kind
+  static const unsigned weight[OP_COUNT] = {30, 10, 25, 10, 5, 3, 1, 2, 2,
+                                            2,  1,  1,  1,  3, 1, 1, 1, 1,
+                                            1,  1,  1,  1,  2, 2, 1, 2};
+  unsigned total = 0;
+  for (int k = 0; k < OP_COUNT; k++) {
+    total += weight[k];
+  }
+  fuzz_state s;
+  fuzz_init(&s, check_every);
+  srand(seed);
+  for (size_t i = 0; i < ops; i++) {
+    unsigned w = rand() % total;
+    fuzz_op o = {0, (key_t)(rand() % keys), rand() & 0xff};
+    while (w >= weight[o.op]) {
+      w -= weight[o.op++];
+    }
+    if (o.op == OP_INSERT && s.n > keys / 2 && rand() % 2) {
+      o.op = OP_ERASE;  // keep the tree near its target size
+    }
+    if (o.op == OP_CLEAR) {
+      o.arg = (rand() % 64 == 0) ? 0 : 1;
+    }
+    run_op(&s, &o);
+  }
+
+  printf("op,calls,ns_per_op\n");
+  for (int k = 0; k < OP_COUNT; k++) {
+    printf("%s,%zu,%.1f\n", op_names[k], s.calls[k],
+           s.calls[k] ? s.ns[k] / s.calls[k] : 0.0);
+  }
+  fuzz_done(&s);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 4 && strcmp(argv[1], "--random") == 0) {
+    run_random((unsigned)atoi(argv[2]), (size_t)atol(argv[3]),
+               argc > 4 ? (size_t)atol(argv[4]) : 1000,
+               argc > 5 ? (size_t)atol(argv[5]) : 1 << 16);
+  } else if (argc == 1) {
+    run_file(stdin);
+  } else {
+    for (int i = 1; i < argc; i++) {
+      FILE *fp = fopen(argv[i], "rb");
+      if (fp == NULL) {
+        perror(argv[i]);
+        return 1;
+      }
+      run_file(fp);
+      fclose(fp);
+    }
+  }
+  printf("Passed all tests!\n");
+  return 0;
+}
+#endif
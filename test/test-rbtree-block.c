@@ -0,0 +1,174 @@
+#include <assert.h>
+#include <limits.h>
+#include <rbtree_block.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tests for the block ("fat node") tree: every block must stay sorted, padded
+// and within its size limits, blocks must follow each other in key order,
+// the block tree must stay a valid red-black tree, and the keys must match a
+// plain sorted array through inserts, erases, splits and merges.
+
+static int comp(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  return (*e1 > *e2) - (*e1 < *e2);
+}
+
+// black height below p, checking red-red links and equal black heights
+static int check_color(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    return 0;
+  }
+  if (p->color == RBTREE_RED) {
+    assert(p->left->color == RBTREE_BLACK && p->right->color == RBTREE_BLACK);
+  }
+  int l = check_color(t, p->left);
+  int r = check_color(t, p->right);
+  assert(l == r);
+  return l + (p->color == RBTREE_BLACK);
+}
+
+// the tree should hold exactly sorted[0..n) in valid blocks
+static void check_blocks(const rbtree_block *bt, const key_t *sorted,
+                         const size_t n) {
+  const rbtree *t = bt->tree;
+  assert(rbtree_block_size(bt) == n);
+  assert(t->root == t->nil || t->root->color == RBTREE_BLACK);
+  check_color(t, t->root);
+
+  rbtree_iter it;
+  size_t seen = 0, blocks = 0;
+  for (node_t *x = rbtree_iter_begin(&it, t); x != NULL;
+       x = rbtree_iter_next(&it)) {
+    const rbtree_block_node *b = (const rbtree_block_node *)x;
+    assert(b->n >= 1 && b->n <= RBTREE_BLOCK_KEYS);
+    assert(b->link.key == b->keys[0]);
+    for (int i = 0; i < RBTREE_BLOCK_KEYS; i++) {
+      if (i < b->n) {
+        assert(seen < n && b->keys[i] == sorted[seen++]);
+      } else {
+        assert(b->keys[i] == INT_MAX);  // padding the SIMD search relies on
+      }
+    }
+    blocks++;
+  }
+  assert(seen == n && blocks == t->count);
+
+  key_t *got = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_block_to_array(bt, got, n) == 0);
+  assert(n == 0 || memcmp(got, sorted, n * sizeof(key_t)) == 0);
+  if (n > 0) {
+    memset(got, 0, n * sizeof(key_t));
+    assert(rbtree_block_to_array(bt, got, n - 1) == -1);
+    assert(memcmp(got, sorted, (n - 1) * sizeof(key_t)) == 0);
+  }
+  free(got);
+}
+
+// a few keys, duplicates and the ends of the key range
+void test_block_basic() {
+  rbtree_block *bt = new_rbtree_block();
+  key_t k;
+  assert(bt != NULL);
+  assert(rbtree_block_find(bt, 1) == 0 && rbtree_block_erase(bt, 1) == 0);
+  assert(rbtree_block_min(bt, &k) == 0 && rbtree_block_max(bt, &k) == 0);
+
+  const key_t keys[] = {10, 5, 8, 34, 67, 23, 5, 1, INT_MAX, INT_MIN};
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    assert(rbtree_block_insert(bt, keys[i]) == 0);
+  }
+  check_blocks(bt, (key_t[]){INT_MIN, 1, 5, 5, 8, 10, 23, 34, 67, INT_MAX},
+               10);
+  assert(rbtree_block_find(bt, INT_MAX) == 1 && rbtree_block_find(bt, 9) == 0);
+  assert(rbtree_block_min(bt, &k) == 1 && k == INT_MIN);
+  assert(rbtree_block_max(bt, &k) == 1 && k == INT_MAX);
+  assert(rbtree_block_erase(bt, 5) == 1 && rbtree_block_find(bt, 5) == 1);
+  assert(rbtree_block_erase(bt, 5) == 1 && rbtree_block_find(bt, 5) == 0);
+  assert(rbtree_block_erase(bt, INT_MAX) == 1);
+  check_blocks(bt, (key_t[]){INT_MIN, 1, 8, 10, 23, 34, 67}, 7);
+  delete_rbtree_block(bt);
+}
+
+// ascending keys fill every block but the last; erasing them all empties
+// the tree
+void test_block_sequential(const size_t n) {
+  rbtree_block *bt = new_rbtree_block();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)i;
+    assert(rbtree_block_insert(bt, arr[i]) == 0);
+  }
+  check_blocks(bt, arr, n);
+  assert(bt->tree->count == (n + RBTREE_BLOCK_KEYS - 1) / RBTREE_BLOCK_KEYS);
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_block_erase(bt, (key_t)(n - 1 - i)) == 1);
+  }
+  check_blocks(bt, arr, 0);
+  assert(bt->tree->root == bt->tree->nil);
+
+  for (size_t i = 0; i < n; i++) {  // descending keys split at the front
+    assert(rbtree_block_insert(bt, (key_t)(n - 1 - i)) == 0);
+  }
+  check_blocks(bt, arr, n);
+  delete_rbtree_block(bt);
+  free(arr);
+}
+
+// random inserts and erases with many duplicates against a sorted array
+void test_block_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree_block *bt = new_rbtree_block();
+  key_t *model = calloc(n, sizeof(key_t));
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    key_t key = rand() % (key_t)(n / 4);
+    if (m == 0 || rand() % 3 != 0) {
+      assert(rbtree_block_insert(bt, key) == 0);
+      model[m++] = key;
+    } else {
+      int had = 0;
+      for (size_t j = 0; j < m; j++) {
+        if (model[j] == key) {
+          model[j] = model[--m];
+          had = 1;
+          break;
+        }
+      }
+      assert(rbtree_block_erase(bt, key) == had);
+    }
+    if (i % 1000 == 0) {
+      qsort(model, m, sizeof(key_t), comp);
+      check_blocks(bt, model, m);
+    }
+  }
+  qsort(model, m, sizeof(key_t), comp);
+  check_blocks(bt, model, m);
+  for (key_t key = -1; key <= (key_t)(n / 4); key++) {
+    assert(rbtree_block_find(bt, key) ==
+           (bsearch(&key, model, m, sizeof(key_t), comp) != NULL));
+  }
+
+  // erasing in random order goes through every merge case
+  while (m > 0) {
+    size_t j = rand() % m;
+    assert(rbtree_block_erase(bt, model[j]) == 1);
+    memmove(model + j, model + j + 1, (m - j - 1) * sizeof(key_t));
+    m--;
+    if (m % 500 == 0) {
+      check_blocks(bt, model, m);
+    }
+  }
+  delete_rbtree_block(bt);
+  free(model);
+}
+
+int main(void) {
+  test_block_basic();
+  test_block_sequential(1000);
+  test_block_sequential(RBTREE_BLOCK_KEYS * 3);
+  test_block_rand(20000, 17);
+  test_block_rand(300, 5);
+  printf("Passed all tests!\n");
+}
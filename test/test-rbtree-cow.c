@@ -0,0 +1,202 @@
+#include <assert.h>
+#include <pthread.h>
+#include <rbtree_cow.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tests for the persistent tree: every version must keep the contents it
+// had when it was taken while later versions change, all versions must stay
+// valid left-leaning red-black trees, and versions dropped from other threads
+// must free only what no one else uses.
+
+#define COW_READERS 4
+
+static int comp(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  return (*e1 > *e2) - (*e1 < *e2);
+}
+
+// black height of p, checking order, no red right links, no two reds in a
+// row and the same black height on every path
+static int check_node(const cow_node_t *p, const key_t *lo, const key_t *hi) {
+  if (p == NULL) {
+    return 0;
+  }
+  assert(lo == NULL || *lo <= p->key);
+  assert(hi == NULL || p->key <= *hi);
+  assert(p->right == NULL || p->right->color == RBTREE_BLACK);
+  if (p->color == RBTREE_RED) {
+    assert(p->left == NULL || p->left->color == RBTREE_BLACK);
+  }
+  int l = check_node(p->left, lo, &p->key);
+  int r = check_node(p->right, &p->key, hi);
+  assert(l == r);
+  return l + (p->color == RBTREE_BLACK);
+}
+
+// the version should be a valid tree holding exactly sorted[0..n)
+static void check_version(const rbtree_cow *t, const key_t *sorted,
+                          const size_t n) {
+  assert(rbtree_cow_size(t) == n);
+  assert(t->root == NULL || t->root->color == RBTREE_BLACK);
+  check_node(t->root, NULL, NULL);
+  key_t *got = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_cow_to_array(t, got, n) == 0);
+  assert(n == 0 || memcmp(got, sorted, n * sizeof(key_t)) == 0);
+  assert(n == 0 || rbtree_cow_to_array(t, got, n - 1) == -1);
+  free(got);
+}
+
+// single-version behaviour matches the plain tree
+void test_cow_basic() {
+  rbtree_cow *t = new_rbtree_cow();
+  key_t k;
+  assert(t != NULL);
+  assert(rbtree_cow_find(t, 1) == 0);
+  assert(rbtree_cow_min(t, &k) == 0 && rbtree_cow_max(t, &k) == 0);
+  assert(rbtree_cow_erase(t, 1) == 0);
+
+  const key_t keys[] = {10, 5, 8, 34, 67, 23, 5, 1};
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    assert(rbtree_cow_insert(t, keys[i]) == 0);
+  }
+  check_version(t, (key_t[]){1, 5, 5, 8, 10, 23, 34, 67}, 8);
+  assert(rbtree_cow_find(t, 23) == 1 && rbtree_cow_find(t, 24) == 0);
+  assert(rbtree_cow_min(t, &k) == 1 && k == 1);
+  assert(rbtree_cow_max(t, &k) == 1 && k == 67);
+  assert(rbtree_cow_lower_bound(t, 24, &k) == 1 && k == 34);
+  assert(rbtree_cow_lower_bound(t, 68, &k) == 0);
+
+  assert(rbtree_cow_erase(t, 5) == 1);
+  assert(rbtree_cow_find(t, 5) == 1);  // the duplicate is still there
+  assert(rbtree_cow_erase(t, 5) == 1);
+  assert(rbtree_cow_erase(t, 5) == 0);
+  check_version(t, (key_t[]){1, 8, 10, 23, 34, 67}, 6);
+  delete_rbtree_cow(t);
+
+  // a tree that grows and shrinks back does not keep its erased nodes
+  t = new_rbtree_cow();
+  for (key_t i = 0; i < 100000; i++) {
+    assert(rbtree_cow_insert(t, i) == 0);
+  }
+  for (key_t i = 0; i < 100000; i++) {
+    assert(rbtree_cow_erase(t, i) == 1);
+  }
+  assert(t->count == 0 && t->spares > 0 && t->spares <= 64);
+  delete_rbtree_cow(t);
+}
+
+// random inserts and erases against a sorted array, with a snapshot taken
+// every few updates; each snapshot must still match the array as it was
+void test_cow_versions(const size_t n, const unsigned int seed) {
+  const size_t every = n / 16;
+  srand(seed);
+  rbtree_cow *t = new_rbtree_cow();
+  key_t *model = calloc(n, sizeof(key_t));
+  size_t m = 0;
+  rbtree_cow *snaps[16];
+  key_t *expect[16];
+  size_t sizes[16], taken = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    key_t key = rand() % (key_t)(n / 2);
+    if (m == 0 || rand() % 3 != 0) {
+      assert(rbtree_cow_insert(t, key) == 0);
+      model[m++] = key;
+    } else {
+      key = model[rand() % m];
+      assert(rbtree_cow_erase(t, key) == 1);
+      for (size_t j = 0; j < m; j++) {
+        if (model[j] == key) {
+          model[j] = model[--m];
+          break;
+        }
+      }
+    }
+    assert(t->spares > 0);  // the reserve covered every node this update made
+    if ((i + 1) % every == 0 && taken < 16) {
+      qsort(model, m, sizeof(key_t), comp);
+      snaps[taken] = rbtree_snapshot(t);
+      expect[taken] = calloc(m + 1, sizeof(key_t));
+      memcpy(expect[taken], model, m * sizeof(key_t));
+      sizes[taken++] = m;
+    }
+  }
+  qsort(model, m, sizeof(key_t), comp);
+  check_version(t, model, m);
+
+  // dropping versions in any order leaves the others intact; the live
+  // version can even be dropped first
+  delete_rbtree_cow(t);
+  for (size_t s = 0; s < taken; s++) {
+    check_version(snaps[s], expect[s], sizes[s]);
+  }
+  for (size_t s = 1; s < taken; s += 2) {
+    delete_rbtree_cow(snaps[s]);
+  }
+  for (size_t s = 0; s < taken; s += 2) {
+    check_version(snaps[s], expect[s], sizes[s]);
+    assert(rbtree_cow_insert(snaps[s], -1) == 0);  // a snapshot can branch
+    delete_rbtree_cow(snaps[s]);
+  }
+  for (size_t s = 0; s < taken; s++) {
+    free(expect[s]);
+  }
+  free(model);
+}
+
+typedef struct {
+  rbtree_cow *snap;
+  key_t *expect;
+  size_t n;
+} cow_arg;
+
+static void *reader_main(void *p) {
+  cow_arg *a = (cow_arg *)p;
+  for (int round = 0; round < 20; round++) {
+    check_version(a->snap, a->expect, a->n);
+    for (size_t i = 0; i < a->n; i++) {
+      assert(rbtree_cow_find(a->snap, a->expect[i]) == 1);
+    }
+  }
+  delete_rbtree_cow(a->snap);
+  return NULL;
+}
+
+// readers check their own snapshots while the writer keeps changing and
+// finally drops the live version
+void test_cow_threads(const size_t n) {
+  rbtree_cow *t = new_rbtree_cow();
+  pthread_t tid[COW_READERS];
+  cow_arg args[COW_READERS];
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_cow_insert(t, (key_t)i) == 0);
+  }
+
+  for (int r = 0; r < COW_READERS; r++) {
+    args[r].snap = rbtree_snapshot(t);
+    args[r].n = rbtree_cow_size(t);
+    args[r].expect = calloc(args[r].n + 1, sizeof(key_t));
+    assert(rbtree_cow_to_array(t, args[r].expect, args[r].n) == 0);
+    pthread_create(&tid[r], NULL, reader_main, &args[r]);
+    for (size_t i = 0; i < n / 8; i++) {  // change the tree under the reader
+      assert(rbtree_cow_erase(t, (key_t)(rand() % n)) >= 0);
+      assert(rbtree_cow_insert(t, (key_t)(rand() % n)) == 0);
+    }
+  }
+  delete_rbtree_cow(t);
+  for (int r = 0; r < COW_READERS; r++) {
+    pthread_join(tid[r], NULL);
+    free(args[r].expect);
+  }
+}
+
+int main(void) {
+  test_cow_basic();
+  test_cow_versions(20000, 17);
+  test_cow_versions(500, 5);
+  test_cow_threads(5000);
+  printf("Passed all tests!\n");
+}
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <pthread.h>
+#include <rbtree.h>
+#include <rbtree_sync.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Stress test for rbtree_sync: writers churn odd keys while readers check
+// that the even keys, which are never erased, are always visible and that
+// min/max stay pinned to the fixed end keys.
+
+#define MT_READERS 4
+#define MT_WRITERS 2
+#define MT_KEYS 4096  // stable keys are 0, 2, ..., 2 * (MT_KEYS - 1)
+#define MT_WRITER_OPS 200000
+#define MT_READER_OPS 400000
+
+typedef struct {
+  rbtree_sync *s;
+  unsigned int seed;
+  long inserted;  // net inserts left behind by this writer
+} mt_arg;
+
+static void *writer_main(void *p) {
+  mt_arg *a = (mt_arg *)p;
+  for (int i = 0; i < MT_WRITER_OPS; i++) {
+    key_t key = 2 * (rand_r(&a->seed) % (MT_KEYS - 1)) + 1;  // odd, inside the stable range
+    if (rand_r(&a->seed) % 2 == 0) {
+      assert(rbtree_sync_insert(a->s, key) == 0);
+      a->inserted++;
+    } else if (rbtree_sync_erase(a->s, key)) {
+      a->inserted--;
+    }
+    if (i % 4096 == 0) {
+      rbtree_sync_compact(a->s, 0.25);  // relinks the tree under readers
+    }
+  }
+  return NULL;
+}
+
+static void *reader_main(void *p) {
+  mt_arg *a = (mt_arg *)p;
+  for (int i = 0; i < MT_READER_OPS; i++) {
+    key_t key = 2 * (rand_r(&a->seed) % MT_KEYS);
+    assert(rbtree_sync_find(a->s, key) == 1);
+
+    key_t k;
+    if (i % 64 == 0) {
+      assert(rbtree_sync_min(a->s, &k) == 1 && k == 0);
+      assert(rbtree_sync_max(a->s, &k) == 1 && k == 2 * (MT_KEYS - 1));
+    }
+  }
+  return NULL;
+}
+
+// readers and writers running together must never see a stable key missing
+void test_sync_stress(rbtree_sync_mode_t mode) {
+  rbtree_sync *s = new_rbtree_sync(mode);
+  assert(s != NULL);
+  for (key_t k = 0; k < MT_KEYS; k++) {
+    assert(rbtree_sync_insert(s, 2 * k) == 0);
+  }
+
+  pthread_t tid[MT_READERS + MT_WRITERS];
+  mt_arg args[MT_READERS + MT_WRITERS];
+  for (int i = 0; i < MT_READERS + MT_WRITERS; i++) {
+    args[i].s = s;
+    args[i].seed = 17 + i;
+    args[i].inserted = 0;
+    pthread_create(&tid[i], NULL, i < MT_WRITERS ? writer_main : reader_main,
+                   &args[i]);
+  }
+
+  long expected = MT_KEYS;
+  for (int i = 0; i < MT_READERS + MT_WRITERS; i++) {
+    pthread_join(tid[i], NULL);
+    expected += args[i].inserted;
+  }
+  assert(rbtree_sync_size(s) == (size_t)expected);
+
+  // the tree must still be ordered and complete after the churn
+  key_t *arr = calloc(expected, sizeof(key_t));
+  assert(rbtree_to_array(s->tree, arr, expected) == 0);
+  for (long i = 1; i < expected; i++) {
+    assert(arr[i - 1] <= arr[i]);
+  }
+  free(arr);
+  delete_rbtree_sync(s);
+}
+
+// single-threaded behaviour matches the plain tree
+void test_sync_basic(rbtree_sync_mode_t mode) {
+  rbtree_sync *s = new_rbtree_sync(mode);
+  key_t k;
+  assert(s != NULL);
+  assert(rbtree_sync_find(s, 1) == 0);
+  assert(rbtree_sync_min(s, &k) == 0);
+  assert(rbtree_sync_max(s, &k) == 0);
+
+  const key_t keys[] = {10, 5, 8, 34, 67, 23, 5, 1};
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    assert(rbtree_sync_insert(s, keys[i]) == 0);
+  }
+  assert(rbtree_sync_size(s) == 8);
+  assert(rbtree_sync_find(s, 23) == 1);
+  assert(rbtree_sync_find(s, 24) == 0);
+  assert(rbtree_sync_min(s, &k) == 1 && k == 1);
+  assert(rbtree_sync_max(s, &k) == 1 && k == 67);
+
+  assert(rbtree_sync_erase(s, 5) == 1);
+  assert(rbtree_sync_find(s, 5) == 1);  // the duplicate is still there
+  assert(rbtree_sync_erase(s, 5) == 1);
+  assert(rbtree_sync_find(s, 5) == 0);
+  assert(rbtree_sync_erase(s, 5) == 0);
+  assert(rbtree_sync_size(s) == 6);
+
+  // erased ends must not show through min/max, before or after compaction
+  assert(rbtree_sync_erase(s, 1) == 1 && rbtree_sync_erase(s, 67) == 1);
+  assert(rbtree_sync_min(s, &k) == 1 && k == 8);
+  assert(rbtree_sync_max(s, &k) == 1 && k == 34);
+#ifdef RBTREE_TOMBSTONE
+  assert(rbtree_sync_compact(s, 0) > 0);
+#else
+  assert(rbtree_sync_compact(s, 0) == 0);
+#endif
+  assert(rbtree_sync_min(s, &k) == 1 && k == 8);
+  assert(rbtree_sync_size(s) == 4);
+  delete_rbtree_sync(s);
+}
+
+int main(void) {
+  test_sync_basic(RBTREE_SYNC_RWLOCK);
+  test_sync_basic(RBTREE_SYNC_OPTIMISTIC);
+  test_sync_stress(RBTREE_SYNC_RWLOCK);
+  test_sync_stress(RBTREE_SYNC_OPTIMISTIC);
+  printf("Passed all tests!\n");
+}
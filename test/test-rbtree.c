@@ -1,11 +1,37 @@
 #include <assert.h>
+#include <limits.h>
 #include <rbtree.h>
+#ifndef RBTREE_COMPACT
+#include <rbtree_gen.h>
+#endif
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef RBTREE_COMPACT
+#include <sys/resource.h>
+#endif
+#include <unistd.h>
 
 // # define SENTINEL 1 // sentinel을 사용할지 여부
 
+// number of keys a node stands for
+#ifdef RBTREE_COUNTED
+#define COPIES(p) ((p)->count)
+#elif defined(RBTREE_TOMBSTONE)
+#define COPIES(p) (!(p)->dead)
+#else
+#define COPIES(p) 1
+#endif
+
+// with RBTREE_TOMBSTONE erased nodes stay in the tree until compaction;
+// tests that look at the tree's shape after erasing drop them first
+static void purge(rbtree *t) {
+#ifdef RBTREE_TOMBSTONE
+  rbtree_compact(t, 0);
+#endif
+}
+
 // new_rbtree should return rbtree struct with null root node
 void test_init(void) {
   rbtree *t = new_rbtree();
@@ -30,9 +56,9 @@ void test_insert_single(const key_t key) {
   assert(p->key == key);
   // assert(p->color == RBTREE_BLACK);  // color of root node should be black
 #ifdef SENTINEL
-  assert(p->left == t->nil);
-  assert(p->right == t->nil);
-  assert(p->parent == t->nil);
+  assert(rbtree_left(t, p) == t->nil);
+  assert(rbtree_right(t, p) == t->nil);
+  assert(rbtree_parent(t, p) == t->nil);
 #else
   assert(p->left == NULL);
   assert(p->right == NULL);
@@ -66,6 +92,7 @@ void test_erase_root(const key_t key) {
   assert(p->key == key);
 
   rbtree_erase(t, p);
+  purge(t);
 #ifdef SENTINEL
   assert(t->root == t->nil);
 #else
@@ -184,8 +211,8 @@ void test_multi_instance() {
 // The values of right subtree should be greater than or equal to the current
 // node
 
-static bool search_traverse(const node_t *p, key_t *min, key_t *max,
-                            node_t *nil) {
+static bool search_traverse(const rbtree *t, const node_t *p, key_t *min,
+                            key_t *max, node_t *nil) {
   if (p == nil) {
     return true;
   }
@@ -195,11 +222,11 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
   key_t l_min, l_max, r_min, r_max;
   l_min = l_max = r_min = r_max = p->key;
 
-  const bool lr = search_traverse(p->left, &l_min, &l_max, nil);
+  const bool lr = search_traverse(t, rbtree_left(t, p), &l_min, &l_max, nil);
   if (!lr || l_max > p->key) {
     return false;
   }
-  const bool rr = search_traverse(p->right, &r_min, &r_max, nil);
+  const bool rr = search_traverse(t, rbtree_right(t, p), &r_min, &r_max, nil);
   if (!rr || r_min < p->key) {
     return false;
   }
@@ -218,7 +245,7 @@ void test_search_constraint(const rbtree *t) {
 #else
   node_t *nil = NULL;
 #endif
-  assert(search_traverse(p, &min, &max, nil));
+  assert(search_traverse(t, p, &min, &max, nil));
 }
 
 // Color constraint
@@ -236,8 +263,9 @@ static void init_color_traverse(void) {
   max_black_depth = 0;
 }
 
-static bool color_traverse(const node_t *p, const color_t parent_color,
-                           const int black_depth, node_t *nil) {
+static bool color_traverse(const rbtree *t, const node_t *p,
+                           const color_t parent_color, const int black_depth,
+                           node_t *nil) {
   if (p == nil) {
     if (!touch_nil) {
       touch_nil = true;
@@ -247,12 +275,13 @@ static bool color_traverse(const node_t *p, const color_t parent_color,
     }
     return true;
   }
-  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
+  const color_t color = rbtree_color(p);
+  if (parent_color == RBTREE_RED && color == RBTREE_RED) {
     return false;
   }
-  int next_depth = ((p->color == RBTREE_BLACK) ? 1 : 0) + black_depth;
-  return color_traverse(p->left, p->color, next_depth, nil) &&
-         color_traverse(p->right, p->color, next_depth, nil);
+  int next_depth = ((color == RBTREE_BLACK) ? 1 : 0) + black_depth;
+  return color_traverse(t, rbtree_left(t, p), color, next_depth, nil) &&
+         color_traverse(t, rbtree_right(t, p), color, next_depth, nil);
 }
 
 void test_color_constraint(const rbtree *t) {
@@ -263,10 +292,10 @@ void test_color_constraint(const rbtree *t) {
   node_t *nil = NULL;
 #endif
   node_t *p = t->root;
-  assert(p == nil || p->color == RBTREE_BLACK);
+  assert(p == nil || rbtree_color(p) == RBTREE_BLACK);
 
   init_color_traverse();
-  assert(color_traverse(p, RBTREE_BLACK, 0, nil));
+  assert(color_traverse(t, p, RBTREE_BLACK, 0, nil));
 }
 
 // rbtree should keep search tree and color constraints
@@ -371,6 +400,1426 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+// pool-backed tree should recycle erased nodes
+void test_pool_reuse() {
+  rbtree *t = new_rbtree_pool(4);
+  assert(t != NULL);
+#ifdef SENTINEL
+  assert(t->root == t->nil);
+#endif
+
+  const key_t arr[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12};
+  const size_t n = sizeof(arr) / sizeof(arr[0]);
+  insert_arr(t, arr, n);
+
+  node_t *p = rbtree_find(t, 34);
+  assert(p != NULL);
+  rbtree_erase(t, p);
+  purge(t);
+  node_t *q = rbtree_insert(t, 35);
+  assert(q == p);
+  assert(q->key == 35);
+
+  test_color_constraint(t);
+  test_search_constraint(t);
+  delete_rbtree(t);
+}
+
+void test_find_erase_pool(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_pool(0);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand();
+  }
+
+  test_find_erase(t, arr, n);
+
+  free(arr);
+  delete_rbtree(t);
+}
+
+// bulk-loaded tree should keep constraints and accept further updates
+void test_from_sorted(const size_t n) {
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = i / 3;  // sorted with duplicates
+  }
+
+  rbtree *t = rbtree_from_sorted(arr, n);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  for (int i = 0; i < n; i += 2) {
+    rbtree_insert(t, i);
+    node_t *p = rbtree_find(t, i / 3);
+    assert(p != NULL);
+    rbtree_erase(t, p);
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+void test_from_sorted_suite() {
+  for (size_t n = 0; n < 70; n++) {
+    test_from_sorted(n);
+  }
+  test_from_sorted(10000);
+
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = rbtree_from_array(entries, n);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)entries, n, sizeof(key_t), comp);
+  key_t res[sizeof(entries) / sizeof(entries[0])];
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(entries[i] == res[i]);
+  }
+  delete_rbtree(t);
+}
+
+// iterator should visit keys in order in both directions
+void test_iterator() {
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+
+  rbtree_iter it;
+  assert(rbtree_iter_begin(&it, t) == NULL);
+  assert(rbtree_iter_rbegin(&it, t) == NULL);
+
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  size_t i = 0;
+  for (node_t *p = rbtree_iter_begin(&it, t); p != NULL;
+       p = rbtree_iter_next(&it)) {
+    assert(i < n);
+    assert(p->key == entries[i]);
+    i += COPIES(p);
+  }
+  assert(i == n);
+
+  for (node_t *p = rbtree_iter_rbegin(&it, t); p != NULL;
+       p = rbtree_iter_prev(&it)) {
+    assert(i > 0);
+    i -= COPIES(p);
+    assert(p->key == entries[i]);
+  }
+  assert(i == 0);
+
+  node_t *p = rbtree_min(t);
+  assert(rbtree_predecessor(t, p) == NULL);
+  assert(rbtree_successor(t, rbtree_max(t)) == NULL);
+
+  key_t res[sizeof(entries) / sizeof(entries[0])];
+  assert(rbtree_to_array(t, res, n - 1) == -1);
+  assert(rbtree_to_array(t, res, n) == 0);
+
+  delete_rbtree(t);
+}
+
+static int count_cb(node_t *p, void *ctx) {
+  *(size_t *)ctx += COPIES(p);
+  return 0;
+}
+
+// bounds and range queries should agree with a scan of the sorted keys
+void test_bounds_range() {
+  key_t entries[] = {10, 5, 5, 34, 6, 23, 12, 12, 6, 12, 990, 25, 2};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = new_rbtree();
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  key_t out[sizeof(entries) / sizeof(entries[0])];
+  for (key_t lo = 0; lo < 40; lo++) {
+    size_t lb = 0, ub = 0;
+    while (lb < n && entries[lb] < lo) lb++;
+    while (ub < n && entries[ub] <= lo) ub++;
+
+    node_t *p = rbtree_lower_bound(t, lo);
+    assert(lb == n ? p == NULL : (p != NULL && p->key == entries[lb]));
+    node_t *q = rbtree_upper_bound(t, lo);
+    assert(ub == n ? q == NULL : (q != NULL && q->key == entries[ub]));
+
+    node_t *first, *last;
+    rbtree_equal_range(t, lo, &first, &last);
+    size_t eq = 0;
+    for (node_t *x = first; x != last; x = rbtree_successor(t, x)) {
+      assert(x->key == lo);
+      eq += COPIES(x);
+    }
+    assert(eq == ub - lb);
+
+    for (key_t hi = lo; hi < 40; hi += 3) {
+      size_t end = lb;
+      while (end < n && entries[end] < hi) end++;
+      size_t got = rbtree_range(t, lo, hi, out, n);
+      assert(got == end - lb);
+      for (size_t i = 0; i < got; i++) {
+        assert(out[i] == entries[lb + i]);
+      }
+      if (got > 1) {
+        assert(rbtree_range(t, lo, hi, out, 1) == 1);
+      }
+      size_t visited = 0;
+      size_t calls = rbtree_range_foreach(t, lo, hi, count_cb, &visited);
+      assert(visited == got);
+#ifndef RBTREE_COUNTED
+      assert(calls == got);  // one node per key
+#else
+      assert(calls <= got);
+#endif
+    }
+  }
+
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_ORDER_STAT
+static size_t size_traverse(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    return 0;
+  }
+  size_t size = size_traverse(t, rbtree_left(t, p)) +
+                size_traverse(t, rbtree_right(t, p)) + COPIES(p);
+  assert(p->size == size);
+  return size;
+}
+#endif
+
+static void check_order_stat(const rbtree *t, const key_t *sorted,
+                             const size_t n) {
+  assert(rbtree_size(t) == n);
+#ifdef RBTREE_ORDER_STAT
+  assert(size_traverse(t, t->root) == n);
+#endif
+  for (size_t k = 0; k < n; k++) {
+    node_t *p = rbtree_select(t, k);
+    assert(p != NULL);
+    assert(p->key == sorted[k]);
+  }
+  assert(rbtree_select(t, n) == NULL);
+  for (size_t i = 0; i < n; i++) {
+    size_t rank = 0;
+    while (rank < n && sorted[rank] < sorted[i]) rank++;
+    assert(rbtree_rank(t, sorted[i]) == rank);
+
+    const key_t lo = sorted[i], hi = sorted[i] + 7;
+    size_t count = 0;
+    for (size_t j = 0; j < n; j++) {
+      count += (sorted[j] >= lo && sorted[j] < hi);
+    }
+    assert(rbtree_count_range(t, lo, hi) == count);
+  }
+}
+
+// size, rank, select and count_range should track inserts and erases
+void test_order_stat(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2 + 1);
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  check_order_stat(t, arr, n);
+
+  // erase every other key; the tree keeps the odd positions
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i % 2 == 0) {
+      node_t *p = rbtree_find(t, arr[i]);
+      assert(p != NULL);
+      rbtree_erase(t, p);
+    } else {
+      arr[m++] = arr[i];
+    }
+  }
+  check_order_stat(t, arr, m);
+  assert(rbtree_count_range(t, 5, 5) == 0);
+
+  rbtree *u = rbtree_from_sorted(arr, m);
+  check_order_stat(u, arr, m);
+  delete_rbtree(u);
+
+  free(arr);
+  delete_rbtree(t);
+}
+
+// rbtree_find_batch should agree with rbtree_find key by key
+void test_find_batch(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_pool(0);
+  key_t *keys = calloc(n, sizeof(key_t));
+  node_t **out = calloc(n, sizeof(node_t *));
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, 2 * (rand() % (key_t)n));  // even keys, with duplicates
+  }
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = rand() % (2 * (key_t)n);  // odd keys always miss
+  }
+
+  size_t found = rbtree_find_batch(t, keys, n, out);
+  size_t expected = 0;
+  for (size_t i = 0; i < n; i++) {
+    assert(out[i] == rbtree_find(t, keys[i]));
+    expected += out[i] != NULL;
+  }
+  assert(found == expected);
+
+  // fewer keys than the interleave width, and none at all
+  assert(rbtree_find_batch(t, keys, 3, out) <= 3);
+  for (size_t i = 0; i < 3; i++) {
+    assert(out[i] == rbtree_find(t, keys[i]));
+  }
+  assert(rbtree_find_batch(t, keys, 0, out) == 0);
+
+  rbtree *e = new_rbtree();
+  assert(rbtree_find_batch(e, keys, n, out) == 0);
+  assert(out[n - 1] == NULL);
+  delete_rbtree(e);
+
+  free(keys);
+  free(out);
+  delete_rbtree(t);
+}
+
+// a frozen snapshot should answer find/lower_bound/range like the live tree
+void test_freeze(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % (key_t)n);  // with duplicates
+  }
+  rbtree_frozen *f = rbtree_freeze(t);
+  assert(f != NULL && f->n == n);
+
+  key_t *expect = calloc(n, sizeof(key_t));
+  key_t *got = calloc(n, sizeof(key_t));
+  for (key_t key = -1; key <= (key_t)n; key++) {
+    assert(rbtree_frozen_find(f, key) == (rbtree_find(t, key) != NULL));
+
+    key_t lb;
+    node_t *p = rbtree_lower_bound(t, key);
+    assert(rbtree_frozen_lower_bound(f, key, &lb) == (p != NULL));
+    assert(p == NULL || lb == p->key);
+
+    size_t m = rbtree_range(t, key, key + 7, expect, n);
+    assert(rbtree_frozen_range(f, key, key + 7, got, n) == m);
+    assert(memcmp(expect, got, m * sizeof(key_t)) == 0);
+  }
+  assert(rbtree_frozen_range(f, -1, (key_t)n, got, n) == n);
+  assert(rbtree_frozen_range(f, -1, (key_t)n, got, 3) == 3);
+
+  // the snapshot does not follow later changes to the tree
+  rbtree_insert(t, (key_t)n + 5);
+  assert(!rbtree_frozen_find(f, (key_t)n + 5));
+  delete_rbtree_frozen(f);
+
+  rbtree *e = new_rbtree();
+  f = rbtree_freeze(e);
+  key_t lb;
+  assert(f != NULL && f->n == 0);
+  assert(!rbtree_frozen_find(f, 0));
+  assert(!rbtree_frozen_lower_bound(f, 0, &lb));
+  assert(rbtree_frozen_range(f, -10, 10, got, n) == 0);
+  delete_rbtree_frozen(f);
+  delete_rbtree(e);
+
+  free(expect);
+  free(got);
+  delete_rbtree(t);
+}
+
+// rbtree_save should round-trip through rbtree_load and rbtree_frozen_open,
+// and damaged files should be rejected
+void test_save_load(const size_t n, const unsigned int seed) {
+  const char *path = "test-rbtree-save.dat";
+  srand(seed);
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % (key_t)n - (key_t)n / 2);
+  }
+  key_t *expect = calloc(n, sizeof(key_t));
+  key_t *got = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, expect, n);
+  assert(rbtree_save(t, path) == 0);
+
+  rbtree *u = rbtree_load(path);
+  assert(u != NULL && rbtree_size(u) == n);
+  rbtree_to_array(u, got, n);
+  assert(memcmp(expect, got, n * sizeof(key_t)) == 0);
+  test_color_constraint(u);
+  test_search_constraint(u);
+  delete_rbtree(u);
+
+  rbtree_frozen *f = rbtree_frozen_open(path);
+  assert(f != NULL && f->n == n);
+  assert(rbtree_frozen_range(f, expect[0], expect[n - 1] + 1, got, n) == n);
+  assert(memcmp(expect, got, n * sizeof(key_t)) == 0);
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_frozen_find(f, expect[i]));
+  }
+
+  // saving over an open snapshot replaces the file; the mapping keeps the old
+  rbtree *e = new_rbtree();
+  assert(rbtree_save(e, path) == 0);
+  assert(rbtree_frozen_range(f, expect[0], expect[n - 1] + 1, got, n) == n);
+  assert(memcmp(expect, got, n * sizeof(key_t)) == 0);
+  delete_rbtree_frozen(f);
+  assert(rbtree_save(t, path) == 0);
+
+  // flip one key byte: the checksum must catch it
+  FILE *fp = fopen(path, "r+b");
+  assert(fp != NULL);
+  fseek(fp, -1, SEEK_END);
+  int c = fgetc(fp);
+  fseek(fp, -1, SEEK_END);
+  fputc(c ^ 0x40, fp);
+  fclose(fp);
+  assert(rbtree_load(path) == NULL);
+
+  // a valid header over a file cut short, or a header-only file whose count
+  // would overflow the size check, must both be rejected
+  assert(rbtree_save(t, path) == 0);
+  unsigned char header[64];
+  fp = fopen(path, "rb");
+  assert(fp != NULL && fread(header, 1, sizeof(header), fp) == sizeof(header));
+  fclose(fp);
+  const long cuts[] = {sizeof(key_t), 1};
+  for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+    assert(truncate(path, 64 + (long)(n + 1) * sizeof(key_t) - cuts[i]) == 0);
+    assert(rbtree_load(path) == NULL);
+    assert(rbtree_frozen_open(path) == NULL);
+  }
+  unsigned long long huge = ((unsigned long long)1 << 62) - 1;
+  memcpy(header + 24, &huge, sizeof(huge));  // count follows magic and four 32-bit fields
+  fp = fopen(path, "wb");
+  assert(fwrite(header, 1, sizeof(header), fp) == sizeof(header));
+  fclose(fp);
+  assert(rbtree_load(path) == NULL);
+  assert(rbtree_frozen_open(path) == NULL);
+
+  // a truncated file is rejected before anything is read
+  fp = fopen(path, "wb");
+  fputs("RBTREE", fp);
+  fclose(fp);
+  assert(rbtree_load(path) == NULL);
+  assert(rbtree_frozen_open(path) == NULL);
+  assert(rbtree_load("does-not-exist.dat") == NULL);
+  assert(rbtree_save(t, "does-not-exist/test.dat") == -1);
+
+  assert(rbtree_save(e, path) == 0);
+  u = rbtree_load(path);
+  assert(u != NULL && rbtree_size(u) == 0 && rbtree_min(u) == u->nil);
+  delete_rbtree(u);
+  delete_rbtree(e);
+
+  remove(path);
+  free(expect);
+  free(got);
+  delete_rbtree(t);
+}
+
+// the tree should be a valid red-black tree holding exactly sorted[0..n)
+static void check_tree(const rbtree *t, const key_t *sorted, const size_t n) {
+  assert(rbtree_size(t) == n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+#ifdef RBTREE_ORDER_STAT
+  assert(size_traverse(t, t->root) == n);
+#endif
+  key_t *got = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array(t, got, n) == 0);
+  assert(n == 0 || memcmp(got, sorted, n * sizeof(key_t)) == 0);
+  free(got);
+}
+
+static rbtree *tree_of(const key_t *arr, const size_t n, const size_t slab) {
+  rbtree *t = slab ? new_rbtree_pool(slab) : new_rbtree();
+  insert_arr(t, arr, n);
+  return t;
+}
+
+// splitting at any key and joining the halves back should keep the tree
+// valid, whether the halves share an allocator or not
+void test_join_split(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = 2 * (rand() % (key_t)(n / 2 + 1));  // even keys, with duplicates
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  for (size_t slab = 0; slab <= 64; slab += 64) {
+    rbtree *t = tree_of(arr, n, slab);
+    for (key_t key = -1; key <= (key_t)n + 2; key += 3) {
+      size_t m = 0;
+      while (m < n && arr[m] < key) m++;
+      rbtree *r = rbtree_split(t, key);
+      assert(r != NULL);
+      check_tree(t, arr, m);
+      check_tree(r, arr + m, n - m);
+
+      // a key out of order is refused and leaves both halves alone
+      if (m > 0 && m < n) {
+        assert(rbtree_join(t, arr[m] + 1, r) == NULL);
+        check_tree(t, arr, m);
+        check_tree(r, arr + m, n - m);
+      }
+
+      // join with a middle key, then take it back out
+      assert(rbtree_join(t, key, r) == t);
+      memmove(arr + m + 1, arr + m, (n - m) * sizeof(key_t));
+      arr[m] = key;
+      check_tree(t, arr, n + 1);
+      rbtree_erase(t, rbtree_select(t, m));
+      memmove(arr + m, arr + m + 1, (n - m) * sizeof(key_t));
+      check_tree(t, arr, n);
+    }
+    delete_rbtree(t);
+  }
+
+  // trees with their own allocators: same mode, and calloc against slab
+  for (size_t slab = 0; slab <= 64; slab += 64) {
+    const size_t m = n / 3;
+    const key_t key = arr[m];
+    rbtree *l = tree_of(arr, m, 64);
+    rbtree *r = tree_of(arr + m + 1, n - m - 1, slab);
+    assert(rbtree_join(l, key, r) == l);
+    check_tree(l, arr, n);
+    delete_rbtree(l);
+  }
+
+  rbtree *l = new_rbtree(), *r = new_rbtree();
+  assert(rbtree_join(l, 5, r) == l);
+  check_tree(l, (key_t[]){5}, 1);
+  r = rbtree_split(l, 6);
+  check_tree(l, (key_t[]){5}, 1);
+  check_tree(r, NULL, 0);
+  delete_rbtree(r);
+  delete_rbtree(l);
+  free(arr);
+}
+
+// multiset union, and intersection/difference by membership in the second
+// tree, computed on sorted arrays
+static size_t model_set_op(const key_t *a, size_t na, const key_t *b, size_t nb,
+                           int op, key_t *out) {
+  size_t n = 0, i = 0, j = 0;
+  if (op == 0) {
+    while (i < na || j < nb) {
+      out[n++] = (j == nb || (i < na && a[i] <= b[j])) ? a[i++] : b[j++];
+    }
+    return n;
+  }
+  for (i = 0; i < na; i++) {
+    while (j < nb && b[j] < a[i]) j++;
+    bool found = j < nb && b[j] == a[i];
+    if (found == (op == 1)) {
+      out[n++] = a[i];
+    }
+  }
+  return n;
+}
+
+// union, intersection, difference and the parallel union should match the
+// array model for trees sharing an allocator, owning their own, or mixing
+// calloc and slab allocation
+void test_set_ops(const size_t n, const unsigned int seed) {
+  srand(seed);
+  const size_t na = n, nb = n / 3;
+  key_t *a = calloc(na, sizeof(key_t));
+  key_t *b = calloc(nb, sizeof(key_t));
+  key_t *expect = calloc(na + nb, sizeof(key_t));
+  for (size_t i = 0; i < na; i++) {
+    a[i] = rand() % (key_t)n;
+  }
+  for (size_t i = 0; i < nb; i++) {
+    b[i] = rand() % (key_t)n;
+  }
+  qsort((void *)a, na, sizeof(key_t), comp);
+  qsort((void *)b, nb, sizeof(key_t), comp);
+
+  const size_t slabs[][2] = {{64, 64}, {0, 0}, {64, 0}, {0, 64}};
+  for (int op = 0; op < 4; op++) {
+    for (size_t s = 0; s < sizeof(slabs) / sizeof(slabs[0]); s++) {
+      for (int swap = 0; swap < 2; swap++) {
+        const key_t *x = swap ? b : a, *y = swap ? a : b;
+        const size_t nx = swap ? nb : na, ny = swap ? na : nb;
+        rbtree *t1 = tree_of(x, nx, slabs[s][0]);
+        rbtree *t2 = tree_of(y, ny, slabs[s][1]);
+        rbtree *r;
+        if (op == 0) {
+          r = rbtree_union(t1, t2);
+        } else if (op == 1) {
+          r = rbtree_intersection(t1, t2);
+        } else if (op == 2) {
+          r = rbtree_difference(t1, t2);
+        } else {
+          r = rbtree_union_parallel(t1, t2, 4);
+        }
+        assert(r == t1);
+        check_tree(t1, expect, model_set_op(x, nx, y, ny, op % 3, expect));
+        delete_rbtree(t1);
+      }
+    }
+  }
+
+  // operands that came from one split share an allocator
+  rbtree *t = tree_of(a, na, 64);
+  rbtree *u = rbtree_split(t, a[na / 2]);
+  size_t m = 0;
+  while (a[m] < a[na / 2]) m++;
+  assert(rbtree_union(u, t) == u);
+  check_tree(u, a, na);
+  t = rbtree_split(u, a[na / 2]);
+  assert(rbtree_difference(t, u) == t);
+  check_tree(t, a + m, na - m);
+  delete_rbtree(t);
+
+  // empty operands
+  t = tree_of(a, na, 0);
+  assert(rbtree_union(t, new_rbtree()) == t);
+  assert(rbtree_difference(t, new_rbtree()) == t);
+  check_tree(t, a, na);
+  assert(rbtree_intersection(t, new_rbtree()) == t);
+  check_tree(t, NULL, 0);
+  assert(rbtree_union_parallel(t, tree_of(b, nb, 64), 3) == t);
+  check_tree(t, b, nb);
+  // absurd thread counts are clamped instead of overflowing the depth loop
+  assert(rbtree_union_parallel(t, new_rbtree(), INT_MAX) == t);
+  assert(rbtree_union_parallel(t, new_rbtree(), -1) == t);
+  check_tree(t, b, nb);
+  assert(rbtree_union(t, t) == NULL);
+  delete_rbtree(t);
+
+  free(a);
+  free(b);
+  free(expect);
+}
+
+// rbtree_erase_range should remove exactly the keys in [lo, hi) and keep the
+// tree valid, on both allocators and on ranges past either end
+void test_erase_range(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *rest = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)(n / 2 + 1);  // with duplicates
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  for (size_t slab = 0; slab <= 64; slab += 64) {
+    for (key_t lo = -3; lo <= (key_t)n / 2 + 3; lo += 7) {
+      for (key_t width = 0; width <= (key_t)n / 2; width += 1 + width) {
+        rbtree *t = tree_of(arr, n, slab);
+        size_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+          if (arr[i] < lo || arr[i] >= lo + width) {
+            rest[m++] = arr[i];
+          }
+        }
+        assert(rbtree_erase_range(t, lo, lo + width) == n - m);
+        check_tree(t, rest, m);
+        delete_rbtree(t);
+      }
+    }
+  }
+
+  rbtree *t = tree_of(arr, n, 0);
+  assert(rbtree_erase_range(t, 5, 2) == 0);
+  assert(rbtree_erase_range(t, arr[0], arr[n - 1] + 1) == n);
+  check_tree(t, NULL, 0);
+  assert(rbtree_erase_range(t, 0, 10) == 0);
+  delete_rbtree(t);
+  free(arr);
+  free(rest);
+}
+
+// rbtree_erase_batch should remove exactly the given nodes
+void test_erase_batch(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *rest = calloc(n, sizeof(key_t));
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)n;
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  for (size_t every = 1; every <= n; every *= 3) {
+    rbtree *t = tree_of(arr, n, 64);
+    rbtree_iter it;
+    size_t k = 0, m = 0, i = 0;
+    for (node_t *p = rbtree_iter_begin(&it, t); p != NULL;
+         p = rbtree_iter_next(&it), i++) {
+      size_t keep = COPIES(p);
+      if (i % every == 0) {
+        nodes[k++] = p;
+        keep--;  // erasing a node drops one copy of its key
+      }
+      for (size_t c = 0; c < keep; c++) {
+        rest[m++] = p->key;
+      }
+    }
+    // erase in a scattered order, not in key order
+    for (size_t j = 0; j < k; j++) {
+      size_t r = rand() % k;
+      node_t *tmp = nodes[j];
+      nodes[j] = nodes[r];
+      nodes[r] = tmp;
+    }
+    assert(rbtree_erase_batch(t, nodes, k) == k);
+    check_tree(t, rest, m);
+    assert(rbtree_erase_batch(t, nodes, 0) == 0);
+#if defined(RBTREE_TOMBSTONE) && !defined(RBTREE_COUNTED)
+    // the nodes stay as tombstones; erasing them again removes no key
+    assert(rbtree_erase_batch(t, nodes, k) == 0);
+    check_tree(t, rest, m);
+#endif
+    delete_rbtree(t);
+  }
+  free(arr);
+  free(rest);
+  free(nodes);
+}
+
+// rbtree_clear should empty the tree and leave it ready for reuse; a pool
+// tree it owns alone reuses its slabs from the start
+void test_clear(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)n;
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  const size_t slabs[] = {0, 64, 4096};
+  for (size_t s = 0; s < sizeof(slabs) / sizeof(slabs[0]); s++) {
+    rbtree *t = slabs[s] ? new_rbtree_pool(slabs[s]) : new_rbtree();
+    node_t *first = rbtree_insert(t, arr[0]);
+    insert_arr(t, arr + 1, n - 1);
+    for (int round = 0; round < 3; round++) {
+      rbtree_clear(t);
+      check_tree(t, NULL, 0);
+      assert(t->root == t->nil);
+      node_t *p = rbtree_insert(t, arr[0]);
+      if (slabs[s] == 4096) {
+        assert(p == first);  // allocation restarts at the first slot
+      }
+      insert_arr(t, arr + 1, n - 1);
+      check_tree(t, arr, n);
+    }
+    rbtree_clear(t);
+    rbtree_clear(t);
+    delete_rbtree(t);
+  }
+
+  // halves of a split share one allocator, so clearing one must not
+  // disturb the other
+  rbtree *t = tree_of(arr, n, 64);
+  rbtree *u = rbtree_split(t, arr[n / 2]);
+  size_t lo = rbtree_size(t);
+  rbtree_clear(u);
+  check_tree(u, NULL, 0);
+  check_tree(t, arr, lo);
+  insert_arr(u, arr + lo, n - lo);
+  check_tree(u, arr + lo, n - lo);
+  rbtree_clear(t);
+  insert_arr(t, arr, lo);
+  check_tree(t, arr, lo);
+  delete_rbtree(u);
+  delete_rbtree(t);
+  free(arr);
+}
+
+// leftmost node found by walking from the root, to check the min cache
+static node_t *walk_min(const rbtree *t) {
+  node_t *p = t->root;
+  while (p != t->nil && rbtree_left(t, p) != t->nil) {
+    p = rbtree_left(t, p);
+  }
+#ifdef RBTREE_TOMBSTONE
+  if (p != t->nil && !COPIES(p)) {  // erased minimum kept as a tombstone
+    p = rbtree_successor(t, p);
+    if (p == NULL) p = t->nil;
+  }
+#endif
+  return p;
+}
+
+// rightmost node found by walking from the root, to check the max cache
+static node_t *walk_max(const rbtree *t) {
+  node_t *p = t->root;
+  while (p != t->nil && rbtree_right(t, p) != t->nil) {
+    p = rbtree_right(t, p);
+  }
+#ifdef RBTREE_TOMBSTONE
+  if (p != t->nil && !COPIES(p)) {  // erased maximum kept as a tombstone
+    p = rbtree_predecessor(t, p);
+    if (p == NULL) p = t->nil;
+  }
+#endif
+  return p;
+}
+
+// hinted insert and finger search should match the plain calls from any
+// starting node, and the cached maximum should survive every update path
+void test_insert_hint(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  node_t **nodes = calloc(n, sizeof(node_t *));
+
+  // nearly sorted stream, each insert hinted with the previous node
+  rbtree *t = new_rbtree_pool(0);
+  node_t *prev = NULL;
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)i - (rand() % 8 == 0 ? rand() % 50 : 0);
+    prev = nodes[i] = rbtree_insert_hint(t, prev, arr[i]);
+    assert(prev != NULL && prev->key == arr[i]);
+    assert(rbtree_max(t) == walk_max(t));
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  check_tree(t, arr, n);
+
+  // random keys, hinted with random nodes
+  for (size_t i = 0; i < n; i++) {
+    key_t key = rand() % (key_t)(2 * n) - 100;
+    node_t *hint = nodes[rand() % n];
+    node_t *near = rbtree_find_near(t, hint, key);
+    node_t *plain = rbtree_find(t, key);
+    assert((near == NULL) == (plain == NULL));
+    assert(near == NULL || near->key == key);
+    assert(rbtree_insert_hint(t, hint, key)->key == key);
+    arr = realloc(arr, (n + i + 1) * sizeof(key_t));
+    arr[n + i] = key;
+  }
+  qsort((void *)arr, 2 * n, sizeof(key_t), comp);
+  check_tree(t, arr, 2 * n);
+  assert(rbtree_find_near(t, NULL, arr[0]) != NULL);
+  assert(rbtree_insert_hint(t, NULL, arr[0]) != NULL);
+  delete_rbtree(t);
+
+  // ascending keys take the append path; erasing the maximum, split and
+  // join must keep the cache right
+  t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, (key_t)i);
+  }
+  assert(rbtree_max(t)->key == (key_t)n - 1 && rbtree_max(t) == walk_max(t));
+  for (size_t i = 0; i < n / 4; i++) {
+    rbtree_erase(t, rbtree_max(t));
+    assert(rbtree_max(t) == walk_max(t));
+  }
+  rbtree *u = rbtree_split(t, (key_t)n / 8);
+  assert(rbtree_max(t) == walk_max(t) && rbtree_max(u) == walk_max(u));
+  rbtree_insert(t, (key_t)n / 8 - 1);
+  assert(rbtree_max(t) == walk_max(t));
+  assert(rbtree_join(t, (key_t)n / 8, u) == t);
+  assert(rbtree_max(t) == walk_max(t));
+  rbtree_insert(t, (key_t)n);
+  assert(rbtree_max(t)->key == (key_t)n && rbtree_max(t) == walk_max(t));
+  rbtree_clear(t);
+  assert(rbtree_max(t) == t->nil);
+  rbtree_insert(t, 5);
+  assert(rbtree_max(t)->key == 5);
+  rbtree_erase(t, rbtree_max(t));
+  assert(rbtree_max(t) == t->nil);
+  delete_rbtree(t);
+  free(arr);
+  free(nodes);
+}
+
+// rbtree_to_array_parallel should give exactly what rbtree_to_array gives,
+// for any thread count and array size, including erased keys
+void test_to_array_parallel(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_pool(0);
+  key_t *expect = calloc(n + 1, sizeof(key_t));
+  key_t *got = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array_parallel(t, got, 0, 4) == 0);
+
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % (key_t)(n / 8));  // plenty of duplicates
+  }
+  for (size_t i = 0; i < n / 10; i++) {
+    node_t *p = rbtree_find(t, rand() % (key_t)(n / 8));
+    if (p != NULL) {
+      rbtree_erase(t, p);
+    }
+  }
+  const size_t m = rbtree_size(t);
+  assert(rbtree_to_array(t, expect, m) == 0);
+
+  const int threads[] = {1, 2, 3, 8, INT_MAX};  // INT_MAX is clamped
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+    const size_t caps[] = {m + 1, m, m - 1, m / 2, 1, 0};
+    for (size_t c = 0; c < sizeof(caps) / sizeof(caps[0]); c++) {
+      const size_t cap = caps[c];
+      memset(got, 0xff, (n + 1) * sizeof(key_t));
+      assert(rbtree_to_array_parallel(t, got, cap, threads[i]) ==
+             (cap >= m ? 0 : -1));
+      const size_t filled = cap < m ? cap : m;
+      assert(memcmp(got, expect, filled * sizeof(key_t)) == 0);
+      for (size_t j = filled; j <= n; j++) {
+        assert(got[j] == (key_t)-1);  // nothing written past the cap
+      }
+    }
+  }
+  delete_rbtree(t);
+  free(expect);
+  free(got);
+}
+
+// pop_min/pop_max should hand out keys in order, and the cached ends should
+// follow every insert, erase and pop
+void test_pop(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_pool(0);
+  key_t *model = calloc(n, sizeof(key_t));  // kept sorted
+  size_t m = 0;
+  key_t k;
+  assert(rbtree_pop_min(t, &k) == 0 && rbtree_pop_max(t, &k) == 0);
+
+  for (size_t i = 0; i < n; i++) {
+    const int op = rand() % 5;
+    if (m == 0 || op < 2) {
+      key_t key = rand() % (key_t)(n / 4);
+      rbtree_insert(t, key);
+      size_t j = m;
+      while (j > 0 && model[j - 1] > key) {
+        model[j] = model[j - 1];
+        j--;
+      }
+      model[j] = key;
+      m++;
+    } else if (op == 2) {
+      assert(rbtree_pop_min(t, &k) == 1 && k == model[0]);
+      memmove(model, model + 1, (--m) * sizeof(key_t));
+    } else if (op == 3) {
+      assert(rbtree_pop_max(t, &k) == 1 && k == model[--m]);
+    } else {  // a plain erase anywhere, including at either end
+      size_t j = rand() % m;
+      rbtree_erase(t, rbtree_find(t, model[j]));
+      memmove(model + j, model + j + 1, (m - j - 1) * sizeof(key_t));
+      m--;
+    }
+    assert(rbtree_min(t) == walk_min(t) && rbtree_max(t) == walk_max(t));
+    assert(m == 0 || (rbtree_min(t)->key == model[0] &&
+                      rbtree_max(t)->key == model[m - 1]));
+  }
+  check_tree(t, model, m);
+
+  // drain from both ends
+  size_t lo = 0, hi = m;
+  while (lo < hi) {
+    if (rand() % 2 == 0) {
+      assert(rbtree_pop_min(t, &k) == 1 && k == model[lo++]);
+    } else {
+      assert(rbtree_pop_max(t, &k) == 1 && k == model[--hi]);
+    }
+  }
+  assert(rbtree_pop_min(t, &k) == 0 && rbtree_pop_max(t, &k) == 0);
+  assert(rbtree_min(t) == t->nil && rbtree_max(t) == t->nil);
+  assert(rbtree_size(t) == 0);
+
+  // descending inserts keep replacing the minimum
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, (key_t)(n - i));
+    assert(rbtree_min(t)->key == (key_t)(n - i) && rbtree_min(t) == walk_min(t));
+  }
+  delete_rbtree(t);
+  free(model);
+}
+
+// rbtree_stats_dump should report counters only when built with RBTREE_STATS
+void test_stats(const size_t n) {
+  rbtree *t = new_rbtree_pool(0);
+#ifndef RBTREE_STATS
+  assert(rbtree_stats_dump(t, stdout) == -1);
+#else
+  // ascending inserts rotate and recolor all the way up the right spine
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, (key_t)i);
+  }
+  const rbtree_stats *s = &t->stats;
+  assert(s->inserts == n && s->allocs == n && s->frees == 0);
+  assert(s->rotations > 0 && s->rotations < n);
+  assert(s->insert_fixup_loops > 0);
+  assert(s->compares >= n);
+
+  node_t **out = calloc(n, sizeof(node_t *));
+  key_t *keys = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = (key_t)i;
+    assert(rbtree_find(t, keys[i]) != NULL);
+  }
+  assert(rbtree_find_batch(t, keys, n, out) == n);
+  assert(s->lookups == 2 * n);
+
+  // every insert and lookup lands in one histogram bucket, and no path is
+  // longer than the red-black bound
+  size_t paths = 0, deepest = 0, bound = 0;
+  while (((size_t)1 << bound) <= n) {
+    bound++;
+  }
+  for (size_t d = 0; d < RBTREE_STATS_DEPTHS; d++) {
+    paths += s->depth[d];
+    if (s->depth[d] != 0) {
+      deepest = d;
+    }
+  }
+  assert(paths == s->inserts + s->lookups);
+  assert(deepest <= 2 * bound);
+  assert(s->depth[0] == 1);  // only the first insert met an empty tree
+
+  for (size_t i = 0; i < n; i++) {
+    rbtree_erase(t, out[i]);
+  }
+  purge(t);
+  assert(s->erases == n && s->frees == n);
+#ifndef RBTREE_TOMBSTONE
+  assert(s->delete_fixup_loops > 0);  // compaction relinks without fixups
+#endif
+
+  FILE *f = tmpfile();
+  assert(rbtree_stats_dump(t, f) == 0);
+  rewind(f);
+  char buf[64];
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strncmp(buf, "{\"size\": 0, \"inserts\": ", 23) == 0);
+  fclose(f);
+
+  rbtree_stats_reset(t);
+  assert(s->inserts == 0 && s->rotations == 0 && s->depth[1] == 0);
+
+  // joining small trees onto the right spine rebalances with rotations that
+  // are counted on the joined tree
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, (key_t)i);
+  }
+  rbtree_stats_reset(t);
+  for (size_t k = 1; k <= 8; k++) {
+    rbtree *r = new_rbtree();
+    for (size_t i = 0; i < k; i++) {
+      rbtree_insert(r, (key_t)(2 * n + 16 * k + i));
+    }
+    t = rbtree_join(t, (key_t)(2 * n + 16 * k - 1), r);
+    s = &t->stats;
+  }
+  assert(s->rotations > 0 && s->insert_fixup_loops > 0);
+  free(out);
+  free(keys);
+#endif
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_COUNTED
+// with RBTREE_COUNTED equal keys share one node: insert bumps its count,
+// erase drops one copy, and everything that lists keys expands them
+void test_counted() {
+  rbtree *t = new_rbtree_pool(0);
+  node_t *p = rbtree_insert(t, 7);
+  for (int i = 1; i < 1000; i++) {
+    assert(rbtree_insert(t, 7) == p);
+  }
+  rbtree_insert(t, 3);
+  rbtree_insert(t, 9);
+  rbtree_insert(t, 9);
+  assert(p->count == 1000 && rbtree_size(t) == 1003);
+  assert(rbtree_find(t, 7) == p);
+  assert(rbtree_select(t, 0)->key == 3);
+  assert(rbtree_select(t, 1) == p && rbtree_select(t, 1000) == p);
+  assert(rbtree_select(t, 1001)->key == 9);
+  assert(rbtree_rank(t, 9) == 1001);
+  assert(rbtree_count_range(t, 7, 8) == 1000);
+
+  size_t nodes = 0;
+  rbtree_iter it;
+  for (node_t *x = rbtree_iter_begin(&it, t); x != NULL;
+       x = rbtree_iter_next(&it)) {
+    nodes++;
+  }
+  assert(nodes == 3);
+
+  key_t *arr = calloc(1003, sizeof(key_t));
+  assert(rbtree_to_array(t, arr, 1003) == 0);
+  assert(arr[0] == 3 && arr[1] == 7 && arr[1000] == 7 && arr[1002] == 9);
+  assert(rbtree_range(t, 0, 8, arr, 5) == 5 && arr[4] == 7);
+  rbtree_frozen *f = rbtree_freeze(t);
+  assert(f->n == 1003);
+  assert(rbtree_frozen_range(f, 7, 8, arr, 1003) == 1000);
+  delete_rbtree_frozen(f);
+  free(arr);
+
+  for (int i = 0; i < 999; i++) {
+    rbtree_erase(t, rbtree_find(t, 7));
+  }
+  assert(rbtree_find(t, 7) == p && p->count == 1 && rbtree_size(t) == 4);
+  rbtree_erase(t, p);
+  assert(rbtree_find(t, 7) == NULL && rbtree_size(t) == 3);
+
+  // joining at a key both sides already hold keeps one node for it
+  rbtree *u = new_rbtree_pool(0);
+  rbtree_insert(u, 9);
+  rbtree_insert(u, 12);
+  assert(rbtree_join(t, 9, u) == t);
+  assert(rbtree_find(t, 9)->count == 4);
+  check_tree(t, (key_t[]){3, 9, 9, 9, 9, 12}, 6);
+
+  // so do the set operations
+  u = rbtree_from_sorted((key_t[]){3, 3, 12, 20}, 4);
+  assert(rbtree_union(t, u) == t);
+  assert(rbtree_find(t, 3)->count == 3 && rbtree_find(t, 12)->count == 2);
+  check_tree(t, (key_t[]){3, 3, 3, 9, 9, 9, 9, 12, 12, 20}, 10);
+  u = rbtree_from_sorted((key_t[]){3, 20}, 2);
+  assert(rbtree_difference(t, u) == t);
+  check_tree(t, (key_t[]){9, 9, 9, 9, 12, 12}, 6);
+  assert(rbtree_erase_range(t, 9, 10) == 4);
+  check_tree(t, (key_t[]){12, 12}, 2);
+  delete_rbtree(t);
+}
+#endif
+
+#ifdef RBTREE_TOMBSTONE
+// with RBTREE_TOMBSTONE erase only marks the node: lookups, iteration and
+// order statistics skip it, inserting the key again revives it, and
+// rbtree_compact drops the marks once they pass the given share
+void test_tombstone(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_pool(0);
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  key_t *live = calloc(n, sizeof(key_t));
+  bool *gone = calloc(n, sizeof(bool));
+  for (size_t i = 0; i < n; i++) {
+    nodes[i] = rbtree_insert(t, (key_t)(2 * i));
+  }
+
+  // erase the two ends and a random third of the rest
+  size_t erased = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i == 0 || i == n - 1 || rand() % 3 == 0) {
+      rbtree_erase(t, nodes[i]);
+      gone[i] = true;
+      erased++;
+    }
+  }
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!gone[i]) {
+      live[m++] = (key_t)(2 * i);
+    }
+  }
+  assert(t->tombstones == erased && m == n - erased);
+  check_tree(t, live, m);
+  assert(rbtree_min(t)->key == live[0] && rbtree_max(t)->key == live[m - 1]);
+  assert(rbtree_select(t, 0)->key == live[0]);
+  assert(rbtree_rank(t, live[m - 1]) == m - 1);
+  for (size_t i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, (key_t)(2 * i));
+    assert(gone[i] ? p == NULL : p == nodes[i]);
+    node_t *q = rbtree_lower_bound(t, (key_t)(2 * i));
+    assert(q == NULL || (COPIES(q) > 0 && q->key >= (key_t)(2 * i)));
+  }
+
+  // inserting an erased key again reuses its node
+  assert(rbtree_insert(t, 0) == nodes[0]);
+  assert(t->tombstones == erased - 1 && rbtree_min(t) == nodes[0]);
+  rbtree_erase(t, nodes[0]);
+
+  // compaction keeps every live node where it was
+  assert(rbtree_compact(t, 0.9) == 0 && t->tombstones == erased);
+  assert(rbtree_compact(t, 0.1) == erased && t->tombstones == 0);
+  assert(rbtree_compact(t, 0) == 0);
+  check_tree(t, live, m);
+  for (size_t i = 0; i < n; i++) {
+    if (!gone[i]) {
+      assert(rbtree_find(t, (key_t)(2 * i)) == nodes[i]);
+    }
+  }
+
+  // operations that reshape the whole tree drop the marks first
+  rbtree_erase(t, rbtree_find(t, live[m / 2]));
+  rbtree *u = rbtree_split(t, live[m / 2]);
+  assert(t->tombstones == 0 && u->tombstones == 0);
+  assert(rbtree_size(t) + rbtree_size(u) == m - 1);
+  rbtree_erase(t, rbtree_max(t));
+  assert(rbtree_join(t, live[m / 2], u) == t && t->tombstones == 0);
+  assert(rbtree_size(t) == m - 1);
+  delete_rbtree(t);
+
+  // a marked copy of a key must not hide a live one
+  t = new_rbtree();
+  rbtree_insert(t, 5);
+  rbtree_insert(t, 5);
+  rbtree_erase(t, rbtree_find(t, 5));
+  assert(rbtree_find(t, 5) != NULL && rbtree_size(t) == 1);
+  rbtree_erase(t, rbtree_find(t, 5));
+  assert(rbtree_find(t, 5) == NULL && rbtree_max(t) == t->nil);
+  delete_rbtree(t);
+  free(nodes);
+  free(live);
+  free(gone);
+}
+#endif
+
+#ifdef RBTREE_INTERVAL
+typedef struct {
+  key_t lo, hi;
+} interval;
+
+static int interval_comp(const void *p1, const void *p2) {
+  const interval *a = (const interval *)p1, *b = (const interval *)p2;
+  if (a->lo != b->lo) {
+    return (a->lo > b->lo) - (a->lo < b->lo);
+  }
+  return (a->hi > b->hi) - (a->hi < b->hi);
+}
+
+// every node's max_hi should be the largest hi in its subtree; returns that
+// (tombstones included, they only make the pruning looser)
+static key_t check_max_hi(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    return INT_MIN;
+  }
+  key_t m = p->hi;
+  const key_t l = check_max_hi(t, rbtree_left(t, p));
+  const key_t r = check_max_hi(t, rbtree_right(t, p));
+  m = l > m ? l : m;
+  m = r > m ? r : m;
+  assert(p->max_hi == m);
+  return m;
+}
+
+typedef struct {
+  interval *found;
+  size_t n, stop_after;
+} overlap_out;
+
+static int collect_overlap(node_t *p, void *ctx) {
+  overlap_out *out = (overlap_out *)ctx;
+  assert(out->n == 0 || out->found[out->n - 1].lo <= p->key);  // key order
+  out->found[out->n++] = (interval){p->key, p->hi};
+  return out->n == out->stop_after;
+}
+
+// the overlap query should report exactly the model's intervals that meet
+// [lo, hi], in key order
+static void check_overlap(const rbtree *t, const interval *model,
+                          const size_t m, const key_t lo, const key_t hi) {
+  interval *expect = calloc(m + 1, sizeof(interval));
+  size_t k = 0;
+  for (size_t i = 0; i < m; i++) {
+    if (model[i].lo <= hi && lo <= model[i].hi) {
+      expect[k++] = model[i];
+    }
+  }
+  overlap_out out = {calloc(m + 1, sizeof(interval)), 0, 0};
+  assert(rbtree_interval_overlap(t, lo, hi, collect_overlap, &out) == k);
+  assert(out.n == k);
+  qsort(expect, k, sizeof(interval), interval_comp);
+  qsort(out.found, k, sizeof(interval), interval_comp);
+  assert(k == 0 || memcmp(expect, out.found, k * sizeof(interval)) == 0);
+
+  out.n = 0;
+  out.stop_after = 1;  // the callback can stop the walk
+  assert(rbtree_interval_overlap(t, lo, hi, collect_overlap, &out) ==
+         (k > 0));
+  free(out.found);
+  free(expect);
+}
+
+// drops one interval starting at the node's key with the node's end
+static void model_drop(interval *model, size_t *m, const node_t *p) {
+  for (size_t i = 0; i < *m; i++) {
+    if (model[i].lo == p->key && model[i].hi == p->hi) {
+      model[i] = model[--*m];
+      return;
+    }
+  }
+  assert(0);
+}
+
+// random intervals through inserts, erases, split/union and erase_range,
+// checking max_hi everywhere and overlap/stabbing queries against brute force
+void test_interval(const size_t n, const unsigned int seed) {
+  srand(seed);
+  const key_t span = (key_t)(4 * n);
+  rbtree *t = new_rbtree_pool(0);
+  interval *model = calloc(2 * n + 2, sizeof(interval));
+  size_t m = 0;
+
+  assert(rbtree_interval_insert(t, 5, 4) == NULL);
+  assert(rbtree_interval_overlap(t, 0, span, collect_overlap, NULL) == 0);
+  assert(rbtree_interval_overlap(t, 5, 4, collect_overlap, NULL) == 0);
+
+  for (size_t i = 0; i < n; i++) {
+    if (m == 0 || rand() % 4 != 0) {
+      key_t lo = rand() % span;
+      key_t hi = lo + (rand() % 8 == 0 ? rand() % span : rand() % 20);
+      node_t *p = (rand() % 10 == 0) ? rbtree_insert(t, lo)  // point
+                                     : rbtree_interval_insert(t, lo, hi);
+      assert(p != NULL && p->key == lo);
+      model[m++] = (interval){lo, p->hi};
+    } else {
+      node_t *p = rbtree_find(t, model[rand() % m].lo);
+      assert(p != NULL);
+      model_drop(model, &m, p);
+      rbtree_erase(t, p);
+    }
+    if (i % 100 == 0) {
+      check_max_hi(t, t->root);
+      key_t lo = rand() % span;
+      check_overlap(t, model, m, lo, lo);  // stabbing
+      check_overlap(t, model, m, lo, lo + rand() % (span / 8));
+    }
+  }
+  check_max_hi(t, t->root);
+  check_overlap(t, model, m, INT_MIN, INT_MAX);
+  test_color_constraint(t);
+
+  // split and merge back: join_node keeps max_hi on both sides
+  rbtree *u = rbtree_split(t, span / 2);
+  check_max_hi(t, t->root);
+  check_max_hi(u, u->root);
+  assert(rbtree_union(t, u) == t);
+  check_max_hi(t, t->root);
+  check_overlap(t, model, m, span / 3, span / 2);
+
+  // erase_range drops the intervals starting in [lo, hi)
+  const key_t lo = span / 4, hi = span / 4 + span / 8;
+  size_t kept = 0;
+  for (size_t i = 0; i < m; i++) {
+    if (model[i].lo < lo || hi <= model[i].lo) {
+      model[kept++] = model[i];
+    }
+  }
+  assert(rbtree_erase_range(t, lo, hi) == m - kept);
+  m = kept;
+  check_max_hi(t, t->root);
+  for (key_t q = 0; q < span; q += span / 64) {
+    check_overlap(t, model, m, q, q);
+  }
+  purge(t);  // compaction relinks the live nodes
+  check_max_hi(t, t->root);
+  check_overlap(t, model, m, INT_MIN, INT_MAX);
+  delete_rbtree(t);
+  free(model);
+}
+#endif
+
+#ifdef RBTREE_COMPACT
+// each compact tree reserves address space for its node store; several
+// trees plus split and from_sorted results must fit under a ulimit -v
+void test_compact_reserve(const size_t n) {
+  struct rlimit old, lim;
+  assert(getrlimit(RLIMIT_AS, &old) == 0);
+  lim = old;
+  lim.rlim_cur = (rlim_t)3 << 30;
+  if (old.rlim_cur != RLIM_INFINITY && old.rlim_cur < lim.rlim_cur) {
+    lim.rlim_cur = old.rlim_cur;
+  }
+  assert(setrlimit(RLIMIT_AS, &lim) == 0);
+
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)i;
+  }
+  rbtree *trees[4];
+  for (size_t i = 0; i < 4; i++) {
+    trees[i] = new_rbtree();
+    assert(trees[i] != NULL);
+    insert_arr(trees[i], arr, n);
+  }
+  rbtree *s = rbtree_from_sorted(arr, n);
+  assert(s != NULL && rbtree_size(s) == n);
+  rbtree *r = rbtree_split(trees[0], (key_t)(n / 2));
+  assert(r != NULL && rbtree_size(r) + rbtree_size(trees[0]) == n);
+  delete_rbtree(r);
+  delete_rbtree(s);
+  for (size_t i = 0; i < 4; i++) {
+    delete_rbtree(trees[i]);
+  }
+  free(arr);
+  assert(setrlimit(RLIMIT_AS, &old) == 0);
+}
+#endif
+
+#ifndef RBTREE_COMPACT
+RBTREE_DEFINE(imap, int, int, RBTREE_CMP)
+RBTREE_DEFINE(smap, const char *, int, strcmp)
+
+// generated maps should behave like rbtree with typed keys and values
+void test_generic_map() {
+  imap *m = imap_new();
+  assert(m != NULL);
+  const int keys[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12};
+  const size_t n = sizeof(keys) / sizeof(keys[0]);
+  for (size_t i = 0; i < n; i++) {
+    assert(imap_put(m, keys[i], keys[i] * 2) != NULL);
+  }
+  assert(imap_put(m, 34, -1)->val == -1);
+  assert(imap_size(m) == n);
+  test_color_constraint(m->tree);
+
+  int prev = -1;
+  size_t count = 0;
+  for (imap_node *p = imap_min(m); p != NULL; p = imap_next(m, p)) {
+    assert(p->key > prev);
+    assert(p->val == (p->key == 34 ? -1 : p->key * 2));
+    prev = p->key;
+    count++;
+  }
+  assert(count == n);
+  assert(imap_max(m)->key == 156);
+  assert(imap_prev(m, imap_min(m)) == NULL);
+  assert(imap_lower_bound(m, 13)->key == 23);
+  assert(imap_lower_bound(m, 157) == NULL);
+
+  for (size_t i = 0; i < n; i++) {
+    imap_node *p = imap_find(m, keys[i]);
+    assert(p != NULL && p->key == keys[i]);
+    imap_erase(m, p);
+    assert(imap_find(m, keys[i]) == NULL);
+  }
+  assert(imap_min(m) == NULL);
+  imap_insert(m, 7, 1);
+  imap_insert(m, 7, 2);
+  assert(imap_size(m) == 2);
+  imap_delete(m);
+
+  smap *s = smap_new();
+  const char *words[] = {"pear", "apple", "fig", "kiwi", "banana"};
+  for (int i = 0; i < 5; i++) {
+    smap_put(s, words[i], i);
+  }
+  assert(strcmp(smap_min(s)->key, "apple") == 0);
+  assert(smap_find(s, "kiwi")->val == 3);
+  assert(smap_find(s, "grape") == NULL);
+  smap_delete(s);
+}
+#endif
+
 int main(void) {
   test_init();
   test_insert_single(1024);
@@ -383,5 +1832,40 @@ int main(void) {
   test_duplicate_values();
   test_multi_instance();
   test_find_erase_rand(10000, 17);
+  test_pool_reuse();
+  test_find_erase_pool(10000, 17);
+  test_from_sorted_suite();
+  test_iterator();
+  test_bounds_range();
+  test_order_stat(500, 17);
+  test_find_batch(5000, 17);
+  test_freeze(1000, 17);
+  test_freeze(1023, 5);
+  test_save_load(1000, 17);
+  test_join_split(300, 17);
+  test_set_ops(2000, 17);
+  test_set_ops(50, 5);
+  test_erase_range(200, 17);
+  test_erase_batch(1000, 17);
+  test_clear(3000, 17);
+  test_stats(1000);
+  test_insert_hint(2000, 17);
+  test_to_array_parallel(200000, 17);
+  test_pop(3000, 17);
+#ifdef RBTREE_COUNTED
+  test_counted();
+#endif
+#ifdef RBTREE_TOMBSTONE
+  test_tombstone(2000, 17);
+#endif
+#ifdef RBTREE_INTERVAL
+  test_interval(3000, 17);
+#endif
+#ifdef RBTREE_COMPACT
+  test_compact_reserve(1000);
+#endif
+#ifndef RBTREE_COMPACT
+  test_generic_map();
+#endif
   printf("Passed all tests!\n");
 }